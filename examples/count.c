@@ -81,28 +81,40 @@ main(int argc, char * argv[]) {
             --len;
             buffer[len] = '\0';
         }
-        // Locate the entry in the table, if it exists.  Note that if we used
-        // he4_get we would have to then do an he4_insert to update the value,
-        // which could require two searches of the table.  If the entry does
-        // not exist, then two searches will be required, still.  A "find or
-        // set" function would avoid this!
-        int * value = he4_find(table, buffer, len);
+        // Locate the entry in the table, inserting it if it does not exist.
+        // This takes a single search of the table either way.  The key is
+        // only copied if it was inserted, since the buffer is reused.
+        bool inserted = false;
+        int * value = he4_find_or_insert(table, buffer, len, &inserted);
         if (value == NULL) {
-            // The entry is not already present, so insert it.
+            // The table is full.  This cannot happen while the table is
+            // kept below full, so it is fatal.
+            he4_delete(table);
+            fprintf(stderr, "ERROR: Table is full.\n");
+            return 1;
+        }
+        // A short key is copied into the cell by the table itself (see
+        // HE4_INLINE_KEYS), so only a longer key needs a copy.
+#ifdef HE4_INLINE_KEYS
+        bool copied = len <= HE4_INLINE_KEYS;
+#else
+        bool copied = false;
+#endif // HE4_INLINE_KEYS
+        if (inserted && !copied) {
+            // The entry was not already present, so keep a copy of the key.
             char * clone = HE4MALLOC(char, len);
             if (clone == NULL) {
                 // Failed to get memory for a string, so we are dead in the
-                // water.  This is fatal.
-                he4_delete(table);
+                // water.  This is fatal.  The table still holds the buffer
+                // as a key, so it is not deleted.
                 fprintf(stderr, "ERROR: Failed to get memory.\n");
                 return 1;
             }
             memcpy(clone, buffer, len);
-            he4_insert(table, clone, len, 1);
-        } else {
-            // The entry is in the table.  Increment it.
-            ++*value;
+            he4_set_key(table, value, clone);
         }
+        // Increment the count.  A new entry starts at zero.
+        ++*value;
 
         // Handle the case of the table becoming too full.  There are two ways
         // to deal with this.  We can let the table get larger, or we can trim
@@ -130,8 +142,9 @@ main(int argc, char * argv[]) {
     for (size_t index = 0; index < table->capacity; ++index) {
         he4_map_t * map = he4_index(table, index);
         if (map != NULL && map->key != NULL) {
-            fprintf(stdout, "%4zu: \"%s\"(%zu) -> %d\n", index, map->key,
-                    map->klen, map->entry);
+            // The keys are not null-terminated.
+            fprintf(stdout, "%4zu: \"%.*s\"(%zu) -> %d\n", index,
+                    (int)map->klen, map->key, map->klen, map->entry);
         }
         HE4FREE(map);
     } // Write all counts.
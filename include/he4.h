@@ -71,7 +71,7 @@ extern "C" {
 // Define memory handling.  Feel free to override this with jeMalloc,
 // nedmalloc, or something else.  Note that to do this you simply
 // need to include the appropriate header and then \#define HE4MALLOC
-// and HE4FREE before you include this file.
+// and HE4FREE (and, optionally, HE4REALLOC) before you include this file.
 //
 // Whatever method you use should also zero out memory, a la calloc.
 // This is important!
@@ -86,6 +86,8 @@ extern "C" {
         (m_thing *)dlcalloc(m_number, sizeof(m_thing))
 #  define HE4FREE(m_ptr) \
         ((m_ptr == NULL) ? NULL : dlfree(m_ptr), NULL)
+#  define HE4REALLOC(m_ptr, m_thing, m_number) \
+        (m_thing *)dlrealloc(m_ptr, (m_number) * sizeof(m_thing))
 #else
 #ifndef HE4MALLOC
 #include <stdlib.h>
@@ -98,6 +100,24 @@ extern "C" {
  */
 #define HE4MALLOC(m_thing, m_number) \
         (m_thing *)calloc(m_number, sizeof(m_thing))
+#ifndef HE4REALLOC
+/**
+ * Resize an allocation, keeping its contents.  Unlike `HE4MALLOC`, this need
+ * not zero the new memory.  This is only defined by default along with
+ * `HE4MALLOC`; if you replace `HE4MALLOC`, then define this too, or tables
+ * will be grown by copying.
+ *
+ * @param m_ptr       Pointer to the allocation.
+ * @param m_thing     The thing allocated.  A pointer to this type is
+ *                    returned.
+ * @param m_number    How many things to allocate.
+ * @return            A pointer to the resized allocation, or NULL if it
+ *                    cannot be resized, in which case the original is
+ *                    unchanged.
+ */
+#define HE4REALLOC(m_ptr, m_thing, m_number) \
+        (m_thing *)realloc(m_ptr, (m_number) * sizeof(m_thing))
+#endif // HE4REALLOC
 #endif // HE4MALLOC
 #ifndef HE4FREE
 #include <stdlib.h>
@@ -121,6 +141,12 @@ extern "C" {
  * Specify the type of an entry.  By default this is `void *`.  To override
  * this (so the compiler can type check your code) define the macro
  * `HE4_ENTRY_TYPE`.
+ *
+ * Entries are normally pointers, and `NULL` is not a valid entry.  If
+ * `HE4_ENTRY_VALUE` is defined then entries are stored by value instead: any
+ * value (including zero) can be stored, the entry type can be any type
+ * (including a structure), and its size and alignment are those of the type.
+ * The library must then be built with the same `HE4_ENTRY_TYPE`.
  */
 typedef HE4_ENTRY_TYPE he4_entry_t;
 
@@ -138,22 +164,172 @@ typedef HE4_ENTRY_TYPE he4_entry_t;
 typedef HE4_KEY_TYPE he4_key_t;
 
 #ifndef HE4_HASH_TYPE
+#  ifdef HE4_HASH64
 /**
  * The type returned by the hash function.
  */
-#  define HE4_HASH_TYPE uint32_t
+#    define HE4_HASH_TYPE uint64_t
+#  else
+/**
+ * The type returned by the hash function.
+ */
+#    define HE4_HASH_TYPE uint32_t
+#  endif // HE4_HASH64
 #else
 /** Signal the use of a user-defined hash. */
 #  define HE4_USER_HASH
 #endif
 /**
- * Specify the type of a hash value.  By default this is `uint32_t`.  To
- * override this define the macro `HE4_HASH_TYPE` and be sure you provide
- * your own properly typed hash function when you create a table, or the
- * library won't create the table.
+ * Specify the type of a hash value.  By default this is `uint32_t`, and the
+ * default hash is XXH32.  If `HE4_HASH64` is defined then it is `uint64_t`,
+ * and the default hash is XXH3; the high seven bits of the hash then give
+ * the control byte tag and the bits below them the cell index, so tables can
+ * exceed 2^32 cells.  To override this define the macro `HE4_HASH_TYPE` and
+ * be sure you provide your own properly typed hash function when you create
+ * a table, or the library won't create the table.
  */
 typedef HE4_HASH_TYPE he4_hash_t;
 
+/**
+ * Flags that select how a table is laid out and probed.  Combine the flags
+ * with bitwise or and pass the result to `he4_new_policy`.  The policy of a
+ * table is preserved when it is rehashed.
+ */
+typedef uint32_t he4_policy_t;
+
+/**
+ * The default policy: open addressing with linear probing over the map array.
+ */
+#define HE4_POLICY_DEFAULT 0x0000
+
+/**
+ * Keep one control byte per cell, holding the state of the cell and seven
+ * bits of the hash.  Probes scan a group of 16 or 32 control bytes at once
+ * (using SSE2 or AVX2, if available) and only read the map array when the
+ * hash bits match.  This costs one additional byte per cell, but misses and
+ * runs of deleted cells become much cheaper.
+ */
+#define HE4_CONTROL_BYTES 0x0001
+
+/**
+ * Use Robin Hood insertion.  Every cell records how far it is from the cell
+ * where the probe for its hash starts, and an insertion takes the cell of
+ * any entry closer to its start than the new entry, carrying the displaced
+ * entry further on.  Deletion shifts the following entries back instead of
+ * leaving deleted cells behind, and an unsuccessful search stops as soon as
+ * it reaches an entry closer to its start than the key would be.  Probe
+ * sequences stay short and even at high load.  This costs four additional
+ * bytes per cell, and cannot be combined with `HE4_CONTROL_BYTES`.
+ */
+#define HE4_ROBIN_HOOD 0x0002
+
+/**
+ * Use hopscotch hashing.  Every entry is kept within `HE4_HOP_RANGE` cells of
+ * the cell where the probe for its hash starts, and every cell keeps a bitmap
+ * of the cells in that range holding entries that start there.  A search
+ * reads only those cells, so it costs one or two cache lines however full
+ * the table is.  Insertion finds the nearest empty cell and hops entries back
+ * towards their start until the empty cell is in range.  If that cannot be
+ * done the insertion fails (or, if forced, overwrites the least-recently-used
+ * entry in range) before the table is full, but this is rare below about 90%
+ * load.  This costs four additional bytes per cell, and cannot be combined
+ * with `HE4_CONTROL_BYTES`, `HE4_ROBIN_HOOD`, or a probe step.
+ */
+#define HE4_HOPSCOTCH 0x0004
+
+/**
+ * The number of cells, starting with the cell where the probe for its hash
+ * starts, in which a hopscotch table keeps an entry.
+ */
+#define HE4_HOP_RANGE 32
+
+/**
+ * Use bucketized cuckoo hashing.  The table is divided into buckets of
+ * `HE4_BUCKET_WAYS` consecutive cells, and every key has two candidate
+ * buckets, both taken from its hash.  A search checks at most those two
+ * buckets, however full the table is.  When both buckets of a new key are
+ * full, a breadth-first search looks for a short chain of entries that can
+ * each move to their other bucket, ending at an empty cell.  If there is none
+ * the insertion fails (or, if forced, overwrites the least-recently-used
+ * entry in the two buckets), possibly before the table is full.  The capacity
+ * is rounded up to a whole number of buckets.  This cannot be combined with
+ * `HE4_CONTROL_BYTES`, `HE4_ROBIN_HOOD`, `HE4_HOPSCOTCH`, or a probe step.
+ */
+#define HE4_CUCKOO 0x0008
+
+/**
+ * The number of cells in a bucket of a cuckoo table.
+ */
+#define HE4_BUCKET_WAYS 4
+
+/**
+ * Round the capacity up to a power of two, and reduce a hash to a cell index
+ * by masking off its low bits.  The default is to take the remainder of the
+ * hash modulo the capacity, which costs an integer division.
+ */
+#define HE4_RANGE_MASK 0x0010
+
+/**
+ * Reduce a hash to a cell index by multiplying the low 32 bits of the hash
+ * by the capacity and keeping the high 32 bits of the product (Lemire's
+ * multiply-shift reduction).  This works for any capacity up to 2^32 without
+ * division, but uses the high bits of the hash, so the hash must be good in
+ * all of its bits.  It takes precedence over `HE4_RANGE_MASK`.  If
+ * `HE4_HASH64` is defined, and the compiler has 128-bit integers, the 57
+ * bits below the control byte tag are used instead, for any capacity.
+ */
+#define HE4_RANGE_MULTIPLY 0x0020
+
+/**
+ * Probe with triangular steps: 1, 2, 3, ... cells (or groups of cells, with
+ * `HE4_CONTROL_BYTES`) from the last probe.  This breaks up the clusters that
+ * linear probing builds around popular cells.  The capacity is rounded up to
+ * a power of two, for which the sequence visits every cell.  This cannot be
+ * combined with `HE4_ROBIN_HOOD`.
+ */
+#define HE4_PROBE_TRIANGULAR 0x0100
+
+/**
+ * Probe with a fixed step taken from a second hash of the key, so that keys
+ * that start at the same cell follow different paths.  The capacity is
+ * rounded up to a power of two, and the step is always odd, so the sequence
+ * visits every cell.  This cannot be combined with `HE4_ROBIN_HOOD` or
+ * `HE4_PROBE_TRIANGULAR`.
+ */
+#define HE4_PROBE_DOUBLE 0x0200
+
+/**
+ * Promise that keys of different lengths are never equal under the key
+ * comparison function.  A probe then checks the key length along with the
+ * hash, and calls the comparison function only when both agree.  The default
+ * comparison always works this way, and is called directly rather than
+ * through the function pointer.
+ */
+#define HE4_EXACT_LENGTH 0x0400
+
+/**
+ * Align the cell arrays, control bytes, and cell metadata of the table to
+ * 64-byte cache lines, so that a group of cells or control bytes does not
+ * straddle more lines than it must.  The arrays are allocated with
+ * `HE4MALLOC` and padded.
+ */
+#define HE4_ALIGN_LINES 0x1000
+
+/**
+ * Align the arrays of the table to pages.  This implies `HE4_ALIGN_LINES`.
+ */
+#define HE4_ALIGN_PAGES 0x2000
+
+/**
+ * Back the arrays of the table with huge pages, to cut the TLB misses that
+ * dominate lookups in very large tables.  On Linux, arrays of at least one
+ * huge page (2MB) are mapped with `MAP_HUGETLB` if huge pages are reserved,
+ * and otherwise mapped normally and marked with `madvise(MADV_HUGEPAGE)` so
+ * that transparent huge pages are used.  Smaller arrays, other systems, and
+ * failed mappings fall back to `HE4_ALIGN_PAGES`.
+ */
+#define HE4_HUGE_PAGES 0x4000
+
 //======================================================================
 // Debugging.
 //======================================================================
@@ -193,23 +369,115 @@ char * he4_version(void);
 // Structure information.
 //======================================================================
 
+#if defined(HE4COMPACT) && !defined(HE4_TOUCH_LIMIT)
+/**
+ * The largest touch index kept in a compact table before the touch indices
+ * are rebased.  See `he4_max_touch`.
+ */
+#  define HE4_TOUCH_LIMIT UINT32_MAX
+#endif
+
+#ifndef HE4COMPACT
+/**
+ * The type used to store a key length.
+ */
+typedef size_t he4_klen_t;
+
 /**
- * Structure used for a mapping in a hash table.
+ * The type used to store a touch index.
+ */
+typedef size_t he4_touch_t;
+#else
+typedef uint32_t he4_klen_t;
+typedef uint32_t he4_touch_t;
+#endif // HE4COMPACT
+
+#ifdef HE4_INLINE_KEYS
+/**
+ * Storage for a short key kept inside a cell.  If `HE4_INLINE_KEYS` is
+ * defined to a number of bytes, then tables that use the default key
+ * comparison copy keys up to that length into the cell itself, and keep
+ * pointers only to longer keys.  The comparison of a short key then reads
+ * the cell instead of chasing the pointer.
+ *
+ * The table does not take ownership of a key that it stores inline: the
+ * caller keeps the key passed in, which can be a reused buffer, and
+ * `delete_key` is never called for it.  Only longer keys must be allocated
+ * for the table.
+ */
+typedef unsigned char he4_ikey_t[HE4_INLINE_KEYS];
+#endif // HE4_INLINE_KEYS
+
+/**
+ * Structure used for a mapping in a hash table.  If `HE4SOA` is defined then
+ * the table keeps each field in a separate array instead, and this structure
+ * is only used to pass mappings around (see `he4_index`).
  */
 typedef struct {
     he4_key_t key;          ///< Key.
-    size_t klen;            ///< Length of key in bytes.
+    he4_klen_t klen;        ///< Length of key in bytes.
     he4_entry_t entry;      ///< Data.
     he4_hash_t hash;        ///< Hash of the key.
 #ifndef HE4NOTOUCH
-    size_t touch;           ///< The touch index.
+    he4_touch_t touch;      ///< The touch index.
 #endif // HE4NOTOUCH
+#ifdef HE4_INLINE_KEYS
+    he4_ikey_t ikey;        ///< Copy of the key, if stored inline.
+#endif // HE4_INLINE_KEYS
 } he4_map_t;
 
+#ifndef HE4COMPACT
 /**
- * Structure defining the hash table.
+ * Structure used to store a cell of a table.  This is just a mapping, unless
+ * `HE4COMPACT` is defined.
+ */
+typedef he4_map_t he4_cell_t;
+#else
+/**
+ * Structure used to store a cell of a table.  With `HE4COMPACT` the key
+ * length, hash, and touch index are 32 bits, and the touch index is kept in
+ * a separate array, so that a cell packs into 24 bytes on LP64 systems.
  */
 typedef struct {
+    he4_key_t key;          ///< Key.
+    he4_entry_t entry;      ///< Data.
+    he4_klen_t klen;        ///< Length of key in bytes.
+    he4_hash_t hash;        ///< Hash of the key.
+#ifdef HE4_INLINE_KEYS
+    he4_ikey_t ikey;        ///< Copy of the key, if stored inline.
+#endif // HE4_INLINE_KEYS
+} he4_cell_t;
+#endif // HE4COMPACT
+
+/**
+ * The kinds of operation in a batch.  See `he4_apply_batch`.
+ */
+typedef uint32_t he4_op_kind_t;
+
+/** Insert the entry, as for `he4_insert`. */
+#define HE4_OP_INSERT 0
+/** Insert the entry, overwriting if need be, as for `he4_force_insert`. */
+#define HE4_OP_FORCE_INSERT 1
+/** Remove the entry and return it, as for `he4_remove`. */
+#define HE4_OP_REMOVE 2
+/** Remove and free the entry, as for `he4_discard`. */
+#define HE4_OP_DISCARD 3
+
+/**
+ * Structure used for one operation of a batch.  See `he4_apply_batch`.
+ */
+typedef struct {
+    he4_op_kind_t kind;     ///< The kind of operation.
+    he4_key_t key;          ///< Key.
+    size_t klen;            ///< Length of key in bytes.
+    he4_entry_t entry;      ///< Entry to insert, or the entry removed.
+    bool result;            ///< Set to the result of the operation.
+} he4_op_t;
+
+/**
+ * Structure defining the hash table.
+ */
+typedef struct he4 {
     /// Hash function.
     he4_hash_t (* hash)(he4_key_t key, size_t klen);
 
@@ -224,11 +492,46 @@ typedef struct {
     void (* delete_entry)(he4_entry_t thing);
 
     size_t capacity;        ///< Capacity of the table.
+    size_t mask;            ///< Capacity less one, if a power of two, or 0.
     size_t free;            ///< Number of free cells.
 #ifndef HE4NOTOUCH
     size_t max_touch;       ///< Maximum touch index.
 #endif // HE4NOTOUCH
-    he4_map_t * maps;       ///< The hash table.
+    he4_policy_t policy;    ///< The policy flags used to create the table.
+#ifndef HE4SOA
+    he4_cell_t * maps;      ///< The hash table.
+#else
+    he4_key_t * keys;       ///< The key of each cell.
+    he4_klen_t * klens;     ///< The key length of each cell.
+    he4_entry_t * entries;  ///< The entry of each cell.
+    he4_hash_t * hashes;    ///< The hash of each cell.
+#ifdef HE4_INLINE_KEYS
+    he4_ikey_t * ikeys;     ///< The inline key of each cell.
+#endif // HE4_INLINE_KEYS
+#endif // HE4SOA
+#if !defined(HE4NOTOUCH) && (defined(HE4SOA) || defined(HE4COMPACT))
+    he4_touch_t * touches;  ///< The touch index of each cell.
+#endif
+    uint8_t * ctrl;         ///< Control bytes, or `NULL` if not used.
+    uint32_t * meta;        ///< Per-cell probe distances or hop bitmaps.
+    size_t probe_limit;     ///< Most cells a probe visits, or 0 for all.
+    he4_map_t * stash;      ///< Overflow stash, or `NULL` if not used.
+    size_t stashed;         ///< Number of entries in the stash.
+    size_t deleted;         ///< Number of deleted cells.
+    double deleted_ratio;   ///< Fraction of deleted cells that forces a
+                            ///< compaction, or 0 for never.
+    struct he4 * old;       ///< Table being migrated by an incremental
+                            ///< rehash, or `NULL`.
+    size_t drained;         ///< Cells of the old table already migrated.
+    double low_load;        ///< Load below which the table shrinks.
+    double high_load;       ///< Load above which the table grows, or 0 to
+                            ///< never resize automatically.
+    size_t max_cells;       ///< Most cells the old and new arrays may have
+                            ///< together when resizing, or 0 for no limit.
+    uint64_t seed;          ///< Seed of the default hash.
+    size_t flood_limit;     ///< Longest probe before the table is re-seeded,
+                            ///< or 0 for never.
+    bool flooded;           ///< Whether a probe passed the flood limit.
 } HE4;
 
 //======================================================================
@@ -242,16 +545,63 @@ typedef struct {
 #define HE4_MINIMUM_SIZE 64
 #endif
 
+#ifndef HE4_STASH_SIZE
+/**
+ * The number of entries in the overflow stash of a table with a probe
+ * limit.  See `he4_set_probe_limit`.
+ */
+#define HE4_STASH_SIZE 8
+#endif
+
+#ifndef HE4_DELETED_RATIO
+/**
+ * The default fraction of the cells of a table that can be deleted before
+ * the table is compacted.  See `he4_set_deleted_ratio`.
+ */
+#define HE4_DELETED_RATIO 0.25
+#endif
+
+#ifndef HE4_BATCH
+/**
+ * The number of keys `he4_get_many` hashes and prefetches before it searches
+ * for any of them.
+ */
+#define HE4_BATCH 16
+#endif
+
+#ifndef HE4_REHASH_STEP
+/**
+ * The number of cells of the old table that each operation migrates during
+ * an incremental rehash.  See `he4_rehash_begin`.
+ */
+#define HE4_REHASH_STEP 64
+#endif
+
 /**
  * Determine the maximum size of hash table that can fit in the provided number
  * of bytes.
  *
  * @param bytes         A number of bytes.
  * @return              The maximum number of entries that can fit in that
- *                      space.  This includes all hash table overhead.
+ *                      space.  This includes all hash table overhead, but
+ *                      not the control bytes or probe distances used by
+ *                      some policies.
  */
 size_t he4_best_capacity(size_t bytes);
 
+/**
+ * Determine the capacity of a table created with the provided number of
+ * entries and policy, which may round the number up (see `he4_new_policy`).
+ * Nothing is allocated, so this can be used to check a size first.
+ *
+ * @param entries       The requested number of entries.
+ * @param policy        The policy of the table.
+ * @return              The capacity of the table, or zero if the number of
+ *                      entries is below `HE4_MINIMUM_SIZE` or too large for
+ *                      the policy.
+ */
+size_t he4_policy_capacity(size_t entries, he4_policy_t policy);
+
 /**
  * Allocate and return a new hash table that has enough space for the provided
  * number of entries.  Remember that (1) the hash table is of fixed size, and
@@ -274,7 +624,8 @@ size_t he4_best_capacity(size_t bytes);
  *     deallocate it.  This is used when an entry is discarded, overwritten, or
  *     when the entire table is deallocated.  If it is `NULL` then the default
  *     deallocator is used.  `NULL` is never passed as an argumen to this
- *     function, so checking is not necessary.
+ *     function, so checking is not necessary.  If `HE4_ENTRY_VALUE` is
+ *     defined, then `NULL` instead means that entries need no deallocation.
  *
  * If the number of entries is less than `HE4_MINIMUM_SIZE`, creation will fail.
  * If memory cannot be allocated, creation will fail.
@@ -293,6 +644,153 @@ HE4 * he4_new(size_t entries,
               void (* delete_key)(he4_key_t key),
               void (* delete_entry)(he4_entry_t thing));
 
+/**
+ * Allocate and return a new hash table using the given policy.  This is
+ * otherwise identical to `he4_new`, which uses `HE4_POLICY_DEFAULT`.
+ *
+ * If the policy requires a power of two capacity (`HE4_RANGE_MASK`,
+ * `HE4_PROBE_TRIANGULAR`, or `HE4_PROBE_DOUBLE`), then the number of entries
+ * is rounded up to the next power of two.  Use `he4_capacity` to find the
+ * actual capacity.
+ *
+ * @code{c}
+ * HE4 * table = he4_new_policy(size, HE4_CONTROL_BYTES, NULL, NULL, NULL,
+ *                              NULL);
+ * @endcode
+ *
+ * @param entries       The maximum number of entries allowed in the table.
+ * @param policy        The policy flags for the table.
+ * @param hash          A function to hash a key.
+ * @param compare       The function to compare two keys.
+ * @param delete_key    Function to deallocate a discarded key.
+ * @param delete_entry  Function to deallocate a discarded entry.
+ * @return              The newly allocated table, or NULL if creation fails.
+ */
+HE4 * he4_new_policy(size_t entries, he4_policy_t policy,
+                     he4_hash_t (* hash)(he4_key_t key, size_t klen),
+                     int (* compare)(he4_key_t key1, size_t klen1,
+                                     he4_key_t key2, size_t klen2),
+                     void (* delete_key)(he4_key_t key),
+                     void (* delete_entry)(he4_entry_t thing));
+
+/**
+ * Bound the number of cells any probe of the table visits.  A search for a
+ * key examines at most `limit` cells of the table, plus the entries of a
+ * small overflow stash of `HE4_STASH_SIZE` entries, so a bad cluster cannot
+ * make misses (or searches of a full table) walk on to the next empty cell.
+ * An insertion that finds no open cell within the limit puts the entry in
+ * the stash instead.  If the stash is full then the insertion fails, or, if
+ * forced, overwrites the least-recently-used entry within the limit.
+ * `he4_trim` moves stashed entries back into the table when it can.
+ *
+ * The limit can only be changed while the table is empty, and is kept when
+ * the table is rehashed.  A limit of zero (the default) removes the bound.
+ * Robin Hood, hopscotch, and cuckoo tables bound their searches already, and
+ * do not accept a limit.
+ *
+ * @param table         The table.
+ * @param limit         The most cells a probe visits, or zero for no limit.
+ * @return              False if the limit was set, and true if not.  This
+ *                      mirrors the usual C error return value.
+ */
+bool he4_set_probe_limit(HE4 * table, size_t limit);
+
+/**
+ * Resize the table automatically to keep its load between two marks.  When
+ * an insertion leaves the load above the high mark, an incremental rehash
+ * to double the capacity is started, and when an insertion (or `he4_trim`)
+ * finds it below the low mark, one to half the capacity is started (see
+ * `he4_rehash_begin`).  Removals never resize (see `he4_index`).  The high
+ * mark must be less than one, and the low mark less than half of the high
+ * mark, so that a table that was just resized is not immediately resized
+ * back.  Tables are never made smaller than `HE4_MINIMUM_SIZE`.
+ *
+ * If the memory limit is not zero, then a resize is only started if the
+ * old and new arrays fit within it together, since both are kept until the
+ * migration is done.  The control bytes and probe distances used by some
+ * policies are not counted (see `he4_best_capacity`).
+ *
+ * A high mark of zero turns automatic resizing off, which is the default.
+ * Then the table never allocates memory except when asked to.  Only tables
+ * that can be rehashed incrementally (see `he4_rehash_begin`) can resize
+ * automatically.
+ *
+ * @param table         The table.
+ * @param low           The load below which the table shrinks.
+ * @param high          The load above which the table grows, or 0 to turn
+ *                      automatic resizing off.
+ * @param max_bytes     The most bytes the table may use, or 0 for no limit.
+ * @return              False if the settings were accepted, and true if
+ *                      not.  This mirrors the usual C error return value.
+ */
+bool he4_set_auto_resize(HE4 * table, double low, double high,
+                         size_t max_bytes);
+
+/**
+ * Set the seed of the default hash, and rebuild the table with it.  Every
+ * table that uses the default hash gets its own seed when it is created,
+ * taken from the addresses of the table and the stack, a counter, and the
+ * time, so that the keys that collide in one table (and one run) do not
+ * collide in the next.  The seed is kept when the table is rehashed.
+ *
+ * Set the seed to share hashes between tables (see `he4_hash_key`), to make
+ * a table reproducible, or to use a seed from the system's random source,
+ * which is better than the one the library can find in portable C.  Tables
+ * with their own hash function ignore the seed.  A table that is not empty
+ * is rebuilt with the new seed, which is done as an incremental rehash, and
+ * so is only possible for the tables `he4_rehash_begin` accepts.
+ *
+ * @param table         The table.
+ * @param seed          The new seed.
+ * @return              False if the seed was set, and true if not.  This
+ *                      mirrors the usual C error return value.
+ */
+bool he4_set_seed(HE4 * table, uint64_t seed);
+
+/**
+ * Guard the table against hash flooding.  Anyone who can choose the keys of
+ * a table, and knows its hash, can choose keys that all land on the same
+ * cells, so that every search walks the whole cluster.  With a limit set, an
+ * insertion whose probe passes more than `limit` cells marks the table as
+ * flooded.  The next call that hashes a key itself (`he4_insert`,
+ * `he4_force_insert`, `he4_find_or_insert`, `he4_apply_batch`, or
+ * `he4_hash_key`) then picks a new seed and rebuilds the table with it (see
+ * `he4_set_seed`), which scatters the cluster.  Hashes from `he4_hash_key`
+ * are not valid after the table is rebuilt.
+ *
+ * A table that is merely full also has long probes, so every rebuild doubles
+ * the limit, and a table is not rebuilt over and over.  A rebuild needs
+ * memory for a second set of arrays, within any limit set by
+ * `he4_set_auto_resize`.  A limit of zero, the default, turns the guard off.
+ * Only tables that use the default hash, and that can be rehashed
+ * incrementally (see `he4_rehash_begin`), can be guarded.
+ *
+ * @param table         The table.
+ * @param limit         The most cells an insertion may probe, or zero to
+ *                      turn the guard off.
+ * @return              False if the limit was set, and true if not.  This
+ *                      mirrors the usual C error return value.
+ */
+bool he4_set_flood_limit(HE4 * table, size_t limit);
+
+/**
+ * Set the fraction of the cells of the table that can be deleted before the
+ * table is compacted.  Removing an entry leaves a deleted cell behind, which
+ * every search must pass over until an insertion reuses it, so a table under
+ * steady churn slowly fills with them.  When an insertion finds more than
+ * this fraction of the cells deleted, the table is first compacted in place
+ * (see `he4_compact`).  Removals never compact (see `he4_index`).  The
+ * default is `HE4_DELETED_RATIO`, and a ratio of zero turns automatic
+ * compaction off.  The ratio is kept when the table is rehashed.  Robin
+ * Hood, hopscotch, and cuckoo tables never have deleted cells.
+ *
+ * @param table         The table.
+ * @param ratio         The fraction of deleted cells, from zero to one.
+ * @return              False if the ratio was set, and true if not.  This
+ *                      mirrors the usual C error return value.
+ */
+bool he4_set_deleted_ratio(HE4 * table, double ratio);
+
 /**
  * Delete the HE4 table, deallocating all entries.  Do not simply free the
  * table pointer, or you will have a serious memory leak!
@@ -340,6 +838,28 @@ size_t he4_capacity(HE4 * table);
  */
 double he4_load(HE4 * table);
 
+/**
+ * Determine the number of deleted cells in the table.  These are left behind
+ * by removals, and are passed over by searches until they are reused or the
+ * table is compacted.
+ *
+ * If the table is `NULL`, then zero is returned.
+ *
+ * @param table         The table.
+ * @return              The number of deleted cells.
+ */
+size_t he4_deleted(HE4 * table);
+
+/**
+ * Get the seed of the default hash for the table (see `he4_set_seed`).
+ *
+ * If the table is `NULL`, then zero is returned.
+ *
+ * @param table         The table.
+ * @return              The seed.
+ */
+uint64_t he4_seed(HE4 * table);
+
 #ifndef HE4NOTOUCH
 /**
  * Get the highest touch index of an item in the table.
@@ -349,6 +869,10 @@ double he4_load(HE4 * table);
  * This can be used to clear out the least-recently-used items (see
  * `he4_trim_and_rehash`).
  *
+ * If `HE4COMPACT` is defined then touch indices are 32 bits.  When the
+ * maximum touch index reaches `HE4_TOUCH_LIMIT` every touch index in the
+ * table is rebased, keeping their order, so the maximum may go down.
+ *
  * If the table is `NULL`, then 0 is returned.
  *
  * @param table         The table.
@@ -366,7 +890,8 @@ size_t he4_max_touch(HE4 * table);
  * item is /not/ inserted, and is in fact discarded.
  *
  * If either the table, key, or entry is equal to `NULL`, or if the key length
- * is 0, then nothing is done and `true` is returned.
+ * is 0, then nothing is done and `true` is returned.  If `HE4_ENTRY_VALUE`
+ * is defined then the entry is not checked.
  *
  * @param table         The hash table to get the new entry.
  * @param key           The key.
@@ -383,7 +908,8 @@ bool he4_insert(HE4 * table, const he4_key_t key, const size_t klen,
  * least-recently-used item is overwritten.
  *
  * If either the table, key, or entry is equal to `NULL`, or if the key length
- * is 0, then nothing is done and `true` is returned.
+ * is 0, then nothing is done and `true` is returned.  If `HE4_ENTRY_VALUE`
+ * is defined then the entry is not checked.
  *
  * @param table         The hash table to get the new entry.
  * @param key           The key.
@@ -406,7 +932,8 @@ bool he4_force_insert(HE4 * table, const he4_key_t key, const size_t klen,
  * @param table         The hash table to search for the entry.
  * @param key           The key to delete.
  * @param klen          Length in bytes of key.
- * @return              The entry for the given key, if found.  `NULL` if not.
+ * @return              The entry for the given key, if found.  `NULL` (or
+ *                      zero, for by-value entries) if not.
  *                      In this case the caller is responsible for freeing
  *                      the entry.
  */
@@ -437,10 +964,66 @@ bool he4_discard(HE4 * table, const he4_key_t key, const size_t klen);
  * @param table         The hash table to search for the entry.
  * @param key           The key to locate.
  * @param klen          Length in bytes of key.
- * @return              The entry, or `NULL` if it was not found.
+ * @return              The entry, or `NULL` if it was not found.  If
+ *                      `HE4_ENTRY_VALUE` is defined then an all-zero entry
+ *                      is returned if it was not found; use `he4_find` to
+ *                      tell this apart from a stored zero.
  */
 he4_entry_t he4_get(HE4 * table, const he4_key_t key, const size_t klen);
 
+/**
+ * Find the entries for many keys at once.  This gives the same results as
+ * calling `he4_get` for each key in turn, but is faster for tables much
+ * larger than the processor cache.  The keys are taken `HE4_BATCH` at a time;
+ * every key of a batch is hashed, and the memory its search reads first is
+ * prefetched, before any key of the batch is searched.  The cache misses of
+ * the batch then overlap instead of following one after another.
+ *
+ * A key that is `NULL`, or that has length 0, is not found.  If the table,
+ * the keys, the lengths, or the output array is `NULL`, then nothing is done
+ * and 0 is returned.
+ *
+ * @param table         The hash table to search.
+ * @param keys          The keys to locate.
+ * @param klens         Length in bytes of each key.
+ * @param count         The number of keys.
+ * @param out           Receives the entry for each key, or `NULL` (or zero,
+ *                      for by-value entries) for each key not found.
+ * @return              The number of keys found.
+ */
+size_t he4_get_many(HE4 * table, const he4_key_t keys[], const size_t klens[],
+                    const size_t count, he4_entry_t out[]);
+
+/**
+ * Apply a batch of insertions and removals.  The keys are all hashed first,
+ * and the operations are then applied in the order of the cells where their
+ * searches start, prefetching ahead.  For tables much larger than the
+ * processor cache this turns a random access per operation into a sweep
+ * through the table.
+ *
+ * Operations on the same key are applied in the order given, but operations
+ * on different keys may be applied in any order.  This matters only if the
+ * table fills up, in which case which insertions fail, or which entries
+ * are overwritten, can differ from applying the operations one by one.
+ *
+ * The `result` of each operation is set to what the corresponding function
+ * returns: true if an insertion failed, if a forced insertion overwrote an
+ * entry, or if a key to remove was not found, and false otherwise.  An
+ * operation with a `NULL` key or a key length of 0 has result true.  The
+ * `entry` of a `HE4_OP_REMOVE` is set to the entry removed, which the caller
+ * then owns.
+ *
+ * Sorting the batch takes memory in proportion to its size.  If that cannot
+ * be had, then the operations are applied in the order given.
+ *
+ * @param table         The hash table.
+ * @param ops           The operations.
+ * @param count         The number of operations.
+ * @return              False if the batch was applied, and true if the table
+ *                      or the operations are `NULL`.
+ */
+bool he4_apply_batch(HE4 * table, he4_op_t ops[], const size_t count);
+
 //======================================================================
 // Random access.
 //======================================================================
@@ -460,6 +1043,181 @@ he4_entry_t he4_get(HE4 * table, const he4_key_t key, const size_t klen);
  */
 he4_entry_t * he4_find(HE4 * table, const he4_key_t key, const size_t klen);
 
+/**
+ * Find the entry with the specified key, inserting the key if it is not
+ * already present, and return a pointer to the entry.  A key that is
+ * inserted gets an empty entry (`NULL`, or zero if `HE4_ENTRY_VALUE` is
+ * defined), which the caller should then set.  For probing tables this takes
+ * a single search of the table, where `he4_find` followed by `he4_insert`
+ * takes two.  Counting the occurrences of keys, with the counts stored by
+ * value (see `HE4_ENTRY_VALUE`), looks like this.
+ *
+ * @code{c}
+ * bool inserted;
+ * he4_entry_t * count = he4_find_or_insert(table, word, len, &inserted);
+ * if (inserted) he4_set_key(table, count, clone(word, len));
+ * ++*count;
+ * @endcode
+ *
+ * The table takes ownership of an inserted key, just as for `he4_insert`.  If
+ * the key is only borrowed, such as a buffer that is reused, then replace it
+ * with a copy before the next operation on the table (see `he4_set_key`).
+ * A key stored inline (see `HE4_INLINE_KEYS`) is already copied into the
+ * cell, and needs no copy.
+ *
+ * If automatic resizing is enabled (see `he4_set_auto_resize`), then the
+ * load is checked before the key is inserted rather than after.
+ *
+ * If either the table or the key is equal to `NULL`, if the key length is 0,
+ * or if there is no room for the key, then nothing is done and `NULL` is
+ * returned.
+ *
+ * @param table         The hash table.
+ * @param key           The key to locate or insert.
+ * @param klen          Length in bytes of key.
+ * @param inserted      If not `NULL`, set to true if the key was inserted,
+ *                      and to false if it was already present.
+ * @return              The entry, or `NULL` if the key was not found and
+ *                      could not be inserted.
+ */
+he4_entry_t * he4_find_or_insert(HE4 * table, const he4_key_t key,
+                                 const size_t klen, bool * inserted);
+
+/**
+ * Replace the key stored with an entry by an equal key.  This is meant for
+ * storing a copy of a borrowed key passed to `he4_find_or_insert`, once it is
+ * known that the key was inserted.  The key that is replaced is not
+ * deallocated.  If the key is stored inline (see `HE4_INLINE_KEYS`), then
+ * the table keeps its own copy instead, and the caller keeps the key passed.
+ *
+ * The entry must be a pointer returned by `he4_find` or `he4_find_or_insert`,
+ * with no other operation on the table since.
+ *
+ * @param table         The hash table.
+ * @param entry         The entry whose key is replaced.
+ * @param key           The new key, which must equal the old one.
+ * @return              False if the key was replaced, and true if the entry
+ *                      is not in the table.  This mirrors the usual C error
+ *                      return value.
+ */
+bool he4_set_key(HE4 * table, he4_entry_t * entry, const he4_key_t key);
+
+//======================================================================
+// Pre-hashed access.
+//======================================================================
+
+/**
+ * Hash a key with the hash function of a table.  The result can be passed to
+ * the `_hashed` functions below, so that a key looked up repeatedly, or in
+ * several tables that share a hash function, is hashed only once.  Tables
+ * that use the default hash share it only if they have the same seed (see
+ * `he4_set_seed`).
+ *
+ * @code{c}
+ * he4_hash_t hash = he4_hash_key(routes, key, klen);
+ * he4_entry_t entry = he4_get_hashed(cache, key, klen, hash);
+ * if (entry == NULL) entry = he4_get_hashed(routes, key, klen, hash);
+ * @endcode
+ *
+ * If either the table or the key is equal to `NULL`, or if the key length is
+ * 0, then 0 is returned.
+ *
+ * @param table         The hash table.
+ * @param key           The key to hash.
+ * @param klen          Length in bytes of key.
+ * @return              The hash of the key.
+ */
+he4_hash_t he4_hash_key(HE4 * table, const he4_key_t key, const size_t klen);
+
+/**
+ * Insert an entry, as for `he4_insert`, given the hash of the key.
+ *
+ * The hash must be the one the hash function of the table gives for the key
+ * (see `he4_hash_key`).  If it is not, then the key is stored where searches
+ * will not find it.
+ *
+ * @param table         The hash table to get the new entry.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param entry         The entry to insert.
+ * @param hash          The hash of the key.
+ * @return              False if the entry was successfully inserted, and true
+ *                      if not.
+ */
+bool he4_insert_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                       const he4_entry_t entry, const he4_hash_t hash);
+
+/**
+ * Insert an entry, overwriting if need be, as for `he4_force_insert`, given
+ * the hash of the key.  See `he4_insert_hashed`.
+ *
+ * @param table         The hash table to get the new entry.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param entry         The entry to insert.
+ * @param hash          The hash of the key.
+ * @return              False if the entry was inserted without overwriting
+ *                      another entry, and true if another entry was
+ *                      overwritten.
+ */
+bool he4_force_insert_hashed(HE4 * table, const he4_key_t key,
+                             const size_t klen, const he4_entry_t entry,
+                             const he4_hash_t hash);
+
+/**
+ * Remove an entry, as for `he4_remove`, given the hash of the key.  See
+ * `he4_insert_hashed`.
+ *
+ * @param table         The hash table to search for the entry.
+ * @param key           The key to delete.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @return              The entry for the given key, if found.  `NULL` (or
+ *                      zero, for by-value entries) if not.
+ */
+he4_entry_t he4_remove_hashed(HE4 * table, const he4_key_t key,
+                              const size_t klen, const he4_hash_t hash);
+
+/**
+ * Remove and free an entry, as for `he4_discard`, given the hash of the key.
+ * See `he4_insert_hashed`.
+ *
+ * @param table         The hash table to search for the entry.
+ * @param key           The key to delete.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @return              False if the entry was successfully removed, and true
+ *                      if not.
+ */
+bool he4_discard_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                        const he4_hash_t hash);
+
+/**
+ * Find and return an entry, as for `he4_get`, given the hash of the key.  See
+ * `he4_insert_hashed`.
+ *
+ * @param table         The hash table to search for the entry.
+ * @param key           The key to locate.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @return              The entry, or `NULL` if it was not found.
+ */
+he4_entry_t he4_get_hashed(HE4 * table, const he4_key_t key,
+                           const size_t klen, const he4_hash_t hash);
+
+/**
+ * Find and return a pointer to an entry, as for `he4_find`, given the hash of
+ * the key.  See `he4_insert_hashed`.
+ *
+ * @param table         The hash table to search for the entry.
+ * @param key           The key to locate.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @return              The entry, or `NULL` if it was not found.
+ */
+he4_entry_t * he4_find_hashed(HE4 * table, const he4_key_t key,
+                              const size_t klen, const he4_hash_t hash);
+
 //======================================================================
 // Direct access.
 //======================================================================
@@ -477,7 +1235,19 @@ he4_entry_t * he4_find(HE4 * table, const he4_key_t key, const size_t klen);
  * @endcode
  *
  * Caution: Do not deallocate the key or entry.  When you are done with the
- * returned mapping, just free it using HE4FREE.
+ * returned mapping, just free it using HE4FREE.  A key stored inline (see
+ * `HE4_INLINE_KEYS`) points to the copy in the returned mapping, so it is
+ * good until the mapping is freed.
+ *
+ * The entries in the overflow stash of a table with a probe limit (see
+ * `he4_set_probe_limit`) follow the cells, at indices from `capacity` up to
+ * `capacity + stashed`.
+ *
+ * Entries in the cells of the table can be removed while walking it this
+ * way, except in a Robin Hood table, whose removals shift the following
+ * entries back.  Otherwise a removal moves no other entry, and removals
+ * never compact or resize the table; that is left to the next insertion.  A
+ * removal from the stash moves its last entry into the gap.
  *
  * @param table         The hash table.
  * @param index         The zero-based index.
@@ -496,9 +1266,10 @@ he4_map_t * he4_index(HE4 * table, const size_t index);
  * If the new table cannot be created, then `NULL` is returned and the old
  * table is not freed.
  *
- * If the provided size is not larger than the original size then the original
- * table is returned.  If the provided size is zero, then the new size will be
- * double the original size.
+ * If the provided size is the original size, or is too small to hold the
+ * entries of the table, then the original table is returned.  A smaller size
+ * shrinks the table, though never below `HE4_MINIMUM_SIZE`.  If the provided
+ * size is zero, then the new size will be double the original size.
  *
  * In summary: If the return value is not `NULL`, then use the return value
  * and do not worry about the original table - it has either been freed or it
@@ -511,6 +1282,106 @@ he4_map_t * he4_index(HE4 * table, const size_t index);
  */
 HE4 * he4_rehash(HE4 * table, const size_t newsize);
 
+/**
+ * Rehash the table to one with the provided size and policy.  This works
+ * like `he4_rehash`, except that the new table uses the given policy, so a
+ * table can be switched to another probing scheme.  If the policy differs
+ * from the original, the new size may equal the original size.
+ *
+ * @param table         The original table.
+ * @param newsize       The new table size.
+ * @param policy        The policy flags for the new table.
+ * @return              The new table, or `NULL` if it cannot be created.
+ */
+HE4 * he4_rehash_policy(HE4 * table, const size_t newsize,
+                        he4_policy_t policy);
+
+/**
+ * Grow the table in place to the provided size.  Unlike `he4_rehash`, this
+ * does not build a second table: the arrays of the table are extended with
+ * `HE4REALLOC` (or `mremap`, for tables backed by huge pages), which can
+ * usually be done without copying, and then the entries are moved to their
+ * new places in a single pass using their stored hashes (see
+ * `he4_compact`).  Peak memory use is the new size of the table, rather than
+ * the old and new sizes together.  If `HE4MALLOC` is replaced without also
+ * defining `HE4REALLOC`, then each array is copied in turn, so the peak is
+ * the new size plus the largest array.
+ *
+ * If the provided size is zero, then the new size is double the original
+ * size.  If the provided size is not larger than the original size, then
+ * nothing is done.  Robin Hood, hopscotch, and cuckoo tables, and tables with
+ * a probe limit, cannot grow in place; use `he4_rehash` for them.  If the
+ * table cannot grow, then it is unchanged.
+ *
+ * @param table         The table.
+ * @param newsize       The new table size.
+ * @return              False if the table was grown (or was large enough),
+ *                      and true if not.  This mirrors the usual C error
+ *                      return value.
+ */
+bool he4_grow(HE4 * table, const size_t newsize);
+
+/**
+ * Start an incremental rehash of the table to the provided size.  Unlike
+ * `he4_rehash`, this does not move the entries all at once.  The table gets
+ * new arrays, and the old arrays are kept until every entry has moved.  Each
+ * later insertion, search, or removal first migrates `HE4_REHASH_STEP` cells
+ * of the old arrays, and searches look in both until the migration is done,
+ * so no single call pays for the whole rehash.  Use `he4_rehash_step` to make
+ * progress while the table is otherwise idle.  The table keeps its address.
+ *
+ * Functions that walk or rebuild the whole table (`he4_index`, `he4_trim`,
+ * `he4_grow`, and the rehash functions) first finish the migration.
+ * Migration may move entries within the new arrays, so pointers from
+ * `he4_find` are only good until the next operation on the table, as with
+ * insertion.
+ *
+ * If the provided size is zero, then the new size is double the original
+ * size.  If the provided size is the original size, or is too small to hold
+ * the entries of the table, then nothing is done.  A smaller size shrinks the
+ * table, though never below `HE4_MINIMUM_SIZE`.  If a rehash is already in
+ * progress, it is finished first.  Hopscotch and cuckoo tables, and tables
+ * with a probe limit, cannot be rehashed incrementally, since placing an
+ * entry in them can fail; use `he4_rehash` for them.  If the rehash cannot
+ * start, then the table is unchanged.
+ *
+ * @param table         The table.
+ * @param newsize       The new table size.
+ * @return              False if the rehash was started (or the table was
+ *                      large enough), and true if not.  This mirrors the
+ *                      usual C error return value.
+ */
+bool he4_rehash_begin(HE4 * table, const size_t newsize);
+
+/**
+ * Continue an incremental rehash, migrating at most the given number of
+ * cells of the old arrays.  When every cell has been migrated the old arrays
+ * are freed.  A budget of zero just reports the progress.  See
+ * `he4_rehash_begin`.
+ *
+ * If the table is `NULL`, or no rehash is in progress, then zero is
+ * returned.
+ *
+ * @param table         The table.
+ * @param budget        The most cells to migrate.
+ * @return              The number of cells still to migrate, which is zero
+ *                      once the rehash is done.
+ */
+size_t he4_rehash_step(HE4 * table, size_t budget);
+
+/**
+ * Compact the table in place, so that it has no deleted cells.  Every entry
+ * is moved to the first cell of its probe sequence that is free once the
+ * deleted cells are emptied.  This takes a single pass over the table and
+ * allocates no memory.  With a probe limit, entries only move to earlier
+ * cells within the limit, and the pass repeats until none moves.  It is
+ * done automatically when an insertion finds too many deleted cells (see
+ * `he4_set_deleted_ratio`), and by `he4_trim`.
+ *
+ * @param table         The table.
+ */
+void he4_compact(HE4 * table);
+
 #ifndef HE4NOTOUCH
 /**
  * Trim old entries from the table and compress deleted cells to improve search
@@ -530,8 +1401,9 @@ void he4_trim(HE4 * table, const size_t trim_below);
  * If the new table cannot be created, then `NULL` is returned and the old
  * table is not freed.
  *
- * If the new size is smaller than the original size, then the original table
- * is returned with no changes.
+ * If the new size is too small to hold the entries that are kept, then the
+ * original size is used.  A smaller size shrinks the table, though never
+ * below `HE4_MINIMUM_SIZE`.
  *
  * In summary: If the return value is not `NULL`, then use the return value
  * and do not worry about the original table - it has either been freed or it
@@ -0,0 +1,736 @@
+#ifndef HE4_HPP
+#define HE4_HPP
+
+/**
+ * @file
+ * A fixed-size hash table template for C++.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ *
+ * # Overview
+ *
+ * The class template `he4::table<K, V, Hash, Eq, Alloc>` is a header-only
+ * table for C++ (C++17 or later).  The keys and values are stored in the
+ * table's cells, and are moved there rather than boxed, and the hash and
+ * equality are function objects that the compiler can inline.
+ *
+ * @code{cpp}
+ * #include <he4.hpp>
+ *
+ * he4::table<std::string, int> table(1000);
+ * table.insert_or_assign("spoon", 1);
+ * auto it = table.find(std::string_view("spoon"));
+ * if (it != table.end()) ++it->second;
+ * @endcode
+ *
+ * Like the tables of `he4.h`, these are fixed-size: the cells are allocated
+ * when the table is made, and never again.  An insertion into a full table
+ * fails, except for `force_insert`, which, like `he4_force_insert`, replaces
+ * the least-recently-used entry.  Every insertion and every non-const `find`
+ * sets the touch index of the entry.
+ *
+ * When both the hash and the equality have a member type `is_transparent`,
+ * the lookup functions accept any type they accept, so a table keyed by
+ * `std::string` can be searched with a `std::string_view` or a `const char *`
+ * without making a string.  The default hash `he4::hash<std::string>` and the
+ * default equality `std::equal_to<>` are both transparent.
+ *
+ * The table probes linearly through a power of two array of cells, with one
+ * control byte per cell, in the same way as the tables of `he4gen.h`.
+ * Removal shifts the following entries back, so there are never deleted
+ * cells.  Inserting may invalidate iterators only when it replaces an entry,
+ * but removal invalidates every iterator.
+ *
+ * This header does not use the C library, and cannot be included in the same
+ * file as `he4.h`, whose table structure is named `struct he4`.
+ *
+ * As for `std::unordered_map`, the entries are seen as `std::pair<const K,
+ * V>`, so a key cannot be changed through an iterator.  The cells hold a
+ * `std::pair<K, V>` of the same layout, so that removal can move the
+ * entries that it shifts back.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#ifndef HE4_MINIMUM_SIZE
+/**
+ * The smallest table, as for `he4.h`.
+ */
+#define HE4_MINIMUM_SIZE 64
+#endif
+
+namespace he4 {
+
+/**
+ * The default hash for `he4::table`.  This is `std::hash`, except for
+ * `std::string`.
+ */
+template <class K>
+struct hash : std::hash<K> {};
+
+/**
+ * The default hash for strings.  This is transparent, and hashes any type
+ * that converts to `std::string_view`.
+ */
+template <>
+struct hash<std::string> {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view key) const noexcept {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+namespace detail {
+
+// True when both the hash and the equality are transparent.
+template <class H, class E, class = void>
+struct transparent : std::false_type {};
+
+template <class H, class E>
+struct transparent<H, E, std::void_t<typename H::is_transparent,
+                                     typename E::is_transparent>>
+    : std::true_type {};
+
+// The type accepted by lookups.  The alias is written so that the type can
+// be deduced from the argument in the transparent case.
+template <bool Transparent>
+struct key_arg {
+    template <class Q, class K>
+    using type = K;
+};
+
+template <>
+struct key_arg<true> {
+    template <class Q, class K>
+    using type = Q;
+};
+
+} // namespace detail
+
+/**
+ * A fixed-size table mapping keys of type `K` to values of type `V`.
+ *
+ * @tparam K            The key type.
+ * @tparam V            The value type.
+ * @tparam Hash         The hash function object.
+ * @tparam Eq           The equality function object.
+ * @tparam Alloc        The allocator, which is rebound for the cells.
+ */
+template <class K, class V, class Hash = hash<K>, class Eq = std::equal_to<>,
+          class Alloc = std::allocator<std::pair<const K, V>>>
+class table {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<const K, V>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = Eq;
+    using allocator_type = Alloc;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+private:
+    // An entry as it is stored, with a key that can be moved from.
+    using slot_type = std::pair<K, V>;
+    static_assert(sizeof(slot_type) == sizeof(value_type) &&
+                  alignof(slot_type) == alignof(value_type),
+                  "stored and visible entries must have the same layout");
+
+    // Raw storage for one entry.
+    struct cell {
+        alignas(slot_type) unsigned char bytes[sizeof(slot_type)];
+    };
+
+    using traits = std::allocator_traits<Alloc>;
+    using cell_alloc = typename traits::template rebind_alloc<cell>;
+    using ctrl_alloc = typename traits::template rebind_alloc<std::uint8_t>;
+    using touch_alloc = typename traits::template rebind_alloc<std::uint64_t>;
+
+    // The type accepted by lookups: anything, if the hash and equality are
+    // transparent, and otherwise the key type.
+    template <class Q>
+    using key_arg = typename detail::key_arg<
+            detail::transparent<Hash, Eq>::value>::template type<Q, K>;
+
+    static constexpr size_type npos = ~size_type(0);
+
+    template <bool Const>
+    class basic_iterator {
+        using table_ptr = std::conditional_t<Const, const table *, table *>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename table::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::conditional_t<Const, const value_type &,
+                                             value_type &>;
+        using pointer = std::conditional_t<Const, const value_type *,
+                                           value_type *>;
+
+        basic_iterator() = default;
+
+        template <bool C = Const, class = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false> & other) noexcept
+            : table_(other.table_), index_(other.index_) {}
+
+        reference operator*() const { return table_->value(index_); }
+        pointer operator->() const { return &table_->value(index_); }
+
+        basic_iterator & operator++() {
+            index_ = table_->next_used(index_ + 1);
+            return *this;
+        }
+
+        basic_iterator operator++(int) {
+            basic_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        friend bool operator==(const basic_iterator & lhs,
+                               const basic_iterator & rhs) noexcept {
+            return lhs.index_ == rhs.index_ && lhs.table_ == rhs.table_;
+        }
+
+        friend bool operator!=(const basic_iterator & lhs,
+                               const basic_iterator & rhs) noexcept {
+            return !(lhs == rhs);
+        }
+
+    private:
+        friend class table;
+        friend class basic_iterator<!Const>;
+
+        basic_iterator(table_ptr owner, size_type index) noexcept
+            : table_(owner), index_(index) {}
+
+        table_ptr table_ = nullptr;
+        size_type index_ = 0;
+    };
+
+public:
+    /**
+     * The iterator.  The key of an entry is const through it.
+     */
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /**
+     * Make a table with at least the given number of cells, rounded up to a
+     * power of two and to `HE4_MINIMUM_SIZE`.
+     *
+     * @param entries       The number of cells.
+     * @param hash          The hash function object.
+     * @param eq            The equality function object.
+     * @param alloc         The allocator.
+     * @throws std::length_error if the table would be too large.
+     */
+    explicit table(size_type entries, const Hash & hash = Hash(),
+                   const Eq & eq = Eq(), const Alloc & alloc = Alloc())
+        : hash_(hash), eq_(eq), cells_alloc_(alloc) {
+        if (entries < HE4_MINIMUM_SIZE) entries = HE4_MINIMUM_SIZE;
+        size_type capacity = 2;
+        unsigned bits = 1;
+        while (capacity < entries) {
+            if (bits >= 57) throw std::length_error("he4::table too large");
+            capacity <<= 1;
+            ++bits;
+        }
+        allocate(capacity);
+        shift_ = 64 - bits;
+    }
+
+    table(const table & other)
+        : hash_(other.hash_), eq_(other.eq_),
+          cells_alloc_(traits::select_on_container_copy_construction(
+                  Alloc(other.cells_alloc_))) {
+        if (other.capacity_ == 0) return;
+        allocate(other.capacity_);
+        shift_ = other.shift_;
+        try {
+            for (size_type index = 0; index < capacity_; ++index) {
+                if (other.ctrl_[index] == 0) continue;
+                ::new (cells_[index].bytes) slot_type(other.slot(index));
+                ctrl_[index] = other.ctrl_[index];
+                touch_[index] = other.touch_[index];
+                ++size_;
+            } // Copy every entry.
+        } catch (...) {
+            release();
+            throw;
+        }
+        max_touch_ = other.max_touch_;
+    }
+
+    table(table && other) noexcept
+        : hash_(std::move(other.hash_)), eq_(std::move(other.eq_)),
+          cells_alloc_(std::move(other.cells_alloc_)) {
+        steal(other);
+    }
+
+    table & operator=(const table & other) {
+        if (this != &other) {
+            table copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    table & operator=(table && other) noexcept {
+        if (this != &other) {
+            release();
+            hash_ = std::move(other.hash_);
+            eq_ = std::move(other.eq_);
+            cells_alloc_ = std::move(other.cells_alloc_);
+            steal(other);
+        }
+        return *this;
+    }
+
+    ~table() { release(); }
+
+    /**
+     * Insert a key and a value made from the arguments, unless the key is
+     * already in the table.  The key and arguments are not used if the key
+     * is found or the table is full.
+     *
+     * @param key           The key.
+     * @param args          The arguments to the value's constructor.
+     * @return              The entry, or `end()` if the table is full, and
+     *                      whether the entry was inserted.
+     */
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const key_type & key,
+                                          Args &&... args) {
+        return emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(key_type && key, Args &&... args) {
+        return emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /**
+     * Insert an entry, unless its key is already in the table.
+     *
+     * @param entry         The entry.
+     * @return              As for `try_emplace`.
+     */
+    std::pair<iterator, bool> insert(const value_type & entry) {
+        return emplace_key(entry.first, entry.second);
+    }
+
+    std::pair<iterator, bool> insert(value_type && entry) {
+        return emplace_key(std::move(entry.first), std::move(entry.second));
+    }
+
+    /**
+     * Insert a key and value, or assign the value if the key is already in
+     * the table.
+     *
+     * @param key           The key.
+     * @param value         The value.
+     * @return              As for `try_emplace`.
+     */
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(const key_type & key,
+                                               M && value) {
+        return assign_key(key, std::forward<M>(value));
+    }
+
+    template <class M>
+    std::pair<iterator, bool> insert_or_assign(key_type && key, M && value) {
+        return assign_key(std::move(key), std::forward<M>(value));
+    }
+
+    /**
+     * Insert a key and value, or assign the value if the key is already in
+     * the table.  If the table is full, the least-recently-used entry is
+     * replaced, as by `he4_force_insert`.
+     *
+     * @param key           The key.
+     * @param value         The value.
+     * @return              True if an entry was replaced, and false if not.
+     */
+    template <class M>
+    bool force_insert(const key_type & key, M && value) {
+        return force_key(key, std::forward<M>(value));
+    }
+
+    template <class M>
+    bool force_insert(key_type && key, M && value) {
+        return force_key(std::move(key), std::forward<M>(value));
+    }
+
+    /**
+     * Find the entry for a key, and set its touch index.
+     *
+     * @param key           The key.
+     * @return              The entry, or `end()` if it is not found.
+     */
+    template <class Q = key_type>
+    iterator find(const key_arg<Q> & key) {
+        size_type index = lookup(key);
+        if (index == npos) return end();
+        touch(index);
+        return iterator(this, index);
+    }
+
+    /**
+     * Find the entry for a key, without setting its touch index.
+     *
+     * @param key           The key.
+     * @return              The entry, or `end()` if it is not found.
+     */
+    template <class Q = key_type>
+    const_iterator find(const key_arg<Q> & key) const {
+        size_type index = lookup(key);
+        return index == npos ? end() : const_iterator(this, index);
+    }
+
+    template <class Q = key_type>
+    bool contains(const key_arg<Q> & key) const {
+        return lookup(key) != npos;
+    }
+
+    template <class Q = key_type>
+    size_type count(const key_arg<Q> & key) const {
+        return lookup(key) != npos ? 1 : 0;
+    }
+
+    /**
+     * Get the value for a key, setting its touch index.
+     *
+     * @param key           The key.
+     * @return              The value.
+     * @throws std::out_of_range if the key is not found.
+     */
+    template <class Q = key_type>
+    mapped_type & at(const key_arg<Q> & key) {
+        size_type index = lookup(key);
+        if (index == npos) throw std::out_of_range("he4::table::at");
+        touch(index);
+        return value(index).second;
+    }
+
+    template <class Q = key_type>
+    const mapped_type & at(const key_arg<Q> & key) const {
+        size_type index = lookup(key);
+        if (index == npos) throw std::out_of_range("he4::table::at");
+        return value(index).second;
+    }
+
+    /**
+     * Remove the entry for a key.
+     *
+     * @param key           The key.
+     * @return              The number of entries removed.
+     */
+    template <class Q = key_type>
+    size_type erase(const key_arg<Q> & key) {
+        size_type index = lookup(key);
+        if (index == npos) return 0;
+        slot(index).~slot_type();
+        // Shift back each following entry that may move to the gap.
+        const size_type mask = capacity_ - 1;
+        size_type next = (index + 1) & mask;
+        while (ctrl_[next] != 0 && next != index) {
+            size_type home = home_cell(mix(value(next).first));
+            if (((next - home) & mask) >= ((next - index) & mask)) {
+                ::new (cells_[index].bytes) slot_type(std::move(slot(next)));
+                slot(next).~slot_type();
+                ctrl_[index] = ctrl_[next];
+                touch_[index] = touch_[next];
+                index = next;
+            }
+            next = (next + 1) & mask;
+        }
+        ctrl_[index] = 0;
+        --size_;
+        return 1;
+    }
+
+    /**
+     * Remove every entry.
+     */
+    void clear() noexcept {
+        for (size_type index = 0; index < capacity_; ++index) {
+            if (ctrl_[index] == 0) continue;
+            slot(index).~slot_type();
+            ctrl_[index] = 0;
+        } // Destroy every entry.
+        size_ = 0;
+    }
+
+    void swap(table & other) noexcept {
+        using std::swap;
+        swap(hash_, other.hash_);
+        swap(eq_, other.eq_);
+        swap(cells_alloc_, other.cells_alloc_);
+        swap(capacity_, other.capacity_);
+        swap(size_, other.size_);
+        swap(shift_, other.shift_);
+        swap(max_touch_, other.max_touch_);
+        swap(ctrl_, other.ctrl_);
+        swap(touch_, other.touch_);
+        swap(cells_, other.cells_);
+    }
+
+    friend void swap(table & lhs, table & rhs) noexcept { lhs.swap(rhs); }
+
+    iterator begin() noexcept { return iterator(this, next_used(0)); }
+    iterator end() noexcept { return iterator(this, capacity_); }
+    const_iterator begin() const noexcept {
+        return const_iterator(this, next_used(0));
+    }
+    const_iterator end() const noexcept {
+        return const_iterator(this, capacity_);
+    }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    size_type size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    size_type capacity() const noexcept { return capacity_; }
+    hasher hash_function() const { return hash_; }
+    key_equal key_eq() const { return eq_; }
+    allocator_type get_allocator() const {
+        return allocator_type(cells_alloc_);
+    }
+
+private:
+    slot_type & slot(size_type index) noexcept {
+        return *std::launder(reinterpret_cast<slot_type *>(
+                cells_[index].bytes));
+    }
+
+    const slot_type & slot(size_type index) const noexcept {
+        return *std::launder(reinterpret_cast<const slot_type *>(
+                cells_[index].bytes));
+    }
+
+    // The entry in a cell as it is seen from outside, with a const key.
+    value_type & value(size_type index) noexcept {
+        return reinterpret_cast<value_type &>(slot(index));
+    }
+
+    const value_type & value(size_type index) const noexcept {
+        return reinterpret_cast<const value_type &>(slot(index));
+    }
+
+    template <class Q>
+    std::uint64_t mix(const Q & key) const {
+        return std::uint64_t(hash_(key)) * UINT64_C(0x9E3779B97F4A7C15);
+    }
+
+    size_type home_cell(std::uint64_t mixed) const noexcept {
+        return size_type(mixed >> shift_);
+    }
+
+    std::uint8_t tag(std::uint64_t mixed) const noexcept {
+        return std::uint8_t(0x80 | ((mixed >> (shift_ - 7)) & 0x7F));
+    }
+
+    void touch(size_type index) noexcept { touch_[index] = ++max_touch_; }
+
+    size_type next_used(size_type index) const noexcept {
+        while (index < capacity_ && ctrl_[index] == 0) ++index;
+        return index;
+    }
+
+    // Find the cell holding the key, or return npos and set open to the
+    // first empty cell on the probe path, or to npos if the table is full.
+    template <class Q>
+    size_type search(const Q & key, std::uint64_t mixed,
+                     size_type & open) const {
+        open = npos;
+        if (capacity_ == 0) return npos;
+        const size_type mask = capacity_ - 1;
+        const std::uint8_t want = tag(mixed);
+        size_type index = home_cell(mixed);
+        for (size_type count = 0; count < capacity_; ++count) {
+            const std::uint8_t ctrl = ctrl_[index];
+            if (ctrl == 0) {
+                open = index;
+                return npos;
+            }
+            if (ctrl == want && eq_(value(index).first, key)) return index;
+            index = (index + 1) & mask;
+        }
+        return npos;
+    }
+
+    template <class Q>
+    size_type lookup(const Q & key) const {
+        size_type open;
+        return search(key, mix(key), open);
+    }
+
+    // Construct an entry in an empty cell.
+    template <class... Args>
+    void construct(size_type index, std::uint64_t mixed, Args &&... args) {
+        ::new (cells_[index].bytes) slot_type(std::forward<Args>(args)...);
+        ctrl_[index] = tag(mixed);
+        touch(index);
+        ++size_;
+    }
+
+    template <class KK, class... Args>
+    std::pair<iterator, bool> emplace_key(KK && key, Args &&... args) {
+        const std::uint64_t mixed = mix(key);
+        size_type open;
+        size_type index = search(key, mixed, open);
+        if (index != npos) {
+            touch(index);
+            return { iterator(this, index), false };
+        }
+        if (open == npos) return { end(), false };
+        construct(open, mixed, std::piecewise_construct,
+                  std::forward_as_tuple(std::forward<KK>(key)),
+                  std::forward_as_tuple(std::forward<Args>(args)...));
+        return { iterator(this, open), true };
+    }
+
+    template <class KK, class M>
+    std::pair<iterator, bool> assign_key(KK && key, M && value) {
+        const std::uint64_t mixed = mix(key);
+        size_type open;
+        size_type index = search(key, mixed, open);
+        if (index != npos) {
+            this->value(index).second = std::forward<M>(value);
+            touch(index);
+            return { iterator(this, index), false };
+        }
+        if (open == npos) return { end(), false };
+        construct(open, mixed, std::forward<KK>(key), std::forward<M>(value));
+        return { iterator(this, open), true };
+    }
+
+    template <class KK, class M>
+    bool force_key(KK && key, M && value) {
+        if (capacity_ == 0) return false;
+        const std::uint64_t mixed = mix(key);
+        size_type open;
+        size_type index = search(key, mixed, open);
+        if (index != npos) {
+            this->value(index).second = std::forward<M>(value);
+            touch(index);
+            return false;
+        }
+        if (open != npos) {
+            construct(open, mixed, std::forward<KK>(key),
+                      std::forward<M>(value));
+            return false;
+        }
+        // The table is full, so replace the least-recently-used entry.  The
+        // new entry is made first, so that the table is unchanged if that
+        // throws.
+        slot_type entry(std::forward<KK>(key), std::forward<M>(value));
+        size_type oldest = 0;
+        for (index = 1; index < capacity_; ++index) {
+            if (touch_[index] < touch_[oldest]) oldest = index;
+        } // Find the lowest touch index.
+        erase(this->value(oldest).first);
+        // The erase opened a cell on the probe path of the new key.
+        search(entry.first, mixed, open);
+        construct(open, mixed, std::move(entry));
+        return true;
+    }
+
+    void allocate(size_type capacity) {
+        ctrl_alloc ca(cells_alloc_);
+        touch_alloc ta(cells_alloc_);
+        ctrl_ = std::allocator_traits<ctrl_alloc>::allocate(ca, capacity);
+        try {
+            touch_ = std::allocator_traits<touch_alloc>::allocate(ta, capacity);
+            try {
+                cells_ = std::allocator_traits<cell_alloc>::allocate(
+                        cells_alloc_, capacity);
+            } catch (...) {
+                std::allocator_traits<touch_alloc>::deallocate(ta, touch_,
+                                                               capacity);
+                throw;
+            }
+        } catch (...) {
+            std::allocator_traits<ctrl_alloc>::deallocate(ca, ctrl_, capacity);
+            ctrl_ = nullptr;
+            touch_ = nullptr;
+            throw;
+        }
+        for (size_type index = 0; index < capacity; ++index) {
+            ctrl_[index] = 0;
+            touch_[index] = 0;
+        } // Mark every cell empty.
+        capacity_ = capacity;
+    }
+
+    void release() noexcept {
+        if (capacity_ == 0) return;
+        clear();
+        ctrl_alloc ca(cells_alloc_);
+        touch_alloc ta(cells_alloc_);
+        std::allocator_traits<ctrl_alloc>::deallocate(ca, ctrl_, capacity_);
+        std::allocator_traits<touch_alloc>::deallocate(ta, touch_, capacity_);
+        std::allocator_traits<cell_alloc>::deallocate(cells_alloc_, cells_,
+                                                      capacity_);
+        ctrl_ = nullptr;
+        touch_ = nullptr;
+        cells_ = nullptr;
+        capacity_ = 0;
+        max_touch_ = 0;
+    }
+
+    // Take the cells of another table, leaving it with none.
+    void steal(table & other) noexcept {
+        capacity_ = other.capacity_;
+        size_ = other.size_;
+        shift_ = other.shift_;
+        max_touch_ = other.max_touch_;
+        ctrl_ = other.ctrl_;
+        touch_ = other.touch_;
+        cells_ = other.cells_;
+        other.capacity_ = 0;
+        other.size_ = 0;
+        other.max_touch_ = 0;
+        other.ctrl_ = nullptr;
+        other.touch_ = nullptr;
+        other.cells_ = nullptr;
+    }
+
+    Hash hash_;
+    Eq eq_;
+    cell_alloc cells_alloc_;
+    size_type capacity_ = 0;
+    size_type size_ = 0;
+    unsigned shift_ = 64;
+    std::uint64_t max_touch_ = 0;
+    std::uint8_t * ctrl_ = nullptr;
+    std::uint64_t * touch_ = nullptr;
+    cell * cells_ = nullptr;
+};
+
+} // namespace he4
+
+#endif // HE4_HPP
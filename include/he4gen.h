@@ -0,0 +1,276 @@
+#ifndef HE4GEN_H
+#define HE4GEN_H
+
+/**
+ * @file
+ * Generate hash tables specialized for a key type and an entry type.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ *
+ * # Overview
+ *
+ * The tables of `he4.h` call the hash, comparison, and deallocation
+ * functions through pointers, and have a single key type and entry type for
+ * the whole program.  The macro `HE4_DECLARE` instead writes a table for one
+ * key type and one entry type into the translation unit that uses it, with
+ * the hash and comparison inlined into every probe.  Any number of such
+ * tables, with different types, can be declared in one program.
+ *
+ * @code{c}
+ * #include <he4gen.h>
+ *
+ * HE4_DECLARE(counts, uint64_t, uint32_t, HE4_HASH_INT, HE4_EQ_INT)
+ *
+ * counts_t * table = counts_new(1000);
+ * counts_insert(table, 42, 1);
+ * uint32_t * count = counts_find(table, 42);
+ * if (count != NULL) ++*count;
+ * counts_delete(table);
+ * @endcode
+ *
+ * Like the tables of `he4.h`, these are fixed-size: new memory is never
+ * allocated once the table is created, and an insertion into a full table
+ * fails.  The table does not own its keys or entries, and never frees them.
+ *
+ * The table probes linearly through a power of two array of cells, and keeps
+ * one control byte per cell.  The hash of a key is multiplied by a constant
+ * (Fibonacci hashing), so that the home cell comes from its high bits and the
+ * control byte from the bits below them; even the identity is a good hash
+ * for integer keys.  A search compares a key only when the control byte
+ * matches.  Removal shifts the following entries back, so there are never
+ * deleted cells.
+ */
+
+#include <string.h>
+#include <he4.h>
+
+/**
+ * Hash an integer key for `HE4_DECLARE`.  The table mixes the hash itself,
+ * so the key can serve as its own hash.
+ *
+ * @param m_key         The key.
+ * @return              The hash.
+ */
+#define HE4_HASH_INT(m_key) ((uint64_t)(m_key))
+
+/**
+ * Compare two keys for `HE4_DECLARE` with `==`.
+ *
+ * @param m_key1        The first key.
+ * @param m_key2        The second key.
+ * @return              Non-zero if the keys are equal, and zero if not.
+ */
+#define HE4_EQ_INT(m_key1, m_key2) ((m_key1) == (m_key2))
+
+/**
+ * Declare a table type `m_name##_t` mapping keys of type `m_key_t` to entries
+ * of type `m_entry_t`, and the static inline functions that work on it.  The
+ * functions are named with the prefix `m_name##_`:
+ *
+ *   - `m_name##_t * m_name##_new(size_t entries)` makes a table with at
+ *     least the given number of cells, rounded up to a power of two and to
+ *     `HE4_MINIMUM_SIZE`, or returns `NULL`.
+ *   - `void m_name##_delete(m_name##_t * table)` frees a table.
+ *   - `bool m_name##_insert(m_name##_t * table, m_key_t key,
+ *     m_entry_t entry)` inserts or replaces an entry, and returns true if
+ *     the table is full.
+ *   - `m_entry_t * m_name##_find(m_name##_t * table, m_key_t key)` returns a
+ *     pointer to the entry for the key, or `NULL`.  The pointer is good
+ *     until the table is next changed.
+ *   - `bool m_name##_remove(m_name##_t * table, m_key_t key,
+ *     m_entry_t * entry)` removes the key, storing its entry if `entry` is
+ *     not `NULL`, and returns true if the key was not found.
+ *   - `bool m_name##_at(m_name##_t * table, size_t index, m_key_t * key,
+ *     m_entry_t * entry)` stores the key and entry of a cell, and returns
+ *     true if the cell is empty or past the end of the table.  Use this to
+ *     walk the table, for instance to free the keys and entries.  Removing
+ *     an entry can move a later entry back into the cell just visited.
+ *   - `void m_name##_clear(m_name##_t * table)` removes every entry.
+ *   - `size_t m_name##_size(m_name##_t * table)` and
+ *     `size_t m_name##_capacity(m_name##_t * table)` give the number of
+ *     entries and of cells.
+ *
+ * The hash and comparison may be functions or macros.  Each is used with
+ * the arguments in parentheses, as `m_hash(key)` and `m_eq(key1, key2)`.
+ * The hash is converted to `uint64_t`, and the comparison must be non-zero
+ * for equal keys.
+ *
+ * @param m_name        The name of the table type.
+ * @param m_key_t       The key type.
+ * @param m_entry_t     The entry type.
+ * @param m_hash        The hash of a key.
+ * @param m_eq          The comparison of two keys.
+ */
+#define HE4_DECLARE(m_name, m_key_t, m_entry_t, m_hash, m_eq) \
+typedef struct { \
+    m_key_t key; \
+    m_entry_t entry; \
+} m_name##_cell_t; \
+\
+typedef struct m_name { \
+    size_t capacity; \
+    size_t size; \
+    unsigned shift; \
+    uint8_t * ctrl; \
+    m_name##_cell_t * cells; \
+} m_name##_t; \
+\
+static inline uint64_t \
+m_name##_mix_(const m_key_t key) { \
+    return (uint64_t)(m_hash(key)) * UINT64_C(0x9E3779B97F4A7C15); \
+} \
+\
+static inline size_t \
+m_name##_home_(m_name##_t * table, const uint64_t mixed) { \
+    return (size_t)(mixed >> table->shift); \
+} \
+\
+static inline uint8_t \
+m_name##_tag_(m_name##_t * table, const uint64_t mixed) { \
+    return (uint8_t)(0x80 | ((mixed >> (table->shift - 7)) & 0x7F)); \
+} \
+\
+static inline m_name##_t * \
+m_name##_new(size_t entries) { \
+    if (entries < HE4_MINIMUM_SIZE) entries = HE4_MINIMUM_SIZE; \
+    size_t capacity = 2; \
+    unsigned bits = 1; \
+    while (capacity < entries) { \
+        if (bits >= 57) return NULL; \
+        capacity <<= 1; \
+        ++bits; \
+    } \
+    m_name##_t * table = HE4MALLOC(m_name##_t, 1); \
+    if (table == NULL) return NULL; \
+    table->capacity = capacity; \
+    table->size = 0; \
+    table->shift = 64 - bits; \
+    table->ctrl = HE4MALLOC(uint8_t, capacity); \
+    table->cells = HE4MALLOC(m_name##_cell_t, capacity); \
+    if (table->ctrl == NULL || table->cells == NULL) { \
+        HE4FREE(table->ctrl); \
+        HE4FREE(table->cells); \
+        HE4FREE(table); \
+        return NULL; \
+    } \
+    return table; \
+} \
+\
+static inline void \
+m_name##_delete(m_name##_t * table) { \
+    if (table == NULL) return; \
+    HE4FREE(table->ctrl); \
+    HE4FREE(table->cells); \
+    HE4FREE(table); \
+} \
+\
+static inline size_t \
+m_name##_search_(m_name##_t * table, const m_key_t key, \
+                 const uint64_t mixed, size_t * open) { \
+    const size_t mask = table->capacity - 1; \
+    const uint8_t tag = m_name##_tag_(table, mixed); \
+    size_t index = m_name##_home_(table, mixed); \
+    for (size_t count = 0; count < table->capacity; ++count) { \
+        const uint8_t ctrl = table->ctrl[index]; \
+        if (ctrl == 0) { \
+            *open = index; \
+            return SIZE_MAX; \
+        } \
+        if (ctrl == tag && m_eq(table->cells[index].key, key)) return index; \
+        index = (index + 1) & mask; \
+    } \
+    *open = SIZE_MAX; \
+    return SIZE_MAX; \
+} \
+\
+static inline bool \
+m_name##_insert(m_name##_t * table, const m_key_t key, \
+                const m_entry_t entry) { \
+    if (table == NULL) return true; \
+    const uint64_t mixed = m_name##_mix_(key); \
+    size_t open; \
+    size_t index = m_name##_search_(table, key, mixed, &open); \
+    if (index != SIZE_MAX) { \
+        table->cells[index].entry = entry; \
+        return false; \
+    } \
+    if (open == SIZE_MAX) return true; \
+    table->ctrl[open] = m_name##_tag_(table, mixed); \
+    table->cells[open].key = key; \
+    table->cells[open].entry = entry; \
+    ++(table->size); \
+    return false; \
+} \
+\
+static inline m_entry_t * \
+m_name##_find(m_name##_t * table, const m_key_t key) { \
+    if (table == NULL) return NULL; \
+    size_t open; \
+    size_t index = m_name##_search_(table, key, m_name##_mix_(key), &open); \
+    return index == SIZE_MAX ? NULL : &(table->cells[index].entry); \
+} \
+\
+static inline bool \
+m_name##_remove(m_name##_t * table, const m_key_t key, \
+                m_entry_t * entry) { \
+    if (table == NULL) return true; \
+    size_t open; \
+    size_t index = m_name##_search_(table, key, m_name##_mix_(key), &open); \
+    if (index == SIZE_MAX) return true; \
+    if (entry != NULL) *entry = table->cells[index].entry; \
+    /* Shift back each following entry that may move to the gap. */ \
+    const size_t mask = table->capacity - 1; \
+    size_t next = (index + 1) & mask; \
+    while (table->ctrl[next] != 0 && next != index) { \
+        size_t home = m_name##_home_(table, \
+                m_name##_mix_(table->cells[next].key)); \
+        if (((next - home) & mask) >= ((next - index) & mask)) { \
+            table->ctrl[index] = table->ctrl[next]; \
+            table->cells[index] = table->cells[next]; \
+            index = next; \
+        } \
+        next = (next + 1) & mask; \
+    } \
+    table->ctrl[index] = 0; \
+    --(table->size); \
+    return false; \
+} \
+\
+static inline bool \
+m_name##_at(m_name##_t * table, const size_t index, m_key_t * key, \
+            m_entry_t * entry) { \
+    if (table == NULL || index >= table->capacity || \
+        table->ctrl[index] == 0) { \
+        return true; \
+    } \
+    if (key != NULL) *key = table->cells[index].key; \
+    if (entry != NULL) *entry = table->cells[index].entry; \
+    return false; \
+} \
+\
+static inline void \
+m_name##_clear(m_name##_t * table) { \
+    if (table == NULL) return; \
+    memset(table->ctrl, 0, table->capacity); \
+    table->size = 0; \
+} \
+\
+static inline size_t \
+m_name##_size(m_name##_t * table) { \
+    return table == NULL ? 0 : table->size; \
+} \
+\
+static inline size_t \
+m_name##_capacity(m_name##_t * table) { \
+    return table == NULL ? 0 : table->capacity; \
+}
+
+#endif // HE4GEN_H
@@ -13,9 +13,34 @@
  * according to those terms.
  */
 
+// Huge pages are requested with mmap and madvise, and grown with mremap,
+// which C99 headers only declare when the GNU feature set is asked for.
+#if defined(__linux__) && !defined(LACKS_UNISTD_H)
+#  define USE_MMAP
+#  ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#  endif
+#endif
+
 #include <string.h>
+#ifndef LACKS_TIME_H
+#  include <time.h>
+#endif // LACKS_TIME_H
+// The count of seeds chosen is kept with the GCC atomic builtins, or else
+// with C11 atomics if the compiler has them, or else not at all.
+#if defined(__GNUC__)
+#  define SEED_COUNT_ATOMIC
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && \
+      !defined(__STDC_NO_ATOMICS__)
+#  define SEED_COUNT_C11
+#  include <stdatomic.h>
+#endif
 #include <he4.h>
 #include "xxhash.h"
+#ifdef USE_MMAP
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif // USE_MMAP
 
 // Make sure the version is defined.  If not, then given an error.
 #ifndef HE4_VERSION
@@ -29,24 +54,65 @@
  * array, a hash array, and an entry array: (key, key length, hash) -> entry.
  *
  * Lazy deletion is supported by freeing both the key and entry and replacing
- * them with NULL, but setting the key length to one (or any non-zero value).
+ * them with NULL, but setting the key length to a marker value
+ * (KLEN_DELETED).  The state of a cell can then be found from its key length
+ * alone.
  *
  * klen == 0 --> an empty cell.
- * klen > 0 && key == NULL --> a deleted cell.
- * klen > 0 && key != NULL --> a non-empty cell.
+ * klen == KLEN_DELETED --> a deleted cell.
+ * otherwise --> a non-empty cell.
+ *
+ * The cells are either stored together in an array of he4_map_t, or (if
+ * HE4SOA is defined) as a separate array for each field.
+ *
+ * If the table was created with the HE4_CONTROL_BYTES policy, then there is
+ * also an array of control bytes, one per cell, that mirrors the state of the
+ * cell.
+ *
+ * ctrl == 0x00 --> an empty cell.
+ * ctrl == 0x01 --> a deleted cell.
+ * ctrl >= 0x80 --> a non-empty cell; the low seven bits are the high seven
+ *                  bits of the hash (the "fingerprint").
+ *
+ * Probes then load a group of control bytes at once and compare them all
+ * against the fingerprint, so that only cells with a matching fingerprint are
+ * ever read from the map array.  The first GROUP_WIDTH - 1 control bytes are
+ * repeated after the end of the array so that a group can be loaded at any
+ * index without having to wrap.
  */
 
 /**
  * A blank map to use for empty cells.
  */
 static he4_map_t blank_cell = {
+#ifndef HE4NOTOUCH
         .touch = 0,
+#endif // HE4NOTOUCH
         .hash = 0,
+#ifndef HE4_ENTRY_VALUE
         .entry = (he4_entry_t)NULL,
+#endif // HE4_ENTRY_VALUE
         .key = (he4_key_t)NULL,
         .klen = 0,
 };
 
+/**
+ * Value returned by the search functions when no cell is found.
+ */
+#define NOT_FOUND SIZE_MAX
+
+#ifdef HE4_ENTRY_VALUE
+/**
+ * An all-zero entry, returned when no entry is found.
+ */
+static const he4_entry_t no_entry;
+/** The entry returned when no entry is found. */
+#  define NO_ENTRY no_entry
+#else
+/** The entry returned when no entry is found. */
+#  define NO_ENTRY ((he4_entry_t)NULL)
+#endif // HE4_ENTRY_VALUE
+
 /**
  * The debugging level.  Right now there are two levels: 0 (suppress) and 1
  * (emit debugging information).
@@ -59,660 +125,4017 @@ he4_version(void) {
 }
 
 //======================================================================
-// Local functions.
-// These are hidden and inline, and we do not check arguments.
+// Control bytes.
+// Group operations use AVX2 or SSE2 when the compiler targets them, and
+// otherwise fall back to portable code.  Define HE4NOSIMD to force the
+// portable code.
 //======================================================================
 
+#define CTRL_EMPTY 0x00         ///< Control byte for an empty cell.
+#define CTRL_DELETED 0x01       ///< Control byte for a deleted cell.
+
+#if !defined(HE4NOSIMD) && defined(__AVX2__)
+#  include <immintrin.h>
+#  define GROUP_AVX2
+/** Number of control bytes examined by one group operation. */
+#  define GROUP_WIDTH 32
+/** A group of control bytes, loaded for comparison. */
+typedef __m256i group_t;
+#elif !defined(HE4NOSIMD) && (defined(__SSE2__) || defined(_M_X64))
+#  include <emmintrin.h>
+#  define GROUP_SSE2
+#  define GROUP_WIDTH 16
+typedef __m128i group_t;
+#else
+#  define GROUP_WIDTH 16
+typedef const uint8_t * group_t;
+#endif
+
 /**
- * Determine if a cell is empty.  An empty cell is one that has never held
- * a value.  A deleted cell is not considered empty.
+ * A bit mask with one bit for each control byte in a group.  The lowest bit
+ * corresponds to the first byte.
+ */
+typedef uint32_t group_mask_t;
+
+/**
+ * Mask with a bit set for every byte of a group.
+ */
+#define GROUP_ALL ((group_mask_t)(((uint64_t)1 << GROUP_WIDTH) - 1))
+
+/**
+ * Load a group of control bytes.  The bytes need not be aligned.
  *
- * @param table         The table.
- * @param index         The index of the cell.
- * @return              True if the cell is empty, and false otherwise.
+ * @param ctrl          Pointer to the first control byte of the group.
+ * @return              The group.
  */
-static inline bool
-is_empty(HE4 * table, const size_t index) {
-    return table->maps[index].klen == 0;
+static inline group_t
+group_load(const uint8_t * ctrl) {
+#if defined(GROUP_AVX2)
+    return _mm256_loadu_si256((const __m256i *)ctrl);
+#elif defined(GROUP_SSE2)
+    return _mm_loadu_si128((const __m128i *)ctrl);
+#else
+    return ctrl;
+#endif
 }
 
 /**
- * Determine if a cell is deleted ("lazy empty").  An deleted cell is one that
- * previously held a value.  A deleted cell is not considered empty.
+ * Find every control byte in a group that is equal to a given value.
  *
- * @param table         The table.
- * @param index         The index of the cell.
- * @return              True if the cell is deleted, and false otherwise.
+ * @param group         The group.
+ * @param value         The value to find.
+ * @return              A mask with a bit set for every matching byte.
  */
-static inline bool
-is_deleted(HE4 * table, const size_t index) {
-    return table->maps[index].klen > 0 && table->maps[index].key == NULL;
+static inline group_mask_t
+group_match(group_t group, const uint8_t value) {
+#if defined(GROUP_AVX2)
+    return (group_mask_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(group, _mm256_set1_epi8((char)value)));
+#elif defined(GROUP_SSE2)
+    return (group_mask_t)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#else
+    group_mask_t mask = 0;
+    for (unsigned bit = 0; bit < GROUP_WIDTH; ++bit) {
+        if (group[bit] == value) mask |= (group_mask_t)1 << bit;
+    } // Check every byte.
+    return mask;
+#endif
 }
 
 /**
- * Determine if a cell is open.  An open cell is one that can have a value
- * placed in it.  Both empty and deleted cells are considered open, so this
- * is equivalent to the check
- * `is_empty(table, index) || is_deleted(table, index)`.
+ * Get the position of the lowest set bit of a non-zero mask.
  *
- * @param table         The table.
- * @param index         The index of the cell.
- * @return              True if the cell is open, and false otherwise.
+ * @param mask          The mask, which must not be zero.
+ * @return              The zero-based position of the lowest set bit.
  */
-static inline bool
-is_open(HE4 * table, const size_t index) {
-    return table->maps[index].key == NULL;
+static inline unsigned
+lowest_bit(group_mask_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctz(mask);
+#else
+    unsigned bit = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++bit;
+    } // Find the lowest bit.
+    return bit;
+#endif
 }
 
 /**
- * Empty a cell.
+ * Get a mask of all the bits below the lowest set bit of a mask.  If the
+ * mask is zero then every bit is set.
+ *
+ * @param mask          The mask.
+ * @return              Mask of the bits below the lowest set bit.
+ */
+static inline group_mask_t
+below_lowest(const group_mask_t mask) {
+    return mask == 0 ? GROUP_ALL : (mask & (~mask + 1)) - 1;
+}
+
+/**
+ * Compute the control byte for a non-empty cell with the given hash.
+ *
+ * @param hash          The hash of the key.
+ * @return              The control byte.
+ */
+static inline uint8_t
+fingerprint(const he4_hash_t hash) {
+    return (uint8_t)(0x80 | (hash >> (sizeof(he4_hash_t) * 8 - 7)));
+}
+
+/**
+ * Set the control byte for a cell, if the table has control bytes.  The
+ * mirrored copy past the end of the array is also updated.
  *
  * @param table         The table.
  * @param index         The index of the cell.
- * @param free_key      If true, deallocate the key.
- * @param free_entry    If true, deallocate the entry.
+ * @param value         The new control byte.
  */
 static inline void
-empty_cell(HE4 * table, const size_t index,
-           const bool free_key, const bool free_entry) {
-    if (free_key && table->maps[index].key != NULL) {
-        table->delete_key(table->maps[index].key);
-    }
-    if (free_entry && table->maps[index].entry != NULL) {
-        table->delete_entry(table->maps[index].entry);
-    }
-    table->maps[index] = blank_cell;
+set_ctrl(HE4 * table, const size_t index, const uint8_t value) {
+    if (table->ctrl == NULL) return;
+    table->ctrl[index] = value;
+    if (index < GROUP_WIDTH - 1) table->ctrl[table->capacity + index] = value;
 }
 
 /**
- * Move the content of a cell to another location in the table.  If the
- * destination cell is occupied, it is first freed.
+ * Advance an index by an offset smaller than the table capacity, wrapping
+ * to the start of the table.
  *
  * @param table         The table.
- * @param from          Index of the cell to move.
- * @param to            Index of the receiving cell.
+ * @param index         The index.
+ * @param offset        The offset, which must be less than the capacity.
+ * @return              The new index.
  */
-static inline void
-move_cell(HE4 * table, const size_t from, const size_t to) {
-    if (! is_open(table, to)) empty_cell(table, to, true, true);
-    table->maps[to] = table->maps[from];
-    table->maps[from] = blank_cell;
+static inline size_t
+wrap_add(HE4 * table, const size_t index, const size_t offset) {
+    size_t next = index + offset;
+    return next >= table->capacity ? next - table->capacity : next;
 }
 
 //======================================================================
-// Default functions.
-// These cannot be inline because we need pointers to them.
+// Probe sequences.
+// A probe starts at the home cell for the hash and visits the cells a group
+// at a time, in an order fixed by the table policy.  A group is GROUP_WIDTH
+// consecutive cells for tables with control bytes, and a single cell
+// otherwise.  Linear probing moves on to the next group, triangular probing
+// skips 1, 2, 3, ... groups, and double hashing skips a fixed odd number of
+// groups taken from the hash.  The last two need a power of two capacity
+// (and a multiple of the group width), so that the sequence visits every
+// cell once in capacity steps.  No step needs a division.
 //======================================================================
 
 /**
- * This is the default hash function.  You cannot use this function if you
- * have re-defined the hash type.
- *
- * @param key           Pointer to the key to hash.
- * @param length        Number of bytes in key.
- * @return              The hash value.
+ * The policy flags that select a non-linear probe step.
  */
-static he4_hash_t
-he4_hash(const he4_key_t key, const size_t length) {
-    return XXH32(key, length, 0);
-}
+#define STEP_POLICY (HE4_PROBE_TRIANGULAR | HE4_PROBE_DOUBLE)
 
 /**
- * This is the default key comparison.
- *
- * @param key1          First key.
- * @param klen1         First key length.
- * @param key2          Second key.
- * @param klen2         Second key length.
- * @return              Non-zero if unequal, zero if equal.
+ * The position of a probe.
  */
-static int
-he4_compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
-    return klen1 != klen2 ? 1 : memcmp(key1, key2, klen1);
-}
+typedef struct {
+    size_t base;        ///< First cell of the current group.
+    size_t offset;      ///< Offset of the current cell within the group.
+    size_t index;       ///< The current cell.
+    size_t stride;      ///< Number of groups to skip for the next group.
+} probe_t;
 
 /**
- * This is the default key deletion.
+ * Get the number of consecutive cells a probe visits before it steps.
  *
- * @param key           The key to delete.
+ * @param table         The table.
+ * @return              The group width.
  */
-static void
-he4_delete_key(he4_key_t key) {
-    HE4FREE(key);
+static inline size_t
+group_width(HE4 * table) {
+    return table->ctrl == NULL ? 1 : GROUP_WIDTH;
 }
 
+#if defined(HE4_HASH64) && !defined(HE4_USER_HASH)
+/** Signal the use of the library's 64-bit hash. */
+#  define HASH64
+#  ifdef __SIZEOF_INT128__
 /**
- * This is the default entry deletion.
- *
- * @param entry         The entry to delete.
+ * The number of bits of a 64-bit hash below the control byte tag.
  */
-static void
-he4_delete_entry(he4_entry_t entry) {
-    HE4FREE(entry);
-}
-
-//======================================================================
-// Table constructor.
-//======================================================================
+#    define INDEX_BITS 57
+#  endif
+#endif
 
-size_t
-he4_best_capacity(size_t bytes) {
-    // Subtract the size of the structure.
-    bytes -= sizeof(HE4);
-    // Every map must include (1) a key, (2) the key length, and (3) an
-    // entry.
-    size_t maximum = bytes / sizeof(he4_map_t);
-    return maximum;
+/**
+ * Reduce a hash to a number less than a range by multiplying and shifting.
+ * A 64-bit hash uses the bits below the control byte tag, so that the tag
+ * and the index are independent.
+ *
+ * @param hash          The hash.
+ * @param range         The range.
+ * @return              A number less than the range.
+ */
+static inline size_t
+scale_hash(const he4_hash_t hash, const size_t range) {
+#ifdef INDEX_BITS
+    __extension__ typedef unsigned __int128 wide_t;
+    const uint64_t low = (uint64_t)hash & (((uint64_t)1 << INDEX_BITS) - 1);
+    return (size_t)(((wide_t)low * range) >> INDEX_BITS);
+#else
+    return (size_t)(((uint64_t)(uint32_t)hash * range) >> 32);
+#endif
 }
 
-HE4 *
-he4_new(size_t entries,
-        he4_hash_t (* hash)(he4_key_t key, size_t klen),
-        int (* compare)(he4_key_t key1, size_t klen1, he4_key_t key2,
-                        size_t klen2),
-        void (* delete_key)(he4_key_t key),
-        void (* delete_entry)(he4_entry_t thing)) {
-    // Check arguments.
-    if (entries < HE4_MINIMUM_SIZE) {
-        DEBUG("Requested table size (%zu) is less than the minimum (%d).",
-              entries, HE4_MINIMUM_SIZE);
-        return NULL;
-    }
-#ifdef HE4_USER_HASH
-    if (hash == NULL) {
-        DEBUG("User must supply a hash function since a custom hash type is "
-              "defined.");
-        return NULL;
+/**
+ * Reduce a hash to the index of the cell where the probe for it starts.
+ *
+ * @param table         The table.
+ * @param hash          The hash.
+ * @return              The index of the home cell.
+ */
+static inline size_t
+home_cell(HE4 * table, const he4_hash_t hash) {
+    if (table->policy & HE4_RANGE_MULTIPLY) {
+        return scale_hash(hash, table->capacity);
     }
-#endif
+    if (table->mask != 0) return (size_t)hash & table->mask;
+    return (size_t)(hash % table->capacity);
+}
 
-    // Allocate the table.
-    HE4 * table = HE4MALLOC(HE4, 1);
-    if (table == NULL) {
-        DEBUG("Unable to get memory for table structure.");
-        return NULL;
+/**
+ * Start a probe for a hash.
+ *
+ * @param table         The table.
+ * @param hash          The hash.
+ * @param probe         The probe to initialize.
+ */
+static inline void
+probe_start(HE4 * table, const he4_hash_t hash, probe_t * probe) {
+    probe->base = probe->index = home_cell(table, hash);
+    probe->offset = 0;
+    probe->stride = 1;
+    if (table->policy & HE4_PROBE_DOUBLE) {
+        // Take the step from other bits of the hash.  Any odd number of
+        // groups will visit every group of a power of two table.
+        probe->stride = (size_t)(((uint64_t)hash *
+                                  UINT64_C(0x9E3779B97F4A7C15)) >> 40) | 1;
     }
+}
 
-    // Set the fields.
-    table->capacity = entries;
-    table->compare = compare == NULL ? he4_compare : compare;
-    table->delete_entry = delete_entry == NULL ? he4_delete_entry : delete_entry;
-    table->delete_key = delete_key == NULL ? he4_delete_key : delete_key;
-    table->free = entries;
-    table->hash = hash == NULL ? he4_hash : hash;
-#ifndef HE4NOTOUCH
-    table->max_touch = 0;
-#endif // HE4NOTOUCH
-
-    // Allocate the key and entry arrays.
-    table->maps = HE4MALLOC(he4_map_t, entries);
-    if (table->maps == NULL) {
-        DEBUG("Unable to get memory for the table.");
-        HE4FREE(table);
-        return NULL;
+/**
+ * Move a probe to the first cell of the next group in its sequence.
+ *
+ * @param table         The table.
+ * @param probe         The probe.
+ */
+static inline void
+probe_next_group(HE4 * table, probe_t * probe) {
+    const size_t width = group_width(table);
+    if (table->policy & STEP_POLICY) {
+        probe->base = (probe->base + width * probe->stride) & table->mask;
+        if (table->policy & HE4_PROBE_TRIANGULAR) ++(probe->stride);
+    } else {
+        probe->base = wrap_add(table, probe->base, width);
     }
-
-    // Success.
-    return table;
+    probe->offset = 0;
+    probe->index = probe->base;
 }
 
-void
-he4_delete(HE4 * table) {
-    if (table == NULL) {
-        DEBUG("Attempt to delete a NULL table.");
-        return;
+/**
+ * Move a probe to the next cell in its sequence.
+ *
+ * @param table         The table.
+ * @param probe         The probe.
+ */
+static inline void
+probe_next(HE4 * table, probe_t * probe) {
+    if (++(probe->offset) < group_width(table)) {
+        probe->index = wrap_add(table, probe->base, probe->offset);
+    } else {
+        probe_next_group(table, probe);
     }
-
-    // Delete any remaining entries.
-    for (size_t index = 0; index < table->capacity; ++index) {
-        empty_cell(table, index, true, true);
-    } // Delete any remaining entries.
-    table->free = 0;
-    table->capacity = 0;
-
-    // Wipe the method table.
-    table->compare = NULL;
-    table->hash = NULL;
-    table->delete_key = NULL;
-    table->delete_entry = NULL;
-
-    // Delete the internal arrays.
-    HE4FREE(table->maps);
-    table->maps = NULL;
-    HE4FREE(table);
 }
 
 //======================================================================
-// Table data.
+// Cell storage.
+// By default every cell is an he4_map_t in the map array.  If HE4SOA is
+// defined, then each field of the cells is kept in an array of its own, so
+// that a probe only streams through the key lengths and hashes of the cells
+// it passes, and reads a key only when the hash matches.  If HE4COMPACT is
+// defined, then the key length, hash, and touch index are 32 bits and the
+// touch indices are kept in an array of their own.  The macros and functions
+// here hide the difference from the rest of the code.
 //======================================================================
 
-size_t
-he4_size(HE4 * table) {
-    if (table == NULL) return 0;
-    return table->capacity - table->free;
-}
+#ifndef HE4SOA
+#  define KEY(m_table, m_index) ((m_table)->maps[m_index].key)
+#  define KLEN(m_table, m_index) ((m_table)->maps[m_index].klen)
+#  define ENTRY(m_table, m_index) ((m_table)->maps[m_index].entry)
+#  define HASH(m_table, m_index) ((m_table)->maps[m_index].hash)
+#  define IKEY(m_table, m_index) ((m_table)->maps[m_index].ikey)
+#else
+#  define KEY(m_table, m_index) ((m_table)->keys[m_index])
+#  define KLEN(m_table, m_index) ((m_table)->klens[m_index])
+#  define ENTRY(m_table, m_index) ((m_table)->entries[m_index])
+#  define HASH(m_table, m_index) ((m_table)->hashes[m_index])
+#  define IKEY(m_table, m_index) ((m_table)->ikeys[m_index])
+#endif // HE4SOA
+#if defined(HE4SOA) || defined(HE4COMPACT)
+/** The touch indices are kept in an array of their own. */
+#  define TOUCH_ARRAY
+#  define TOUCH(m_table, m_index) ((m_table)->touches[m_index])
+#else
+#  define TOUCH(m_table, m_index) ((m_table)->maps[m_index].touch)
+#endif
 
-size_t
-he4_capacity(HE4 * table) {
-    return table == NULL ? 0 : table->capacity;
-}
+/**
+ * Key length that marks a deleted cell.  See `is_deleted`.
+ */
+#define KLEN_DELETED ((he4_klen_t)-1)
 
-double
-he4_load(HE4 * table) {
-    if (table == NULL) return 1.0;
-    return (double)(table->capacity - table->free) / (double)(table->capacity);
-}
+/**
+ * Bound on the length of a key.  The top bit of the key length is reserved
+ * for compaction.  See `compact`.
+ */
+#define KLEN_LIMIT ((he4_klen_t)(KLEN_DELETED >> 1))
 
+/**
+ * Number of bytes used to store one cell.
+ */
+#if defined(TOUCH_ARRAY) && !defined(HE4NOTOUCH)
+#  define TOUCH_BYTES sizeof(he4_touch_t)
+#else
+#  define TOUCH_BYTES 0
+#endif
+#ifdef HE4_INLINE_KEYS
+#  define IKEY_BYTES sizeof(he4_ikey_t)
+#else
+#  define IKEY_BYTES 0
+#endif // HE4_INLINE_KEYS
+#ifndef HE4SOA
+#  define CELL_BYTES (sizeof(he4_cell_t) + TOUCH_BYTES)
+#else
+#  define CELL_BYTES (sizeof(he4_key_t) + sizeof(he4_klen_t) + \
+                      sizeof(he4_entry_t) + sizeof(he4_hash_t) + \
+                      TOUCH_BYTES + IKEY_BYTES)
+#endif // HE4SOA
+
+/**
+ * Get a copy of the mapping in a cell.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @return              The mapping.
+ */
+static inline he4_map_t
+get_cell(HE4 * table, const size_t index) {
+#if !defined(HE4SOA) && !defined(HE4COMPACT)
+    return table->maps[index];
+#else
+    he4_map_t map;
+    map.key = KEY(table, index);
+    map.klen = KLEN(table, index);
+    map.entry = ENTRY(table, index);
+    map.hash = HASH(table, index);
 #ifndef HE4NOTOUCH
-size_t
-he4_max_touch(HE4 * table) {
-    return table == NULL ? 0 : table->max_touch;
-}
+    map.touch = TOUCH(table, index);
 #endif // HE4NOTOUCH
-
-//======================================================================
-// Table insertion / deletion functions.
-//======================================================================
+#ifdef HE4_INLINE_KEYS
+    memcpy(map.ikey, IKEY(table, index), sizeof(he4_ikey_t));
+#endif // HE4_INLINE_KEYS
+    return map;
+#endif
+}
+
+/**
+ * Store a mapping in a cell.  Whatever was in the cell is overwritten and
+ * not deallocated.  The control byte is not changed.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param map           The mapping.
+ */
+static inline void
+put_cell(HE4 * table, const size_t index, const he4_map_t map) {
+#if !defined(HE4SOA) && !defined(HE4COMPACT)
+    table->maps[index] = map;
+#else
+    KEY(table, index) = map.key;
+    KLEN(table, index) = map.klen;
+    ENTRY(table, index) = map.entry;
+    HASH(table, index) = map.hash;
+#ifndef HE4NOTOUCH
+    TOUCH(table, index) = map.touch;
+#endif // HE4NOTOUCH
+#ifdef HE4_INLINE_KEYS
+    memcpy(IKEY(table, index), map.ikey, sizeof(he4_ikey_t));
+#endif // HE4_INLINE_KEYS
+#endif
+}
+
+// The default key comparison.  Only tables that use it store keys inline,
+// since only then is the key known to point to klen bytes, and probes
+// compare such keys directly.
+static int he4_compare(he4_key_t key1, size_t klen1, he4_key_t key2,
+                       size_t klen2);
+
+/**
+ * Determine if a key is stored inline.
+ *
+ * @param table         The table.
+ * @param klen          Length in bytes of the key.
+ * @return              True iff the key is stored inline.
+ */
+static inline bool
+is_inline(HE4 * table, const size_t klen) {
+#ifdef HE4_INLINE_KEYS
+    return klen != 0 && klen <= HE4_INLINE_KEYS &&
+           table->compare == he4_compare;
+#else
+    (void)table;
+    (void)klen;
+    return false;
+#endif // HE4_INLINE_KEYS
+}
+
+/**
+ * Get the key of a cell.  If the key is stored inline, then this points to
+ * the copy in the cell, and is good only until the cell is next changed.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @return              The key.
+ */
+static inline he4_key_t
+cell_key(HE4 * table, const size_t index) {
+#ifdef HE4_INLINE_KEYS
+    if (is_inline(table, KLEN(table, index))) {
+        return (he4_key_t)IKEY(table, index);
+    }
+#endif // HE4_INLINE_KEYS
+    return KEY(table, index);
+}
+
+/**
+ * Get the key of a mapping.  If the key is stored inline, then this points
+ * to the copy in the mapping.
+ *
+ * @param table         The table.
+ * @param map           The mapping.
+ * @return              The key.
+ */
+static inline he4_key_t
+map_key(HE4 * table, he4_map_t * map) {
+#ifdef HE4_INLINE_KEYS
+    if (is_inline(table, map->klen)) return (he4_key_t)map->ikey;
+#else
+    (void)table;
+#endif // HE4_INLINE_KEYS
+    return map->key;
+}
+
+//======================================================================
+// Array allocation.
+// The arrays of a table are allocated with HE4MALLOC unless the policy asks
+// for alignment or huge pages.  Such a block is then padded so it can be
+// aligned, or mapped directly, and a trailer after the requested bytes
+// records how to release it.
+//======================================================================
+
+/**
+ * Policy flags that change how the arrays are allocated.
+ */
+#define ALIGN_POLICY (HE4_ALIGN_LINES | HE4_ALIGN_PAGES | HE4_HUGE_PAGES)
+
+/** Alignment used for `HE4_ALIGN_LINES`. */
+#define CACHE_LINE 64
+
+/** Size of a huge page; smaller blocks are not mapped with huge pages. */
+#define HUGE_PAGE ((size_t)2 << 20)
+
+/**
+ * The trailer of an aligned block.
+ */
+typedef struct {
+    void * base;            ///< Start of the allocation.
+    size_t length;          ///< Length of the mapping, or 0 if allocated.
+} block_t;
+
+/**
+ * Get the size of a page.
+ *
+ * @return              The page size in bytes.
+ */
+static inline size_t
+page_size(void) {
+#ifdef USE_MMAP
+    long size = sysconf(_SC_PAGESIZE);
+    if (size > 0) return (size_t)size;
+#endif // USE_MMAP
+    return 4096;
+}
+
+/**
+ * Get the offset of the trailer of a block.
+ *
+ * @param bytes         The size of the block.
+ * @return              The offset of the trailer from the start of the block.
+ */
+static inline size_t
+trailer_offset(const size_t bytes) {
+    return (bytes + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+}
+
+#ifdef USE_MMAP
+/**
+ * Map a block of memory backed by huge pages.  Explicit huge pages are tried
+ * first, and then transparent huge pages.
+ *
+ * @param length        The length of the mapping, which must be a multiple
+ *                      of the huge page size.
+ * @return              The mapping, or NULL if it cannot be made.
+ */
+static void *
+map_huge(const size_t length) {
+    void * block = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    block = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif // MAP_HUGETLB
+    if (block == MAP_FAILED) {
+        block = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (block == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        // This is only a hint, so failure does not matter.
+        (void)madvise(block, length, MADV_HUGEPAGE);
+#endif // MADV_HUGEPAGE
+    }
+    return block;
+}
+#endif // USE_MMAP
+
+/**
+ * Allocate a zeroed, aligned block for an array.  See `ALIGN_POLICY`.
+ *
+ * @param policy        The policy of the table.
+ * @param number        The number of elements.
+ * @param size          The size of an element.
+ * @return              The block, or NULL if it cannot be allocated.
+ */
+static void *
+alloc_block(const he4_policy_t policy, const size_t number,
+            const size_t size) {
+    size_t align = (policy & (HE4_ALIGN_PAGES | HE4_HUGE_PAGES)) ?
+                   page_size() : CACHE_LINE;
+    if (size != 0 && number > (SIZE_MAX - sizeof(block_t) - 2 * align -
+                               HUGE_PAGE) / size) {
+        DEBUG("Requested block (%zu elements) is too large.", number);
+        return NULL;
+    }
+    size_t offset = trailer_offset(number * size);
+    size_t bytes = offset + sizeof(block_t);
+#ifdef USE_MMAP
+    if ((policy & HE4_HUGE_PAGES) && bytes >= HUGE_PAGE) {
+        size_t length = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        char * block = map_huge(length);
+        if (block != NULL) {
+            block_t * trailer = (block_t *)(block + offset);
+            trailer->base = block;
+            trailer->length = length;
+            return block;
+        }
+        DEBUG("Unable to map huge pages; using aligned memory.");
+    }
+#endif // USE_MMAP
+    char * base = HE4MALLOC(char, bytes + align - 1);
+    if (base == NULL) return NULL;
+    char * block = base + (align - (uintptr_t)base % align) % align;
+    block_t * trailer = (block_t *)(block + offset);
+    trailer->base = base;
+    trailer->length = 0;
+    return block;
+}
+
+/**
+ * Free a block allocated by `alloc_block`.  NULL blocks are ignored.
+ *
+ * @param block         The block.
+ * @param number        The number of elements.
+ * @param size          The size of an element.
+ */
+static void
+free_block(void * block, const size_t number, const size_t size) {
+    if (block == NULL) return;
+    block_t * trailer = (block_t *)((char *)block +
+                                    trailer_offset(number * size));
+    void * base = trailer->base;
+#ifdef USE_MMAP
+    if (trailer->length != 0) {
+        munmap(base, trailer->length);
+        return;
+    }
+#endif // USE_MMAP
+    HE4FREE(base);
+}
+
+/**
+ * Resize a block allocated by `alloc_block`, keeping its alignment and its
+ * contents.  Any new elements are zeroed.  A mapped block is remapped, and
+ * an allocated block is reallocated if `HE4REALLOC` is available, so that
+ * the old and new blocks need not exist at once.
+ *
+ * @param policy        The policy of the table.
+ * @param block         The block.
+ * @param old_number    The number of elements in the block.
+ * @param number        The new number of elements.
+ * @param size          The size of an element.
+ * @return              The resized block, or NULL if it cannot be resized,
+ *                      in which case the original block is unchanged.
+ */
+static void *
+resize_block(const he4_policy_t policy, void * block,
+             const size_t old_number, const size_t number,
+             const size_t size) {
+    size_t align = (policy & (HE4_ALIGN_PAGES | HE4_HUGE_PAGES)) ?
+                   page_size() : CACHE_LINE;
+    if (size != 0 && number > (SIZE_MAX - sizeof(block_t) - 2 * align -
+                               HUGE_PAGE) / size) {
+        DEBUG("Requested block (%zu elements) is too large.", number);
+        return NULL;
+    }
+    block_t trailer = *(block_t *)((char *)block +
+                                   trailer_offset(old_number * size));
+    size_t keep = (old_number < number ? old_number : number) * size;
+    size_t offset = trailer_offset(number * size);
+    size_t bytes = offset + sizeof(block_t);
+    char * moved = NULL;
+#ifdef USE_MMAP
+    if (trailer.length != 0) {
+        size_t length = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        moved = trailer.base;
+        if (length != trailer.length) {
+            moved = mremap(trailer.base, trailer.length, length,
+                           MREMAP_MAYMOVE);
+            if (moved == MAP_FAILED) return NULL;
+        }
+        trailer.base = moved;
+        trailer.length = length;
+    }
+#endif // USE_MMAP
+    if (moved == NULL) {
+        size_t shift = (size_t)((char *)block - (char *)trailer.base);
+#ifdef HE4REALLOC
+        char * base = HE4REALLOC(trailer.base, char, bytes + align - 1);
+        if (base == NULL) return NULL;
+        moved = base + (align - (uintptr_t)base % align) % align;
+        if (moved != base + shift) memmove(moved, base + shift, keep);
+#else
+        char * base = HE4MALLOC(char, bytes + align - 1);
+        if (base == NULL) return NULL;
+        moved = base + (align - (uintptr_t)base % align) % align;
+        memcpy(moved, block, keep);
+        HE4FREE(trailer.base);
+#endif // HE4REALLOC
+        trailer.base = base;
+        trailer.length = 0;
+    }
+    if (number * size > keep) memset(moved + keep, 0, number * size - keep);
+    *(block_t *)(moved + offset) = trailer;
+    return moved;
+}
+
+/**
+ * Allocate an array for a table, honoring the alignment requested by the
+ * policy of the table.  The array is zeroed.
+ *
+ * @param m_table       The table.
+ * @param m_thing       The type of the elements.
+ * @param m_number      The number of elements.
+ * @return              A pointer to the array, or NULL.
+ */
+#define ALLOC_ARRAY(m_table, m_thing, m_number) \
+        (((m_table)->policy & ALIGN_POLICY) ? \
+         (m_thing *)alloc_block((m_table)->policy, m_number, \
+                                sizeof(m_thing)) : \
+         HE4MALLOC(m_thing, m_number))
+
+/**
+ * Free an array allocated by `ALLOC_ARRAY`, and set the pointer to NULL.
+ *
+ * @param m_table       The table.
+ * @param m_ptr         The array.
+ * @param m_number      The number of elements.
+ */
+#define FREE_ARRAY(m_table, m_ptr, m_number) \
+        { \
+            if ((m_table)->policy & ALIGN_POLICY) { \
+                free_block(m_ptr, m_number, sizeof(*(m_ptr))); \
+            } else { \
+                HE4FREE(m_ptr); \
+            } \
+            m_ptr = NULL; \
+        }
+
+/**
+ * Allocate the cells of a table.  Every cell starts out empty.
+ *
+ * @param table         The table.
+ * @param entries       The number of cells.
+ * @return              True if allocation fails, and false otherwise.
+ */
+static bool
+alloc_cells(HE4 * table, const size_t entries) {
+#ifndef HE4SOA
+    table->maps = ALLOC_ARRAY(table, he4_cell_t, entries);
+    bool failed = table->maps == NULL;
+#else
+    table->keys = ALLOC_ARRAY(table, he4_key_t, entries);
+    table->klens = ALLOC_ARRAY(table, he4_klen_t, entries);
+    table->entries = ALLOC_ARRAY(table, he4_entry_t, entries);
+    table->hashes = ALLOC_ARRAY(table, he4_hash_t, entries);
+    bool failed = table->keys == NULL || table->klens == NULL ||
+                  table->entries == NULL || table->hashes == NULL;
+#ifdef HE4_INLINE_KEYS
+    table->ikeys = ALLOC_ARRAY(table, he4_ikey_t, entries);
+    failed = failed || table->ikeys == NULL;
+#endif // HE4_INLINE_KEYS
+#endif // HE4SOA
+#if defined(TOUCH_ARRAY) && !defined(HE4NOTOUCH)
+    table->touches = ALLOC_ARRAY(table, he4_touch_t, entries);
+    failed = failed || table->touches == NULL;
+#endif
+    return failed;
+}
+
+/**
+ * Free the cells of a table.  The keys and entries are not deallocated.
+ *
+ * @param table         The table.
+ */
+static void
+free_cells(HE4 * table) {
+#ifndef HE4SOA
+    FREE_ARRAY(table, table->maps, table->capacity);
+#else
+    FREE_ARRAY(table, table->keys, table->capacity);
+    FREE_ARRAY(table, table->klens, table->capacity);
+    FREE_ARRAY(table, table->entries, table->capacity);
+    FREE_ARRAY(table, table->hashes, table->capacity);
+#ifdef HE4_INLINE_KEYS
+    FREE_ARRAY(table, table->ikeys, table->capacity);
+#endif // HE4_INLINE_KEYS
+#endif // HE4SOA
+#if defined(TOUCH_ARRAY) && !defined(HE4NOTOUCH)
+    FREE_ARRAY(table, table->touches, table->capacity);
+#endif
+}
+
+/**
+ * Resize an array of a table, keeping its contents.  Any new elements are
+ * zeroed.  See `resize_block`.
+ *
+ * @param table         The table.
+ * @param array         The array.
+ * @param old_number    The number of elements in the array.
+ * @param number        The new number of elements.
+ * @param size          The size of an element.
+ * @return              The resized array, or NULL if it cannot be resized,
+ *                      in which case the original array is unchanged.
+ */
+static void *
+resize_array(HE4 * table, void * array, const size_t old_number,
+             const size_t number, const size_t size) {
+    if (table->policy & ALIGN_POLICY) {
+        return resize_block(table->policy, array, old_number, number, size);
+    }
+    if (size != 0 && number > SIZE_MAX / size) {
+        DEBUG("Requested array (%zu elements) is too large.", number);
+        return NULL;
+    }
+    size_t keep = (old_number < number ? old_number : number) * size;
+#ifdef HE4REALLOC
+    char * moved = HE4REALLOC(array, char, number * size);
+    if (moved == NULL) return NULL;
+#else
+    char * moved = HE4MALLOC(char, number * size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, array, keep);
+    HE4FREE(array);
+#endif // HE4REALLOC
+    if (number * size > keep) memset(moved + keep, 0, number * size - keep);
+    return moved;
+}
+
+/**
+ * Resize the cell arrays, control bytes, and cell metadata of a table.  The
+ * capacity of the table is not changed.  If any array cannot be resized,
+ * then those already resized are restored and the table is unchanged.
+ *
+ * @param table         The table.
+ * @param capacity      The new number of cells.
+ * @return              True if the arrays cannot be resized, and false
+ *                      otherwise.
+ */
+static bool
+resize_cells(HE4 * table, const size_t capacity) {
+    // Gather the arrays, with their element sizes and the number of elements
+    // each has beyond one per cell.
+    void * array[8];
+    size_t size[8];
+    size_t extra[8] = { 0 };
+    size_t count = 0;
+#ifndef HE4SOA
+    array[count] = table->maps;
+    size[count++] = sizeof(he4_cell_t);
+#else
+    array[count] = table->keys;
+    size[count++] = sizeof(he4_key_t);
+    array[count] = table->klens;
+    size[count++] = sizeof(he4_klen_t);
+    array[count] = table->entries;
+    size[count++] = sizeof(he4_entry_t);
+    array[count] = table->hashes;
+    size[count++] = sizeof(he4_hash_t);
+#ifdef HE4_INLINE_KEYS
+    array[count] = table->ikeys;
+    size[count++] = sizeof(he4_ikey_t);
+#endif // HE4_INLINE_KEYS
+#endif // HE4SOA
+#if defined(TOUCH_ARRAY) && !defined(HE4NOTOUCH)
+    array[count] = table->touches;
+    size[count++] = sizeof(he4_touch_t);
+#endif
+    array[count] = table->ctrl;
+    extra[count] = GROUP_WIDTH - 1;
+    size[count++] = sizeof(uint8_t);
+    array[count] = table->meta;
+    size[count++] = sizeof(uint32_t);
+
+    // Resize the arrays.  On failure, put back those already resized.
+    const size_t old = table->capacity;
+    for (size_t which = 0; which < count; ++which) {
+        if (array[which] == NULL) continue;
+        void * resized = resize_array(table, array[which],
+                                      old + extra[which],
+                                      capacity + extra[which], size[which]);
+        if (resized != NULL) {
+            array[which] = resized;
+            continue;
+        }
+        while (which-- > 0) {
+            if (array[which] == NULL) continue;
+            resized = resize_array(table, array[which],
+                                   capacity + extra[which],
+                                   old + extra[which], size[which]);
+            if (resized != NULL) array[which] = resized;
+        } // Restore the arrays.
+        count = 0;
+        break;
+    } // Resize every array.
+
+    // Scatter the arrays.
+    size_t which = 0;
+#ifndef HE4SOA
+    table->maps = array[which++];
+#else
+    table->keys = array[which++];
+    table->klens = array[which++];
+    table->entries = array[which++];
+    table->hashes = array[which++];
+#ifdef HE4_INLINE_KEYS
+    table->ikeys = array[which++];
+#endif // HE4_INLINE_KEYS
+#endif // HE4SOA
+#if defined(TOUCH_ARRAY) && !defined(HE4NOTOUCH)
+    table->touches = array[which++];
+#endif
+    table->ctrl = array[which++];
+    table->meta = array[which++];
+    return count == 0;
+}
+
+//======================================================================
+// Local functions.
+// These are hidden and inline, and we do not check arguments.
+//======================================================================
+
+/**
+ * Determine if a cell is empty.  An empty cell is one that has never held
+ * a value.  A deleted cell is not considered empty.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @return              True if the cell is empty, and false otherwise.
+ */
+static inline bool
+is_empty(HE4 * table, const size_t index) {
+    return KLEN(table, index) == 0;
+}
+
+/**
+ * Determine if a cell is deleted ("lazy empty").  An deleted cell is one that
+ * previously held a value.  A deleted cell is not considered empty.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @return              True if the cell is deleted, and false otherwise.
+ */
+static inline bool
+is_deleted(HE4 * table, const size_t index) {
+    return KLEN(table, index) == KLEN_DELETED;
+}
+
+/**
+ * Determine if a cell is open.  An open cell is one that can have a value
+ * placed in it.  Both empty and deleted cells are considered open, so this
+ * is equivalent to the check
+ * `is_empty(table, index) || is_deleted(table, index)`.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @return              True if the cell is open, and false otherwise.
+ */
+static inline bool
+is_open(HE4 * table, const size_t index) {
+    return KLEN(table, index) == 0 || KLEN(table, index) == KLEN_DELETED;
+}
+
+/**
+ * Determine if a non-empty cell holds the given key.  The hash is checked
+ * first.  With the default comparison the key length is checked next and
+ * the keys are compared directly; a table with `HE4_EXACT_LENGTH` checks the
+ * key length before calling its comparison function.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @return              True if the cell holds the key, and false otherwise.
+ */
+static inline bool
+matches(HE4 * table, const size_t index, const he4_key_t key,
+        const size_t klen, const he4_hash_t hash) {
+    if (HASH(table, index) != hash) return false;
+    if (table->compare == he4_compare) {
+        return KLEN(table, index) == klen &&
+               memcmp(key, cell_key(table, index), klen) == 0;
+    }
+    if ((table->policy & HE4_EXACT_LENGTH) && KLEN(table, index) != klen) {
+        return false;
+    }
+    return table->compare(key, klen, cell_key(table, index),
+                          KLEN(table, index)) == 0;
+}
+
+/**
+ * Deallocate an entry that the table is discarding.  By-value entries that
+ * need no deallocation have no deallocation function.
+ *
+ * @param table         The table.
+ * @param entry         The entry.
+ */
+static inline void
+discard_entry(HE4 * table, const he4_entry_t entry) {
+#ifdef HE4_ENTRY_VALUE
+    if (table->delete_entry != NULL) table->delete_entry(entry);
+#else
+    if (entry != NULL) table->delete_entry(entry);
+#endif // HE4_ENTRY_VALUE
+}
+
+/**
+ * Empty a cell.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param free_key      If true, deallocate the key.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+empty_cell(HE4 * table, const size_t index,
+           const bool free_key, const bool free_entry) {
+    if (free_key && KEY(table, index) != NULL) {
+        table->delete_key(KEY(table, index));
+    }
+    if (free_entry) discard_entry(table, ENTRY(table, index));
+    put_cell(table, index, blank_cell);
+    set_ctrl(table, index, CTRL_EMPTY);
+}
+
+/**
+ * Empty a cell and then mark it as deleted.  The key is always deallocated.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+delete_cell(HE4 * table, const size_t index, const bool free_entry) {
+    empty_cell(table, index, true, free_entry);
+    KLEN(table, index) = KLEN_DELETED;
+    set_ctrl(table, index, CTRL_DELETED);
+    ++(table->deleted);
+}
+
+/**
+ * Make a mapping to store in a cell.  If the key is short enough to store
+ * inline, then it is copied into the mapping, and the key pointer is not
+ * kept, so the table never deallocates it.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param entry         The entry.
+ * @param hash          The hash of the key.
+ * @param touch_index   The touch index, if touch index is enabled.
+ * @return              The mapping.
+ */
+static inline he4_map_t
+make_map(HE4 * table, const he4_key_t key, const size_t klen,
+         const he4_entry_t entry, const he4_hash_t hash,
+         const size_t touch_index) {
+    he4_map_t map = blank_cell;
+#ifdef HE4_INLINE_KEYS
+    if (is_inline(table, klen)) {
+        memcpy(map.ikey, key, klen);
+    } else {
+        map.key = key;
+    }
+#else
+    map.key = key;
+    (void)table;
+#endif // HE4_INLINE_KEYS
+    map.klen = klen;
+    map.entry = entry;
+    map.hash = hash;
+#ifndef HE4NOTOUCH
+    map.touch = touch_index;
+#else
+    (void)touch_index;
+#endif // HE4NOTOUCH
+    return map;
+}
+
+/**
+ * Store a mapping in a cell.  Whatever was in the cell is overwritten and
+ * not deallocated.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param entry         The entry.
+ * @param hash          The hash of the key.
+ * @param touch_index   The touch index, if touch index is enabled.
+ */
+static inline void
+fill_cell(HE4 * table, const size_t index, const he4_key_t key,
+          const size_t klen, const he4_entry_t entry, const he4_hash_t hash,
+          const size_t touch_index) {
+    put_cell(table, index, make_map(table, key, klen, entry, hash,
+                                    touch_index));
+    set_ctrl(table, index, fingerprint(hash));
+}
+
+/**
+ * Move the content of a cell to another location in the table.  If the
+ * destination cell is occupied, it is first freed.  The source cell is left
+ * marked as deleted.
+ *
+ * @param table         The table.
+ * @param from          Index of the cell to move.
+ * @param to            Index of the receiving cell.
+ */
+static inline void
+move_cell(HE4 * table, const size_t from, const size_t to) {
+    if (is_deleted(table, to)) {
+        --(table->deleted);
+    } else if (! is_open(table, to)) {
+        empty_cell(table, to, true, true);
+    }
+    put_cell(table, to, get_cell(table, from));
+    set_ctrl(table, to, fingerprint(HASH(table, to)));
+    empty_cell(table, from, false, false);
+    KLEN(table, from) = KLEN_DELETED;
+    set_ctrl(table, from, CTRL_DELETED);
+    ++(table->deleted);
+}
+
+#if defined(HE4COMPACT) && !defined(HE4NOTOUCH)
+/**
+ * Rebase the touch indices of a table so that they start at zero.  If they
+ * still span more than half of the touch index range, then they are also
+ * halved until they do not.  The order of the touch indices is kept, though
+ * entries touched at nearly the same time may end up with the same index.
+ *
+ * @param table         The table.
+ */
+static void
+rebase_touch(HE4 * table) {
+    // The cells of an incremental rehash not yet migrated are kept in the
+    // old table, and are rebased along with the rest.
+    size_t low = table->max_touch;
+    for (HE4 * part = table; part != NULL; part = part->old) {
+        for (size_t index = 0; index < part->capacity; ++index) {
+            if (!is_open(part, index) && TOUCH(part, index) < low) {
+                low = TOUCH(part, index);
+            }
+        } // Find the lowest touch index.
+        for (size_t slot = 0; slot < part->stashed; ++slot) {
+            if (part->stash[slot].touch < low) low = part->stash[slot].touch;
+        } // Include the stash.
+    } // Check the old table too.
+    unsigned shift = 0;
+    size_t max_touch = table->max_touch - low;
+    while (max_touch > HE4_TOUCH_LIMIT / 2) {
+        max_touch >>= 1;
+        ++shift;
+    } // Find how far to shift the touch indices.
+    for (HE4 * part = table; part != NULL; part = part->old) {
+        for (size_t index = 0; index < part->capacity; ++index) {
+            if (is_open(part, index)) continue;
+            TOUCH(part, index) =
+                (he4_touch_t)((TOUCH(part, index) - low) >> shift);
+        } // Rebase the touch indices.
+        for (size_t slot = 0; slot < part->stashed; ++slot) {
+            he4_map_t * map = part->stash + slot;
+            map->touch = (he4_touch_t)((map->touch - low) >> shift);
+        } // Rebase the stash.
+    } // Rebase the old table too.
+    table->max_touch = max_touch;
+}
+#endif
+
+/**
+ * Make sure the maximum touch index can be incremented.  This only matters
+ * for compact tables, where the touch indices are rebased when they run out.
+ *
+ * @param table         The table.
+ */
+static inline void
+touch_room(HE4 * table) {
+#if defined(HE4COMPACT) && !defined(HE4NOTOUCH)
+    if (table->max_touch >= HE4_TOUCH_LIMIT) rebase_touch(table);
+#else
+    (void)table;
+#endif
+}
+
+/**
+ * Finish a successful search.  If this search counts as a use of the entry
+ * then the cell is moved to the first deleted cell passed during the search,
+ * if any, and the touch index is updated.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell that was found.
+ * @param lazy          Whether a deleted cell was passed.
+ * @param lazy_index    Index of the first deleted cell passed.
+ * @param use           Whether the search counts as a use of the entry.
+ * @return              The index of the cell now holding the entry.
+ */
+static inline size_t
+found_cell(HE4 * table, size_t index, const bool lazy,
+           const size_t lazy_index, const bool use) {
+    if (!use) return index;
+    if (lazy) {
+        move_cell(table, index, lazy_index);
+        index = lazy_index;
+    }
+#ifndef HE4NOTOUCH
+    touch_room(table);
+    ++(table->max_touch);
+    TOUCH(table, index) = table->max_touch;
+#endif // HE4NOTOUCH
+    return index;
+}
+
+/**
+ * Find the least-recently-used cell among the cells a probe for the hash
+ * visits, all of which must be occupied.  If the touch index is not enabled,
+ * then this is the cell where the probe for the hash starts.
+ *
+ * @param table         The hash table.
+ * @param hash          The hash of the key being inserted.
+ * @param limit         The number of cells the probe visits.
+ * @return              The index of the cell to overwrite.
+ */
+static inline size_t
+lru_cell(HE4 * table, const he4_hash_t hash, const size_t limit) {
+    probe_t probe;
+    probe_start(table, hash, &probe);
+    size_t lru_index = probe.index;
+#ifndef HE4NOTOUCH
+    size_t lru = SIZE_MAX;
+    for (size_t count = 0; count < limit; ++count) {
+        if (TOUCH(table, probe.index) < lru) {
+            lru = TOUCH(table, probe.index);
+            lru_index = probe.index;
+        }
+        probe_next(table, &probe);
+    } // Check every cell of the probe.
+#else
+    (void)limit;
+#endif // HE4NOTOUCH
+    return lru_index;
+}
+
+//======================================================================
+// Probe limit and overflow stash.
+// A table may bound the number of cells a probe visits.  Entries that find
+// no open cell within the bound go to a small stash instead, which every
+// search checks after the table.  Stash entries are given the indices that
+// follow the cells, so the search functions can return them.
+//======================================================================
+
+/**
+ * Get the number of cells a probe of the table may visit.
+ *
+ * @param table         The table.
+ * @return              The probe limit, or the capacity if there is none.
+ */
+static inline size_t
+probe_limit(HE4 * table) {
+    return table->probe_limit == 0 ? table->capacity : table->probe_limit;
+}
+
+/**
+ * Note the length of a probe made to insert a key, and mark the table as
+ * flooded if it is longer than the flood limit.
+ *
+ * @param table         The table.
+ * @param cells         The number of cells the probe passed.
+ */
+static inline void
+note_probe(HE4 * table, const size_t cells) {
+    if (table->flood_limit != 0 && cells > table->flood_limit) {
+        table->flooded = true;
+    }
+}
+
+/**
+ * Search the stash for a key.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param use           Whether the search counts as a use of the entry.
+ * @return              The capacity plus the stash index of the key, or
+ *                      `NOT_FOUND`.
+ */
+static inline size_t
+stash_find(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_hash_t hash, const bool use) {
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        he4_map_t * map = table->stash + slot;
+        if (map->hash != hash ||
+            table->compare(key, klen, map_key(table, map),
+                           map->klen) != 0) continue;
+#ifndef HE4NOTOUCH
+        if (use) {
+            touch_room(table);
+            map->touch = ++(table->max_touch);
+        }
+#else
+        (void)use;
+#endif // HE4NOTOUCH
+        return table->capacity + slot;
+    } // Search the stash.
+    return NOT_FOUND;
+}
+
+/**
+ * Remove an entry from the stash.  The key is always deallocated.  The last
+ * entry of the stash takes its place.
+ *
+ * @param table         The table.
+ * @param slot          The stash index of the entry.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+stash_remove(HE4 * table, const size_t slot, const bool free_entry) {
+    if (table->stash[slot].key != NULL) {
+        table->delete_key(table->stash[slot].key);
+    }
+    if (free_entry) discard_entry(table, table->stash[slot].entry);
+    table->stash[slot] = table->stash[--(table->stashed)];
+    table->stash[table->stashed] = blank_cell;
+}
+
+/**
+ * Get a pointer to the entry at an index returned by a search.
+ *
+ * @param table         The table.
+ * @param index         The index of a cell, or of a stash entry.
+ * @return              Pointer to the entry.
+ */
+static inline he4_entry_t *
+entry_at(HE4 * table, const size_t index) {
+    if (index >= table->capacity) {
+        return &(table->stash[index - table->capacity].entry);
+    }
+    return &ENTRY(table, index);
+}
+
+//======================================================================
+// Robin Hood hashing.
+// These are used for tables with the HE4_ROBIN_HOOD policy.  The meta array
+// holds the probe distance of each cell (the number of steps from the cell
+// where the probe for its hash starts) plus one, so zero marks an empty cell.
+// Insertion takes the cell of any entry that is closer to its start than the
+// new entry is, and carries the displaced entry on down the table.  Deletion
+// shifts the following entries back, so there are never deleted cells.
+//======================================================================
+
+/**
+ * Search for a key in a Robin Hood table.  The search stops at the first
+ * empty cell, or at the first entry closer to its start than the key would
+ * be.  See `find_cell`.
+ */
+static inline size_t
+rh_find(HE4 * table, const he4_key_t key, const size_t klen,
+        const he4_hash_t hash, const bool use) {
+    size_t index = home_cell(table, hash);
+    for (size_t dist = 0; dist < table->capacity; ++dist) {
+        // An empty cell has zero here, so this also stops at an empty cell.
+        if (table->meta[index] <= dist) return NOT_FOUND;
+        if (matches(table, index, key, klen, hash)) {
+            return found_cell(table, index, false, 0, use);
+        }
+        index = wrap_add(table, index, 1);
+    } // Find the entry.
+    return NOT_FOUND;
+}
+
+/**
+ * Place a mapping in a Robin Hood table.  The key must not already be in the
+ * table, and the table must have a free cell.
+ *
+ * @param table         The table.
+ * @param cell          The mapping to place.
+ * @return              The index of the cell that receives the mapping.
+ */
+static inline size_t
+rh_place(HE4 * table, he4_map_t cell) {
+    size_t index = home_cell(table, cell.hash);
+    size_t dist = 0;
+    size_t placed = NOT_FOUND;
+    while (table->meta[index] != 0) {
+        if (table->meta[index] <= dist) {
+            // The entry here is closer to its start than we are.  Take the
+            // cell and carry the entry along instead.
+            if (placed == NOT_FOUND) placed = index;
+            he4_map_t displaced = get_cell(table, index);
+            size_t displaced_dist = table->meta[index] - 1;
+            put_cell(table, index, cell);
+            table->meta[index] = (uint32_t)(dist + 1);
+            cell = displaced;
+            dist = displaced_dist;
+        }
+        index = wrap_add(table, index, 1);
+        ++dist;
+    } // Find an empty cell.
+    put_cell(table, index, cell);
+    table->meta[index] = (uint32_t)(dist + 1);
+    note_probe(table, dist);
+    return placed == NOT_FOUND ? index : placed;
+}
+
+/**
+ * Remove the mapping from a cell of a Robin Hood table, and shift the
+ * following entries back to fill the gap.  The key is always deallocated.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+rh_erase(HE4 * table, size_t index, const bool free_entry) {
+    empty_cell(table, index, true, free_entry);
+    table->meta[index] = 0;
+    size_t next = wrap_add(table, index, 1);
+    for (size_t count = 1; count < table->capacity; ++count) {
+        // Stop at an empty cell or an entry already at its start.
+        if (table->meta[next] <= 1) break;
+        put_cell(table, index, get_cell(table, next));
+        table->meta[index] = table->meta[next] - 1;
+        put_cell(table, next, blank_cell);
+        table->meta[next] = 0;
+        index = next;
+        next = wrap_add(table, next, 1);
+    } // Shift entries back.
+}
+
+//======================================================================
+// Hopscotch hashing.
+// These are used for tables with the HE4_HOPSCOTCH policy.  Every entry is
+// within hop_range cells of its home cell, and bit i of the meta entry of a
+// cell is set when the cell i cells on holds an entry whose home is that
+// cell.  Searches only visit the cells named by the bitmap.  Deletion just
+// empties the cell and clears its bit, so there are never deleted cells.
+//======================================================================
+
+/**
+ * Get the size of the neighborhood of a cell.  This is `HE4_HOP_RANGE`,
+ * unless the table is smaller than that.
+ *
+ * @param table         The table.
+ * @return              The number of cells in a neighborhood.
+ */
+static inline size_t
+hop_range(HE4 * table) {
+    return table->capacity < HE4_HOP_RANGE ? table->capacity : HE4_HOP_RANGE;
+}
+
+/**
+ * Find how far a cell is past another, wrapping at the end of the table.
+ *
+ * @param table         The table.
+ * @param from          The index of the first cell.
+ * @param to            The index of the second cell.
+ * @return              The number of steps from the first cell to the second.
+ */
+static inline size_t
+wrap_dist(HE4 * table, const size_t from, const size_t to) {
+    return to >= from ? to - from : to + table->capacity - from;
+}
+
+/**
+ * Search for a key in a hopscotch table.  Only the cells in the bitmap of
+ * the home cell are checked.  See `find_cell`.
+ */
+static inline size_t
+hop_find(HE4 * table, const he4_key_t key, const size_t klen,
+         const he4_hash_t hash, const bool use) {
+    size_t home = home_cell(table, hash);
+    uint32_t hops = table->meta[home];
+    while (hops != 0) {
+        size_t index = wrap_add(table, home, lowest_bit(hops));
+        if (matches(table, index, key, klen, hash)) {
+            return found_cell(table, index, false, 0, use);
+        }
+        hops &= hops - 1;
+    } // Check every cell in the neighborhood.
+    return NOT_FOUND;
+}
+
+/**
+ * Place a mapping in a hopscotch table.  The key must not already be in the
+ * table.  The nearest empty cell is found, and then entries are moved into
+ * it from earlier cells (staying within their own neighborhoods) until the
+ * empty cell is in the neighborhood of the home cell.
+ *
+ * @param table         The table.
+ * @param cell          The mapping to place.
+ * @return              False if the mapping was placed, and true if no empty
+ *                      cell could be brought into the neighborhood.
+ */
+static inline bool
+hop_place(HE4 * table, const he4_map_t cell) {
+    const size_t range = hop_range(table);
+    size_t home = home_cell(table, cell.hash);
+    size_t index = home;
+    size_t dist = 0;
+    while (!is_empty(table, index)) {
+        if (++dist == table->capacity) return true;
+        index = wrap_add(table, index, 1);
+    } // Find the nearest empty cell.
+    while (dist >= range) {
+        // Look for an entry to move into the empty cell.  Try the cells
+        // whose neighborhoods hold it furthest back first, and take the
+        // first of their entries that is before the empty cell.
+        size_t back = range - 1;
+        for (; back > 0; --back) {
+            size_t start = index >= back ? index - back :
+                           index + table->capacity - back;
+            uint32_t hops = table->meta[start] & (((uint32_t)1 << back) - 1);
+            if (hops == 0) continue;
+            unsigned hop = lowest_bit(hops);
+            size_t from = wrap_add(table, start, hop);
+            put_cell(table, index, get_cell(table, from));
+            put_cell(table, from, blank_cell);
+            table->meta[start] ^= ((uint32_t)1 << hop) |
+                                  ((uint32_t)1 << back);
+            dist -= back - hop;
+            index = from;
+            break;
+        } // Find an entry to move.
+        if (back == 0) return true;
+    } // Move the empty cell back.
+    put_cell(table, index, cell);
+    table->meta[home] |= (uint32_t)1 << dist;
+    return false;
+}
+
+/**
+ * Remove the mapping from a cell of a hopscotch table.  The key is always
+ * deallocated.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+hop_erase(HE4 * table, const size_t index, const bool free_entry) {
+    size_t home = home_cell(table, HASH(table, index));
+    table->meta[home] &= ~((uint32_t)1 << wrap_dist(table, home, index));
+    empty_cell(table, index, true, free_entry);
+}
+
+/**
+ * Find the least-recently-used cell in the neighborhood of a hash.  If the
+ * touch index is not enabled, then this is the home cell.  Every cell in the
+ * neighborhood must be occupied.
+ *
+ * @param table         The hash table.
+ * @param hash          The hash of the key being inserted.
+ * @return              The index of the cell to overwrite.
+ */
+static inline size_t
+hop_lru(HE4 * table, const he4_hash_t hash) {
+    size_t index = home_cell(table, hash);
+    size_t lru_index = index;
+#ifndef HE4NOTOUCH
+    size_t lru = SIZE_MAX;
+    for (size_t count = 0; count < hop_range(table); ++count) {
+        if (TOUCH(table, index) < lru) {
+            lru = TOUCH(table, index);
+            lru_index = index;
+        }
+        index = wrap_add(table, index, 1);
+    } // Check the neighborhood.
+#endif // HE4NOTOUCH
+    return lru_index;
+}
+
+//======================================================================
+// Cuckoo hashing.
+// These are used for tables with the HE4_CUCKOO policy.  The cells are
+// grouped into buckets of HE4_BUCKET_WAYS, and an entry lives in one of the
+// two buckets given by its hash.  Since the hash is kept in the cell, the
+// other bucket of any entry can be found, so insertion can move entries
+// between their buckets to make room.  Deletion just empties the cell.
+//======================================================================
+
+/**
+ * The most cells a cuckoo insertion examines looking for a chain of moves
+ * that frees a cell.  This covers about three levels of moves.
+ */
+#define CUCKOO_SEARCH 256
+
+/**
+ * Reduce a hash to a bucket of a cuckoo table.
+ *
+ * @param table         The table.
+ * @param hash          The hash.
+ * @return              The index of the first cell of the bucket.
+ */
+static inline size_t
+bucket_cell(HE4 * table, const he4_hash_t hash) {
+    const size_t buckets = table->capacity / HE4_BUCKET_WAYS;
+    size_t bucket;
+    if (table->policy & HE4_RANGE_MULTIPLY) {
+        bucket = scale_hash(hash, buckets);
+    } else if (table->mask != 0) {
+        bucket = (size_t)hash & (buckets - 1);
+    } else {
+        bucket = (size_t)hash % buckets;
+    }
+    return bucket * HE4_BUCKET_WAYS;
+}
+
+/**
+ * Find the two buckets for a hash.  They are always distinct.
+ *
+ * @param table         The table.
+ * @param hash          The hash.
+ * @param bucket        Receives the first cell of each bucket.
+ */
+static inline void
+cuckoo_buckets(HE4 * table, const he4_hash_t hash, size_t bucket[2]) {
+#ifdef HASH64
+    // Take the second bucket from the high half of the hash, so that it does
+    // not follow from the first.
+    bucket[0] = bucket_cell(table, hash);
+    bucket[1] = bucket_cell(table, ((hash >> 32) | (hash << 32)) *
+                                   UINT64_C(0x9E3779B97F4A7C15));
+#else
+    bucket[0] = bucket_cell(table, (uint32_t)hash);
+    bucket[1] = bucket_cell(table, (uint32_t)(((uint64_t)hash *
+                                  UINT64_C(0x9E3779B97F4A7C15)) >> 32));
+#endif // HASH64
+    if (bucket[1] == bucket[0]) {
+        bucket[1] = wrap_add(table, bucket[0], HE4_BUCKET_WAYS);
+    }
+}
+
+/**
+ * Get the index of one of the cells in the two buckets for a hash.
+ *
+ * @param bucket        The first cell of each bucket.
+ * @param way           Which cell, counting through both buckets.
+ * @return              The index of the cell.
+ */
+static inline size_t
+bucket_way(const size_t bucket[2], const size_t way) {
+    return bucket[way / HE4_BUCKET_WAYS] + way % HE4_BUCKET_WAYS;
+}
+
+/**
+ * Search for a key in a cuckoo table.  Only the cells of the two buckets
+ * for the hash are checked.  See `find_cell`.
+ */
+static inline size_t
+cuckoo_find(HE4 * table, const he4_key_t key, const size_t klen,
+            const he4_hash_t hash, const bool use) {
+    size_t bucket[2];
+    cuckoo_buckets(table, hash, bucket);
+    for (size_t way = 0; way < 2 * HE4_BUCKET_WAYS; ++way) {
+        size_t index = bucket_way(bucket, way);
+        if (!is_open(table, index) &&
+            matches(table, index, key, klen, hash)) {
+            return found_cell(table, index, false, 0, use);
+        }
+    } // Check both buckets.
+    return NOT_FOUND;
+}
+
+/**
+ * Find an empty cell in a bucket of a cuckoo table.
+ *
+ * @param table         The table.
+ * @param bucket        The first cell of the bucket.
+ * @return              The index of an empty cell, or `NOT_FOUND`.
+ */
+static inline size_t
+cuckoo_empty(HE4 * table, const size_t bucket) {
+    for (size_t way = 0; way < HE4_BUCKET_WAYS; ++way) {
+        if (is_open(table, bucket + way)) return bucket + way;
+    } // Check the bucket.
+    return NOT_FOUND;
+}
+
+/**
+ * Free a cell in one of the two buckets for a hash, moving entries to their
+ * other buckets if necessary.  The moves are found by a breadth-first search
+ * over the entries of the buckets, so the chain of moves is as short as
+ * possible.
+ *
+ * @param table         The table.
+ * @param hash          The hash of the key being inserted.
+ * @return              The index of the empty cell, or `NOT_FOUND` if no
+ *                      chain of moves could be found.
+ */
+static inline size_t
+cuckoo_make_room(HE4 * table, const he4_hash_t hash) {
+    size_t bucket[2];
+    cuckoo_buckets(table, hash, bucket);
+    for (size_t which = 0; which < 2; ++which) {
+        size_t index = cuckoo_empty(table, bucket[which]);
+        if (index != NOT_FOUND) return index;
+    } // Look for an empty cell.
+
+    // Search for a chain of moves.  Each node is an occupied cell, and its
+    // children are the cells of the other bucket of its entry.
+    size_t cell[CUCKOO_SEARCH];
+    size_t parent[CUCKOO_SEARCH];
+    size_t count = 0;
+    for (size_t way = 0; way < 2 * HE4_BUCKET_WAYS; ++way) {
+        cell[count] = bucket_way(bucket, way);
+        parent[count++] = NOT_FOUND;
+    } // Start with both buckets.
+    for (size_t node = 0; node < count; ++node) {
+        size_t other[2];
+        cuckoo_buckets(table, HASH(table, cell[node]), other);
+        size_t here = cell[node] - cell[node] % HE4_BUCKET_WAYS;
+        size_t alt = other[0] == here ? other[1] : other[0];
+        size_t empty = cuckoo_empty(table, alt);
+        if (empty != NOT_FOUND) {
+            // Found a chain.  Move each entry along it, last first.
+            for (size_t at = node; at != NOT_FOUND; at = parent[at]) {
+                put_cell(table, empty, get_cell(table, cell[at]));
+                empty = cell[at];
+            } // Move the entries.
+            put_cell(table, empty, blank_cell);
+            return empty;
+        }
+        for (size_t way = 0; way < HE4_BUCKET_WAYS; ++way) {
+            if (count == CUCKOO_SEARCH) break;
+            cell[count] = alt + way;
+            parent[count++] = node;
+        } // Add the other bucket.
+    } // Search for a chain.
+    return NOT_FOUND;
+}
+
+/**
+ * Find the least-recently-used cell in the two buckets for a hash.  If the
+ * touch index is not enabled, then this is the first cell of the first
+ * bucket.  Every cell of both buckets must be occupied.
+ *
+ * @param table         The hash table.
+ * @param hash          The hash of the key being inserted.
+ * @return              The index of the cell to overwrite.
+ */
+static inline size_t
+cuckoo_lru(HE4 * table, const he4_hash_t hash) {
+    size_t bucket[2];
+    cuckoo_buckets(table, hash, bucket);
+    size_t lru_index = bucket[0];
+#ifndef HE4NOTOUCH
+    size_t lru = SIZE_MAX;
+    for (size_t way = 0; way < 2 * HE4_BUCKET_WAYS; ++way) {
+        size_t index = bucket_way(bucket, way);
+        if (TOUCH(table, index) < lru) {
+            lru = TOUCH(table, index);
+            lru_index = index;
+        }
+    } // Check both buckets.
+#endif // HE4NOTOUCH
+    return lru_index;
+}
+
+/**
+ * Remove the mapping from a cell.  The key is always deallocated.  Depending
+ * on the table policy the cell is marked as deleted, the following entries
+ * are shifted back to fill it, or it is simply emptied.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell.
+ * @param free_entry    If true, deallocate the entry.
+ */
+static inline void
+remove_cell(HE4 * table, const size_t index, const bool free_entry) {
+    if (table->policy & HE4_ROBIN_HOOD) {
+        rh_erase(table, index, free_entry);
+    } else if (table->policy & HE4_HOPSCOTCH) {
+        hop_erase(table, index, free_entry);
+    } else if (table->policy & HE4_CUCKOO) {
+        empty_cell(table, index, true, free_entry);
+    } else {
+        delete_cell(table, index, free_entry);
+    }
+}
+
+//======================================================================
+// Compaction.
+// Removing an entry from a table that probes leaves a deleted cell behind.
+// Compaction empties the deleted cells and moves every entry to the first
+// cell of its probe sequence that is not taken by an entry already placed.
+// Entries not yet placed are marked by setting the top bit of their key
+// length, which no valid key length has.
+//======================================================================
+
+/**
+ * Key length bit that marks an entry not yet placed by compaction.
+ */
+#define KLEN_PENDING ((he4_klen_t)(KLEN_DELETED ^ (KLEN_DELETED >> 1)))
+
+/**
+ * Compact a table with a probe limit in place.  See `he4_compact`.
+ *
+ * The swaps made by `compact` can move an entry past the probe limit, where
+ * no search looks for it.  Here an entry only ever moves to an empty cell
+ * earlier in its own probe sequence, so it stays within the limit.  Moving
+ * an entry empties its cell, which may separate other entries from the
+ * start of their probe sequences, so the passes repeat until no entry moves.
+ * Every move shortens the probe for an entry, so this ends, and a pass
+ * visits at most the probe limit of cells for each entry.
+ *
+ * @param table         The table.
+ */
+static void
+compact_limited(HE4 * table) {
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (is_deleted(table, index)) empty_cell(table, index, false, false);
+    } // Empty the deleted cells.
+    table->deleted = 0;
+
+    const size_t limit = table->probe_limit;
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        for (size_t index = 0; index < table->capacity; ++index) {
+            if (is_empty(table, index)) continue;
+            probe_t probe;
+            probe_start(table, HASH(table, index), &probe);
+            size_t count = 0;
+            while (count < limit && probe.index != index &&
+                   !is_empty(table, probe.index)) {
+                probe_next(table, &probe);
+                ++count;
+            } // Find the first empty cell before this one.
+            if (count == limit || probe.index == index) continue;
+            he4_map_t map = get_cell(table, index);
+            empty_cell(table, index, false, false);
+            put_cell(table, probe.index, map);
+            set_ctrl(table, probe.index, fingerprint(map.hash));
+            moved = true;
+        } // Traverse the table.
+    } // Repeat until no entry moves.
+}
+
+/**
+ * Compact the table in place.  See `he4_compact`.  A table with a probe
+ * limit is compacted by `compact_limited` instead.
+ *
+ * Entries are placed in index order.  An entry goes to the first cell of
+ * its probe sequence that is empty or holds an entry not yet placed, which
+ * is at worst its own cell.  If that cell holds another entry not yet
+ * placed, the two are swapped and the other entry is placed next.  Placed
+ * entries never move again, and a cell is only emptied when the entry in it
+ * moves to an earlier cell of its own probe sequence, so no entry is ever
+ * separated from the start of its probe sequence by an empty cell.
+ *
+ * @param table         The table.
+ */
+static void
+compact(HE4 * table) {
+    if (table->probe_limit != 0) {
+        compact_limited(table);
+        return;
+    }
+
+    // Empty the deleted cells, and mark every entry as not yet placed.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (is_deleted(table, index)) {
+            empty_cell(table, index, false, false);
+        } else if (!is_empty(table, index)) {
+            KLEN(table, index) |= KLEN_PENDING;
+        }
+    } // Mark the cells.
+    table->deleted = 0;
+
+    // Place the entries.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        while (KLEN(table, index) & KLEN_PENDING) {
+            KLEN(table, index) &= (he4_klen_t)~KLEN_PENDING;
+            probe_t probe;
+            probe_start(table, HASH(table, index), &probe);
+            while (probe.index != index &&
+                   KLEN(table, probe.index) != 0 &&
+                   !(KLEN(table, probe.index) & KLEN_PENDING)) {
+                probe_next(table, &probe);
+            } // Find the first cell not taken by a placed entry.
+            if (probe.index == index) {
+                set_ctrl(table, index, fingerprint(HASH(table, index)));
+                break;
+            }
+            he4_map_t map = get_cell(table, index);
+            if (is_empty(table, probe.index)) {
+                empty_cell(table, index, false, false);
+            } else {
+                put_cell(table, index, get_cell(table, probe.index));
+            }
+            put_cell(table, probe.index, map);
+            set_ctrl(table, probe.index, fingerprint(map.hash));
+        } // Place the entry in this cell, and any swapped into it.
+    } // Traverse the table.
+}
+
+/**
+ * Compact the table if removals have left too many deleted cells.
+ *
+ * @param table         The table.
+ */
+static inline void
+check_deleted(HE4 * table) {
+    if (table->deleted_ratio > 0.0 && (double)table->deleted >
+        table->deleted_ratio * (double)table->capacity) {
+        compact(table);
+    }
+}
+
+//======================================================================
+// Search.
+//======================================================================
+
+/**
+ * Search for a key using the control bytes, a group at a time.  See
+ * `find_cell`.
+ */
+static inline size_t
+find_group(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_hash_t hash, const bool use) {
+    const uint8_t fp = fingerprint(hash);
+    probe_t probe;
+    probe_start(table, hash, &probe);
+    bool lazy = false;
+    size_t lazy_index = 0;
+    const size_t limit = probe_limit(table);
+    for (size_t seen = 0; seen < limit; seen += GROUP_WIDTH) {
+        size_t index = probe.base;
+        group_t group = group_load(table->ctrl + index);
+        size_t count = limit - seen;
+        group_mask_t valid = count < GROUP_WIDTH ?
+                             ((group_mask_t)1 << count) - 1 : GROUP_ALL;
+        group_mask_t empty = group_match(group, CTRL_EMPTY) & valid;
+        group_mask_t hits = group_match(group, fp) & valid &
+                            below_lowest(empty);
+        while (hits != 0) {
+            unsigned bit = lowest_bit(hits);
+            size_t cell = wrap_add(table, index, bit);
+            if (matches(table, cell, key, klen, hash)) {
+                if (use && !lazy) {
+                    // Look for a deleted cell earlier in this group.
+                    group_mask_t deleted = group_match(group, CTRL_DELETED) &
+                                           (((group_mask_t)1 << bit) - 1);
+                    if (deleted != 0) {
+                        lazy = true;
+                        lazy_index = wrap_add(table, index,
+                                              lowest_bit(deleted));
+                    }
+                }
+                return found_cell(table, cell, lazy, lazy_index, use);
+            }
+            hits &= hits - 1;
+        } // Check every fingerprint match.
+
+        // If we hit an empty cell, we can stop.
+        if (empty != 0) return NOT_FOUND;
+
+        // Keep track of the first deleted cell.
+        if (use && !lazy) {
+            group_mask_t deleted = group_match(group, CTRL_DELETED) & valid;
+            if (deleted != 0) {
+                lazy = true;
+                lazy_index = wrap_add(table, index, lowest_bit(deleted));
+            }
+        }
+        probe_next_group(table, &probe);
+    } // Search the groups.
+    return NOT_FOUND;
+}
+
+/**
+ * Search for a key cell by cell.  See `find_cell`.
+ */
+static inline size_t
+find_probe(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_hash_t hash, const bool use) {
+    // Find the corresponding entry.  Stop after visiting every cell the
+    // probe may visit, which can happen with a full table.
+    probe_t probe;
+    probe_start(table, hash, &probe);
+    bool lazy = false;
+    size_t lazy_index = 0;
+    const size_t limit = probe_limit(table);
+    for (size_t count = 0; count < limit; ++count) {
+        size_t index = probe.index;
+
+        // If we find an empty slot, stop.
+        if (is_empty(table, index)) return NOT_FOUND;
+
+        // Pass over deleted cells.
+        if (is_deleted(table, index)) {
+            if (!lazy) {
+                // This is the first lazy-deleted cell encountered.
+                lazy = true;
+                lazy_index = index;
+            }
+        } else if (matches(table, index, key, klen, hash)) {
+            // Found the entry.
+            return found_cell(table, index, lazy, lazy_index, use);
+        }
+        probe_next(table, &probe);
+    } // Find the entry.
+
+    // Not found.
+    return NOT_FOUND;
+}
+
+/**
+ * Search for a key.  Deleted cells are passed over, and the search stops at
+ * the first empty cell or when the entire table (or as much of it as the
+ * probe limit allows) has been searched.  The stash is then searched.
+ *
+ * If the search counts as a use of the entry, then the entry may be moved to
+ * the first deleted cell passed during the search (so that found items move
+ * to the front of the line) and its touch index is updated.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param use           Whether the search counts as a use of the entry.
+ * @return              The index of the cell holding the key, the capacity
+ *                      plus the stash index of the key, or `NOT_FOUND`.
+ */
+static inline size_t
+find_cell(HE4 * table, const he4_key_t key, const size_t klen,
+          const he4_hash_t hash, const bool use) {
+    if (table->policy & HE4_ROBIN_HOOD) {
+        return rh_find(table, key, klen, hash, use);
+    }
+    if (table->policy & HE4_HOPSCOTCH) {
+        return hop_find(table, key, klen, hash, use);
+    }
+    if (table->policy & HE4_CUCKOO) {
+        return cuckoo_find(table, key, klen, hash, use);
+    }
+    size_t index = table->ctrl != NULL ?
+                   find_group(table, key, klen, hash, use) :
+                   find_probe(table, key, klen, hash, use);
+    if (index == NOT_FOUND && table->stashed != 0) {
+        index = stash_find(table, key, klen, hash, use);
+    }
+    return index;
+}
+
+//======================================================================
+// Incremental rehash.
+// During an incremental rehash the table has new arrays, and the old arrays
+// are kept in a second table until every entry has moved.  Every key is in
+// exactly one of the two.  Old cells are migrated in index order, so the
+// cells before `drained` are all open, and a key found among the old cells is
+// migrated before it is used.
+//======================================================================
+
+/**
+ * Place a mapping in a table.  The key must not already be in the table, and
+ * the table must have a free cell.
+ *
+ * @param table         The table.
+ * @param map           The mapping to place.
+ */
+static inline void
+place_map(HE4 * table, const he4_map_t map) {
+    if (table->policy & HE4_ROBIN_HOOD) {
+        rh_place(table, map);
+    } else {
+        probe_t probe;
+        probe_start(table, map.hash, &probe);
+        while (!is_open(table, probe.index)) probe_next(table, &probe);
+        if (is_deleted(table, probe.index)) --(table->deleted);
+        put_cell(table, probe.index, map);
+        set_ctrl(table, probe.index, fingerprint(map.hash));
+    }
+    --(table->free);
+}
+
+/**
+ * Move the entry in a cell of the old table to the new arrays.
+ *
+ * @param table         The table being rehashed.
+ * @param index         The index of the old cell.
+ */
+static inline void
+migrate_cell(HE4 * table, const size_t index) {
+    HE4 * old = table->old;
+    place_map(table, get_cell(old, index));
+    // The key and entry now belong to the new arrays.
+    KEY(old, index) = NULL;
+    remove_cell(old, index, false);
+    ++(old->free);
+}
+
+/**
+ * Advance any incremental rehash, and then search for a key.  A key found
+ * among the old cells is first migrated.  See `find_cell`.
+ */
+static inline size_t
+search_cell(HE4 * table, const he4_key_t key, const size_t klen,
+            const he4_hash_t hash, const bool use) {
+    if (table->old == NULL) return find_cell(table, key, klen, hash, use);
+    he4_rehash_step(table, HE4_REHASH_STEP);
+    size_t index = find_cell(table, key, klen, hash, use);
+    if (index != NOT_FOUND || table->old == NULL) return index;
+    index = find_cell(table->old, key, klen, hash, false);
+    if (index == NOT_FOUND) return NOT_FOUND;
+    migrate_cell(table, index);
+    return find_cell(table, key, klen, hash, use);
+}
+
+/**
+ * Advance any incremental rehash before inserting a key.  If the key is
+ * among the old cells, it is first migrated, so that the insertion finds it.
+ * Otherwise, if the new key would leave too little room for the entries
+ * still to migrate, the rehash is finished.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ */
+static inline void
+prepare_insert(HE4 * table, const he4_key_t key, const size_t klen,
+               const he4_hash_t hash) {
+    he4_rehash_step(table, HE4_REHASH_STEP);
+    if (table->old == NULL) return;
+    size_t index = find_cell(table->old, key, klen, hash, false);
+    if (index != NOT_FOUND) {
+        migrate_cell(table, index);
+    } else if (table->free <= he4_size(table->old)) {
+        he4_rehash_step(table, SIZE_MAX);
+    }
+}
+
+//======================================================================
+// Default functions.
+// These cannot be inline because we need pointers to them.
+//======================================================================
+
+/**
+ * Compute the default hash of a key with a seed.  This is XXH3 for 64-bit
+ * hashes, and XXH32 otherwise.
+ *
+ * @param key           Pointer to the key to hash.
+ * @param length        Number of bytes in key.
+ * @param seed          The seed.
+ * @return              The hash value.
+ */
+static inline he4_hash_t
+seeded_hash(const he4_key_t key, const size_t length, const uint64_t seed) {
+#ifdef HASH64
+    return XXH3_64bits_withSeed(key, length, seed);
+#else
+    return XXH32(key, length, (XXH32_hash_t)seed);
+#endif // HASH64
+}
+
+/**
+ * This is the default hash function.  You cannot use this function if you
+ * have re-defined the hash type.  Tables that use it give it their seed
+ * instead of calling it (see `key_hash`).
+ *
+ * @param key           Pointer to the key to hash.
+ * @param length        Number of bytes in key.
+ * @return              The hash value.
+ */
+static he4_hash_t
+he4_hash(const he4_key_t key, const size_t length) {
+    return seeded_hash(key, length, 0);
+}
+
+/**
+ * This is the default key comparison.
+ *
+ * @param key1          First key.
+ * @param klen1         First key length.
+ * @param key2          Second key.
+ * @param klen2         Second key length.
+ * @return              Non-zero if unequal, zero if equal.
+ */
+static int
+he4_compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    return klen1 != klen2 ? 1 : memcmp(key1, key2, klen1);
+}
+
+/**
+ * This is the default key deletion.
+ *
+ * @param key           The key to delete.
+ */
+static void
+he4_delete_key(he4_key_t key) {
+    HE4FREE(key);
+}
+
+#ifndef HE4_ENTRY_VALUE
+/**
+ * This is the default entry deletion.
+ *
+ * @param entry         The entry to delete.
+ */
+static void
+he4_delete_entry(he4_entry_t entry) {
+    HE4FREE(entry);
+}
+#endif // HE4_ENTRY_VALUE
+
+//======================================================================
+// Hashing keys.
+// Tables that use the default hash give it their own seed, so every key is
+// hashed through key_hash.  The batch functions hash their keys together.
+// If HE4_HASH_LANES is defined, then with the default hash and AVX2 sixteen
+// short keys are hashed at once, one in each 32-bit lane of two vectors, by
+// running the steps of XXH32 on all of them.  Lanes whose keys have run out
+// are masked, so the result is exactly that of XXH32 for every key.  This is
+// not the default, because XXH32 is a chain of dependent multiplications,
+// which are slower on vectors, and on some processors the scalar code is as
+// fast.
+//======================================================================
+
+/**
+ * Hash a key with the hash function of a table.  The default hash is given
+ * the seed of the table.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @return              The hash of the key.
+ */
+static inline he4_hash_t
+key_hash(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (table->hash == he4_hash) return seeded_hash(key, klen, table->seed);
+    return table->hash(key, klen);
+}
+
+#if defined(HE4_HASH_LANES) && !defined(HE4NOSIMD) && defined(__AVX2__) && \
+    !defined(HE4_USER_HASH) && !defined(HASH64)
+#  include <immintrin.h>
+#  define HASH_AVX2
+/** Number of vectors of eight keys hashed at once. */
+#  define VECTORS 2
+/** Number of keys hashed at once. */
+#  define LANES (8 * VECTORS)
+/** Longest key, in bytes, hashed in a lane. */
+#  define LANE_KEY_BYTES 32
+
+/** The XXH32 primes. */
+#  define XXH_P1 0x9E3779B1u
+#  define XXH_P2 0x85EBCA77u
+#  define XXH_P3 0xC2B2AE3Du
+#  define XXH_P4 0x27D4EB2Fu
+#  define XXH_P5 0x165667B1u
+
+/** Rotate every lane left. */
+#  define ROTL_LANES(m_x, m_bits) \
+        _mm256_or_si256(_mm256_slli_epi32((m_x), (m_bits)), \
+                        _mm256_srli_epi32((m_x), 32 - (m_bits)))
+/** Multiply every lane by a constant. */
+#  define MUL_LANES(m_x, m_k) \
+        _mm256_mullo_epi32((m_x), _mm256_set1_epi32((int)(m_k)))
+
+/**
+ * One XXH32 accumulator round in every lane.
+ */
+static inline __m256i
+xxh32_round(__m256i acc, const __m256i input) {
+    acc = _mm256_add_epi32(acc, MUL_LANES(input, XXH_P2));
+    return MUL_LANES(ROTL_LANES(acc, 13), XXH_P1);
+}
+
+/**
+ * Transpose eight rows of eight 32-bit words in place, so that row `j`
+ * then holds word `j` of every original row.
+ *
+ * @param rows          The rows.
+ */
+static inline void
+transpose_words(__m256i rows[8]) {
+    __m256i pairs[8];
+    __m256i quads[8];
+    for (int at = 0; at < 8; at += 2) {
+        pairs[at] = _mm256_unpacklo_epi32(rows[at], rows[at + 1]);
+        pairs[at + 1] = _mm256_unpackhi_epi32(rows[at], rows[at + 1]);
+    } // Interleave the words of pairs of rows.
+    for (int at = 0; at < 8; at += 4) {
+        quads[at] = _mm256_unpacklo_epi64(pairs[at], pairs[at + 2]);
+        quads[at + 1] = _mm256_unpackhi_epi64(pairs[at], pairs[at + 2]);
+        quads[at + 2] = _mm256_unpacklo_epi64(pairs[at + 1], pairs[at + 3]);
+        quads[at + 3] = _mm256_unpackhi_epi64(pairs[at + 1], pairs[at + 3]);
+    } // Interleave the pairs of words of pairs of pairs.
+    for (int at = 0; at < 4; ++at) {
+        rows[at] = _mm256_permute2x128_si256(quads[at], quads[at + 4], 0x20);
+        rows[at + 4] = _mm256_permute2x128_si256(quads[at], quads[at + 4],
+                                                 0x31);
+    } // Join the halves.
+}
+
+/**
+ * Compute XXH32 of sixteen keys at once.  The keys are held
+ * in two vectors of eight, so that the two chains of multiplications can
+ * overlap.
+ *
+ * @param keys          The keys.
+ * @param klens         Length in bytes of each key.
+ * @param seed          The seed.
+ * @param hashes        Receives the hash of each key.
+ * @return              False if the keys were hashed, and true if any key is
+ *                      too long to hash in a lane.
+ */
+static bool
+xxh32_lanes(const he4_key_t keys[], const size_t klens[], const uint32_t seed,
+            he4_hash_t hashes[]) {
+    // Load the whole words of each key with a masked load, which does not
+    // touch memory past the end of the key, and transpose them so that each
+    // vector holds the same word of eight keys.  The bytes after the last
+    // whole word are read as part of the last four bytes of the key, or one
+    // at a time for keys shorter than a word, and kept in the top bytes of a
+    // word of their own.
+    uint32_t lens[LANES];
+    uint32_t tails[LANES];
+    __m256i rows[VECTORS][8];
+    const __m256i word_index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    uint32_t stripes = 0;
+    uint32_t words = 0;
+    uint32_t bytes = 0;
+    for (int lane = 0; lane < LANES; ++lane) {
+        // Keys that are NULL are given length 0, so they are never read.
+        const uint8_t * key = (const uint8_t *)keys[lane];
+        const uint32_t len = key == NULL ? 0 : (uint32_t)klens[lane];
+        if (len > LANE_KEY_BYTES) return true;
+        lens[lane] = len;
+        // Steps that no key needs are skipped.
+        if (len / 16 > stripes) stripes = len / 16;
+        if ((len & 15) / 4 > words) words = (len & 15) / 4;
+        if ((len & 3) > bytes) bytes = len & 3;
+        rows[lane / 8][lane % 8] = _mm256_maskload_epi32((const int *)key,
+                _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(len / 4)),
+                                   word_index));
+        if (len >= 4) {
+            memcpy(tails + lane, key + len - 4, 4);
+        } else {
+            tails[lane] = 0;
+            for (uint32_t byte = 0; byte < len; ++byte) {
+                tails[lane] |= (uint32_t)key[byte] << (8 * (4 - len + byte));
+            } // Place the bytes at the top of the word.
+        }
+    } // Load every key.
+
+    for (int v = 0; v < VECTORS; ++v) transpose_words(rows[v]);
+    __m256i len[VECTORS];
+    __m256i long_key[VECTORS];
+    __m256i h[VECTORS];
+    for (int v = 0; v < VECTORS; ++v) {
+        len[v] = _mm256_loadu_si256((const __m256i *)(lens + 8 * v));
+        long_key[v] = _mm256_cmpgt_epi32(len[v], _mm256_set1_epi32(15));
+    } // Load the lengths.
+
+    // Keys of 16 bytes or more are first consumed 16 bytes at a time by four
+    // accumulators.
+    for (int v = 0; v < VECTORS; ++v) {
+        __m256i acc[4] = {
+            _mm256_set1_epi32((int)(seed + XXH_P1 + XXH_P2)),
+            _mm256_set1_epi32((int)(seed + XXH_P2)),
+            _mm256_set1_epi32((int)seed),
+            _mm256_set1_epi32((int)(seed - XXH_P1)),
+        };
+        for (uint32_t stripe = 0; stripe < stripes; ++stripe) {
+            __m256i mask = _mm256_cmpgt_epi32(len[v],
+                    _mm256_set1_epi32((int)(16 * stripe + 15)));
+            for (int which = 0; which < 4; ++which) {
+                acc[which] = _mm256_blendv_epi8(acc[which],
+                        xxh32_round(acc[which], rows[v][4 * stripe + which]),
+                        mask);
+            } // Run each accumulator.
+        } // Consume every stripe.
+        h[v] = _mm256_add_epi32(
+                _mm256_add_epi32(ROTL_LANES(acc[0], 1),
+                                 ROTL_LANES(acc[1], 7)),
+                _mm256_add_epi32(ROTL_LANES(acc[2], 12),
+                                 ROTL_LANES(acc[3], 18)));
+        h[v] = _mm256_blendv_epi8(_mm256_set1_epi32((int)(seed + XXH_P5)),
+                                  h[v], long_key[v]);
+        h[v] = _mm256_add_epi32(h[v], len[v]);
+    } // Run the accumulators of each vector.
+
+    // Then up to three words, which follow the stripes.  A key of 32 bytes
+    // has none, so these come from the first stripe or just after it.
+    for (uint32_t word = 0; word < words; ++word) {
+        for (int v = 0; v < VECTORS; ++v) {
+            __m256i mask = _mm256_cmpgt_epi32(
+                    _mm256_and_si256(len[v], _mm256_set1_epi32(15)),
+                    _mm256_set1_epi32((int)(4 * word + 3)));
+            __m256i words = _mm256_blendv_epi8(rows[v][word],
+                                               rows[v][4 + word],
+                                               long_key[v]);
+            __m256i next = _mm256_add_epi32(h[v], MUL_LANES(words, XXH_P3));
+            next = MUL_LANES(ROTL_LANES(next, 17), XXH_P4);
+            h[v] = _mm256_blendv_epi8(h[v], next, mask);
+        } // Consume the word in each vector.
+    } // Consume every word.
+
+    // Then up to three bytes, from the top of the tail word.
+    for (uint32_t byte = 0; byte < bytes; ++byte) {
+        for (int v = 0; v < VECTORS; ++v) {
+            __m256i tail = _mm256_and_si256(len[v], _mm256_set1_epi32(3));
+            __m256i mask = _mm256_cmpgt_epi32(tail,
+                    _mm256_set1_epi32((int)byte));
+            __m256i shift = _mm256_slli_epi32(_mm256_sub_epi32(
+                    _mm256_set1_epi32((int)(4 + byte)), tail), 3);
+            __m256i value = _mm256_and_si256(_mm256_srlv_epi32(
+                    _mm256_loadu_si256((const __m256i *)(tails + 8 * v)),
+                    shift), _mm256_set1_epi32(0xFF));
+            __m256i next = _mm256_add_epi32(h[v], MUL_LANES(value, XXH_P5));
+            next = MUL_LANES(ROTL_LANES(next, 11), XXH_P1);
+            h[v] = _mm256_blendv_epi8(h[v], next, mask);
+        } // Consume the byte in each vector.
+    } // Consume every byte.
+
+    // Mix the bits.
+    for (int v = 0; v < VECTORS; ++v) {
+        h[v] = MUL_LANES(_mm256_xor_si256(h[v], _mm256_srli_epi32(h[v], 15)),
+                         XXH_P2);
+        h[v] = MUL_LANES(_mm256_xor_si256(h[v], _mm256_srli_epi32(h[v], 13)),
+                         XXH_P3);
+        h[v] = _mm256_xor_si256(h[v], _mm256_srli_epi32(h[v], 16));
+        _mm256_storeu_si256((__m256i *)(hashes + 8 * v), h[v]);
+    } // Mix and store each vector.
+    return false;
+}
+#endif // HASH_AVX2
+
+/**
+ * Hash many keys with the hash function of a table.  A key that is `NULL`,
+ * or that has length 0, is given hash 0.
+ *
+ * @param table         The table.
+ * @param keys          The keys.
+ * @param klens         Length in bytes of each key.
+ * @param count         The number of keys.
+ * @param hashes        Receives the hash of each key.
+ */
+static void
+hash_keys(HE4 * table, const he4_key_t keys[], const size_t klens[],
+          const size_t count, he4_hash_t hashes[]) {
+    size_t at = 0;
+#ifdef HASH_AVX2
+    if (table->hash == he4_hash) {
+        for (; at + LANES <= count; at += LANES) {
+            if (!xxh32_lanes(keys + at, klens + at, (uint32_t)table->seed,
+                             hashes + at)) {
+                for (size_t lane = at; lane < at + LANES; ++lane) {
+                    if (keys[lane] == NULL || klens[lane] == 0) {
+                        hashes[lane] = 0;
+                    }
+                } // Clear the hashes of missing keys.
+                continue;
+            }
+            for (size_t lane = at; lane < at + LANES; ++lane) {
+                hashes[lane] = keys[lane] == NULL || klens[lane] == 0 ? 0 :
+                               key_hash(table, keys[lane], klens[lane]);
+            } // Hash a long key, and its neighbors, one at a time.
+        } // Hash the keys sixteen at a time.
+    }
+#endif // HASH_AVX2
+    for (; at < count; ++at) {
+        hashes[at] = keys[at] == NULL || klens[at] == 0 ? 0 :
+                     key_hash(table, keys[at], klens[at]);
+    } // Hash the rest one at a time.
+}
+
+//======================================================================
+// Table constructor.
+//======================================================================
+
+size_t
+he4_best_capacity(size_t bytes) {
+    // Subtract the size of the structure.
+    bytes -= sizeof(HE4);
+    // Every cell must include (1) a key, (2) the key length, (3) an entry,
+    // (4) the hash, and (5) the touch index.  How many bytes that takes
+    // depends on how the cells are stored.
+    size_t maximum = bytes / CELL_BYTES;
+    return maximum;
+}
+
+HE4 *
+he4_new(size_t entries,
+        he4_hash_t (* hash)(he4_key_t key, size_t klen),
+        int (* compare)(he4_key_t key1, size_t klen1, he4_key_t key2,
+                        size_t klen2),
+        void (* delete_key)(he4_key_t key),
+        void (* delete_entry)(he4_entry_t thing)) {
+    return he4_new_policy(entries, HE4_POLICY_DEFAULT, hash, compare,
+                          delete_key, delete_entry);
+}
+
+/**
+ * Find the capacity of a table with the given policy, and the mask used to
+ * reduce a hash to a cell index.  The capacity is rounded up to a power of
+ * two, if required.  With control bytes it must also be a multiple of the
+ * group width, and a cuckoo table needs a whole number of buckets.
+ *
+ * @param policy        The policy of the table.
+ * @param entries       The requested capacity, which is replaced by the
+ *                      actual capacity.
+ * @param mask          Set to the mask, or zero if there is none.
+ * @return              True if the capacity is too large, and false
+ *                      otherwise.
+ */
+static bool
+round_capacity(const he4_policy_t policy, size_t * entries, size_t * mask) {
+    *mask = 0;
+    if (policy & HE4_CUCKOO) {
+        if (*entries > SIZE_MAX - HE4_BUCKET_WAYS) {
+            DEBUG("Requested table size (%zu) is too large.", *entries);
+            return true;
+        }
+        *entries = (*entries + HE4_BUCKET_WAYS - 1) / HE4_BUCKET_WAYS *
+                   HE4_BUCKET_WAYS;
+    }
+    if (policy & (HE4_RANGE_MASK | STEP_POLICY)) {
+        size_t capacity = (policy & HE4_CONTROL_BYTES) ? GROUP_WIDTH : 1;
+        while (capacity < *entries) {
+            if (capacity > SIZE_MAX / 2) {
+                DEBUG("Requested table size (%zu) is too large.", *entries);
+                return true;
+            }
+            capacity <<= 1;
+        } // Find the next power of two.
+        *entries = capacity;
+        *mask = capacity - 1;
+    }
+#ifdef INDEX_BITS
+    if ((policy & HE4_RANGE_MULTIPLY) &&
+        ((uint64_t)*entries - 1) >> INDEX_BITS != 0) {
+#else
+    if ((policy & HE4_RANGE_MULTIPLY) &&
+        ((uint64_t)*entries - 1) >> 32 != 0) {
+#endif // INDEX_BITS
+        DEBUG("Requested table size (%zu) is too large for multiply-shift "
+              "reduction.", *entries);
+        return true;
+    }
+    return false;
+}
+
+size_t
+he4_policy_capacity(size_t entries, he4_policy_t policy) {
+    if (entries < HE4_MINIMUM_SIZE) return 0;
+    size_t mask = 0;
+    if (round_capacity(policy, &entries, &mask)) return 0;
+    return entries;
+}
+
+/**
+ * Choose a seed for the default hash of a new table.  Portable C has no
+ * source of randomness, so this mixes what varies from table to table and
+ * run to run: the address of the table, which the system may randomize, the
+ * address of the stack, a count of the seeds chosen, and the time.  The
+ * count is only kept where it can be updated atomically; without it, tables
+ * still differ by their addresses.
+ *
+ * @param table         The new table.
+ * @return              The seed.
+ */
+static uint64_t
+choose_seed(HE4 * table) {
+    uint64_t parts[4] = { (uint64_t)(uintptr_t)table, 0, 0, 0 };
+    parts[1] = (uint64_t)(uintptr_t)parts;
+#if defined(SEED_COUNT_ATOMIC)
+    static size_t chosen = 0;
+    parts[2] = __atomic_add_fetch(&chosen, 1, __ATOMIC_RELAXED);
+#elif defined(SEED_COUNT_C11)
+    static atomic_size_t chosen = 0;
+    parts[2] = atomic_fetch_add_explicit(&chosen, 1,
+                                         memory_order_relaxed) + 1;
+#endif
+#ifndef LACKS_TIME_H
+    parts[3] = (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32);
+#endif // LACKS_TIME_H
+    return XXH64(parts, sizeof(parts), 0);
+}
+
+HE4 *
+he4_new_policy(size_t entries, he4_policy_t policy,
+               he4_hash_t (* hash)(he4_key_t key, size_t klen),
+               int (* compare)(he4_key_t key1, size_t klen1, he4_key_t key2,
+                               size_t klen2),
+               void (* delete_key)(he4_key_t key),
+               void (* delete_entry)(he4_entry_t thing)) {
+    // Check arguments.
+    if (entries < HE4_MINIMUM_SIZE) {
+        DEBUG("Requested table size (%zu) is less than the minimum (%d).",
+              entries, HE4_MINIMUM_SIZE);
+        return NULL;
+    }
+#ifdef HE4_USER_HASH
+    if (hash == NULL) {
+        DEBUG("User must supply a hash function since a custom hash type is "
+              "defined.");
+        return NULL;
+    }
+#endif
+    if ((policy & HE4_ROBIN_HOOD) && (policy & HE4_CONTROL_BYTES)) {
+        DEBUG("Robin Hood tables cannot use control bytes.");
+        return NULL;
+    }
+    if ((policy & HE4_ROBIN_HOOD) && (policy & STEP_POLICY)) {
+        DEBUG("Robin Hood tables must use linear probing.");
+        return NULL;
+    }
+    if ((policy & HE4_HOPSCOTCH) &&
+        (policy & (HE4_ROBIN_HOOD | HE4_CONTROL_BYTES | STEP_POLICY))) {
+        DEBUG("Hopscotch tables cannot use Robin Hood insertion, control "
+              "bytes, or a probe step.");
+        return NULL;
+    }
+    if ((policy & HE4_CUCKOO) &&
+        (policy & (HE4_ROBIN_HOOD | HE4_HOPSCOTCH | HE4_CONTROL_BYTES |
+                   STEP_POLICY))) {
+        DEBUG("Cuckoo tables cannot use Robin Hood insertion, hopscotch "
+              "hashing, control bytes, or a probe step.");
+        return NULL;
+    }
+    if ((policy & STEP_POLICY) == STEP_POLICY) {
+        DEBUG("Only one probe step can be selected.");
+        return NULL;
+    }
+
+    size_t mask = 0;
+    if (round_capacity(policy, &entries, &mask)) return NULL;
+
+    // Allocate the table.
+    HE4 * table = HE4MALLOC(HE4, 1);
+    if (table == NULL) {
+        DEBUG("Unable to get memory for table structure.");
+        return NULL;
+    }
+
+    // Set the fields.
+    table->capacity = entries;
+    table->mask = mask;
+    table->compare = compare == NULL ? he4_compare : compare;
+#ifdef HE4_ENTRY_VALUE
+    table->delete_entry = delete_entry;
+#else
+    table->delete_entry = delete_entry == NULL ? he4_delete_entry : delete_entry;
+#endif // HE4_ENTRY_VALUE
+    table->delete_key = delete_key == NULL ? he4_delete_key : delete_key;
+    table->free = entries;
+    table->hash = hash == NULL ? he4_hash : hash;
+    table->seed = choose_seed(table);
+    table->flood_limit = 0;
+    table->flooded = false;
+    table->policy = policy;
+#ifndef HE4NOTOUCH
+    table->max_touch = 0;
+#endif // HE4NOTOUCH
+
+    // Allocate the key and entry arrays.
+    if (alloc_cells(table, entries)) {
+        DEBUG("Unable to get memory for the table.");
+        free_cells(table);
+        HE4FREE(table);
+        return NULL;
+    }
+
+    // Allocate the control bytes, if requested.  These start out zero, which
+    // marks every cell as empty.
+    table->ctrl = NULL;
+    table->meta = NULL;
+    table->probe_limit = 0;
+    table->stash = NULL;
+    table->stashed = 0;
+    table->deleted = 0;
+    table->deleted_ratio = HE4_DELETED_RATIO;
+    if (policy & HE4_CONTROL_BYTES) {
+        table->ctrl = ALLOC_ARRAY(table, uint8_t, entries + GROUP_WIDTH - 1);
+        if (table->ctrl == NULL) {
+            DEBUG("Unable to get memory for the control bytes.");
+            free_cells(table);
+            HE4FREE(table);
+            return NULL;
+        }
+    }
+
+    // Allocate the probe distances or hop bitmaps, if requested.  These start
+    // out zero, which marks every cell as empty.
+    if (policy & (HE4_ROBIN_HOOD | HE4_HOPSCOTCH)) {
+        table->meta = ALLOC_ARRAY(table, uint32_t, entries);
+        if (table->meta == NULL) {
+            DEBUG("Unable to get memory for the cell metadata.");
+            free_cells(table);
+            HE4FREE(table);
+            return NULL;
+        }
+    }
+
+    // Success.
+    return table;
+}
+
+void
+he4_delete(HE4 * table) {
+    if (table == NULL) {
+        DEBUG("Attempt to delete a NULL table.");
+        return;
+    }
+    if (table->old != NULL) he4_delete(table->old);
+
+    // Delete any remaining entries.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        empty_cell(table, index, true, true);
+    } // Delete any remaining entries.
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        if (table->stash[slot].klen == 0) continue;
+        if (table->stash[slot].key != NULL) {
+            table->delete_key(table->stash[slot].key);
+        }
+        discard_entry(table, table->stash[slot].entry);
+    } // Delete any stashed entries.
+    table->stashed = 0;
+    table->free = 0;
+
+    // Wipe the method table.
+    table->compare = NULL;
+    table->hash = NULL;
+    table->delete_key = NULL;
+    table->delete_entry = NULL;
+
+    // Delete the internal arrays.
+    free_cells(table);
+    FREE_ARRAY(table, table->ctrl, table->capacity + GROUP_WIDTH - 1);
+    FREE_ARRAY(table, table->meta, table->capacity);
+    HE4FREE(table->stash);
+    table->stash = NULL;
+    table->capacity = 0;
+    HE4FREE(table);
+}
+
+bool
+he4_set_deleted_ratio(HE4 * table, double ratio) {
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (!(ratio >= 0.0 && ratio <= 1.0)) {
+        DEBUG("Deleted cell ratio (%g) must be from zero to one.", ratio);
+        return true;
+    }
+    table->deleted_ratio = ratio;
+    return false;
+}
+
+bool
+he4_set_probe_limit(HE4 * table, size_t limit) {
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (table->policy & (HE4_ROBIN_HOOD | HE4_HOPSCOTCH | HE4_CUCKOO)) {
+        DEBUG("Robin Hood, hopscotch, and cuckoo tables cannot take a probe "
+              "limit.");
+        return true;
+    }
+    if (he4_size(table) != 0) {
+        DEBUG("The probe limit can only be changed for an empty table.");
+        return true;
+    }
+    if (limit >= table->capacity) limit = 0;
+    if (limit != 0 && table->stash == NULL) {
+        table->stash = HE4MALLOC(he4_map_t, HE4_STASH_SIZE);
+        if (table->stash == NULL) {
+            DEBUG("Unable to get memory for the stash.");
+            return true;
+        }
+    }
+    table->probe_limit = limit;
+    return false;
+}
+
+/**
+ * Determine if the entries of a table can be migrated to new arrays a few
+ * at a time.  This is not so for hopscotch and cuckoo tables, or tables
+ * with a probe limit, since placing an entry in them can fail.  See
+ * `he4_rehash_begin`.
+ *
+ * @param table         The table.
+ * @return              True if the table can migrate, and false if not.
+ */
+static inline bool
+can_migrate(HE4 * table) {
+    if ((table->policy & (HE4_HOPSCOTCH | HE4_CUCKOO)) ||
+        table->probe_limit != 0) {
+        DEBUG("Hopscotch and cuckoo tables, and tables with a probe limit, "
+              "cannot be rehashed incrementally.");
+        return false;
+    }
+    return true;
+}
+
+bool
+he4_set_auto_resize(HE4 * table, double low, double high,
+                    size_t max_bytes) {
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (high == 0.0) {
+        table->high_load = 0.0;
+        return false;
+    }
+    if (!can_migrate(table)) return true;
+    if (!(high > 0.0 && high < 1.0 && low >= 0.0 && 2.0 * low < high)) {
+        DEBUG("Load marks (%g, %g) must have 0 <= 2 * low < high < 1.",
+              low, high);
+        return true;
+    }
+    if (max_bytes != 0 && max_bytes <= sizeof(HE4)) {
+        DEBUG("Memory limit (%zu) is too small.", max_bytes);
+        return true;
+    }
+    table->low_load = low;
+    table->high_load = high;
+    table->max_cells = max_bytes == 0 ? 0 : he4_best_capacity(max_bytes);
+    return false;
+}
+
+//======================================================================
+// Table data.
+//======================================================================
+
+size_t
+he4_size(HE4 * table) {
+    if (table == NULL) return 0;
+    return table->capacity - table->free + table->stashed +
+           he4_size(table->old);
+}
+
+size_t
+he4_capacity(HE4 * table) {
+    return table == NULL ? 0 : table->capacity;
+}
+
+double
+he4_load(HE4 * table) {
+    if (table == NULL) return 1.0;
+    return (double)he4_size(table) / (double)(table->capacity);
+}
+
+size_t
+he4_deleted(HE4 * table) {
+    return table == NULL ? 0 : table->deleted;
+}
+
+uint64_t
+he4_seed(HE4 * table) {
+    return table == NULL ? 0 : table->seed;
+}
+
+#ifndef HE4NOTOUCH
+size_t
+he4_max_touch(HE4 * table) {
+    return table == NULL ? 0 : table->max_touch;
+}
+#endif // HE4NOTOUCH
+
+//======================================================================
+// Table insertion / deletion functions.
+//======================================================================
+
+/**
+ * Search for a place to insert a key using the control bytes.  See
+ * `insert_cell`.
+ *
+ * @param table         The hash table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param open          Set to the index of the first open cell, or to
+ *                      `NOT_FOUND` if there is none.
+ * @return              The index of the cell holding the key, or `NOT_FOUND`.
+ */
+static inline size_t
+insert_group(HE4 * table, const he4_key_t key, const size_t klen,
+             const he4_hash_t hash, size_t * open) {
+    const uint8_t fp = fingerprint(hash);
+    probe_t probe;
+    probe_start(table, hash, &probe);
+    *open = NOT_FOUND;
+    const size_t limit = probe_limit(table);
+    for (size_t seen = 0; seen < limit; seen += GROUP_WIDTH) {
+        size_t index = probe.base;
+        group_t group = group_load(table->ctrl + index);
+        size_t count = limit - seen;
+        group_mask_t valid = count < GROUP_WIDTH ?
+                             ((group_mask_t)1 << count) - 1 : GROUP_ALL;
+        group_mask_t empty = group_match(group, CTRL_EMPTY) & valid;
+        if (*open == NOT_FOUND) {
+            group_mask_t free = (empty | group_match(group, CTRL_DELETED)) &
+                                valid;
+            if (free != 0) *open = wrap_add(table, index, lowest_bit(free));
+        }
+        group_mask_t hits = group_match(group, fp) & valid &
+                            below_lowest(empty);
+        while (hits != 0) {
+            size_t cell = wrap_add(table, index, lowest_bit(hits));
+            if (matches(table, cell, key, klen, hash)) return cell;
+            hits &= hits - 1;
+        } // Check every fingerprint match.
+        if (empty != 0) {
+            note_probe(table, seen + lowest_bit(empty));
+            return NOT_FOUND;
+        }
+        probe_next_group(table, &probe);
+    } // Search the groups.
+    note_probe(table, limit);
+    return NOT_FOUND;
+}
+
+/**
+ * Insert the given entry into a Robin Hood table.  See `insert_cell`.
+ */
+static inline bool
+rh_insert(HE4 * table, const he4_key_t key, const size_t klen,
+          const he4_entry_t entry, const he4_hash_t hash,
+          const bool overwrite, const size_t touch_index) {
+    size_t index = rh_find(table, key, klen, hash, false);
+    if (index != NOT_FOUND) {
+        // Found the key.  Replace the entry.
+        discard_entry(table, ENTRY(table, index));
+        ENTRY(table, index) = entry;
+#ifndef HE4NOTOUCH
+        TOUCH(table, index) = touch_index;
+#endif // HE4NOTOUCH
+        return false;
+    }
+    bool overwritten = false;
+    if (table->free == 0) {
+        if (!overwrite) return true;
+        // Discard the least-recently-used entry to make room.
+        rh_erase(table, lru_cell(table, hash, table->capacity), true);
+        ++(table->free);
+        overwritten = true;
+    }
+    rh_place(table, make_map(table, key, klen, entry, hash, touch_index));
+    --(table->free);
+    return overwritten;
+}
+
+/**
+ * Insert the given entry into a hopscotch table.  See `insert_cell`.
+ */
+static inline bool
+hop_insert(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_entry_t entry, const he4_hash_t hash,
+           const bool overwrite, const size_t touch_index) {
+    size_t index = hop_find(table, key, klen, hash, false);
+    if (index != NOT_FOUND) {
+        // Found the key.  Replace the entry.
+        discard_entry(table, ENTRY(table, index));
+        ENTRY(table, index) = entry;
+#ifndef HE4NOTOUCH
+        TOUCH(table, index) = touch_index;
+#endif // HE4NOTOUCH
+        return false;
+    }
+    he4_map_t cell = make_map(table, key, klen, entry, hash, touch_index);
+    if (table->free != 0 && !hop_place(table, cell)) {
+        --(table->free);
+        return false;
+    }
+    if (!overwrite) return true;
+
+    // There is no empty cell in the neighborhood, and none can be moved
+    // into it.  Discard the least-recently-used entry there to make room.
+    hop_erase(table, hop_lru(table, hash), true);
+    hop_place(table, cell);
+    return true;
+}
+
+/**
+ * Insert the given entry into a cuckoo table.  See `insert_cell`.
+ */
+static inline bool
+cuckoo_insert(HE4 * table, const he4_key_t key, const size_t klen,
+              const he4_entry_t entry, const he4_hash_t hash,
+              const bool overwrite, const size_t touch_index) {
+    size_t index = cuckoo_find(table, key, klen, hash, false);
+    if (index != NOT_FOUND) {
+        // Found the key.  Replace the entry.
+        discard_entry(table, ENTRY(table, index));
+        ENTRY(table, index) = entry;
+#ifndef HE4NOTOUCH
+        TOUCH(table, index) = touch_index;
+#endif // HE4NOTOUCH
+        return false;
+    }
+    bool overwritten = false;
+    index = table->free == 0 ? NOT_FOUND : cuckoo_make_room(table, hash);
+    if (index == NOT_FOUND) {
+        if (!overwrite) return true;
+        // Discard the least-recently-used entry in the buckets.
+        index = cuckoo_lru(table, hash);
+        empty_cell(table, index, true, true);
+        ++(table->free);
+        overwritten = true;
+    }
+    fill_cell(table, index, key, klen, entry, hash, touch_index);
+    --(table->free);
+    return overwritten;
+}
+
+/**
+ * Search a table that probes for a key, and for the first open cell where
+ * the key could be inserted.  The key might be present past a deleted cell,
+ * so the search continues until it hits an empty cell.  If the key is not in
+ * the table, it might be in the stash.  First the deleted cells are cleared
+ * out, if there are too many.  This is done here rather than on removal
+ * (see `he4_index`).
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param open          Set to the index of the first open cell, or to
+ *                      `NOT_FOUND` if there is none within the probe limit.
+ * @return              The index of the cell holding the key, the capacity
+ *                      plus the stash index of the key, or `NOT_FOUND`.
+ */
+static inline size_t
+find_slot(HE4 * table, const he4_key_t key, const size_t klen,
+          const he4_hash_t hash, size_t * open) {
+    check_deleted(table);
+    *open = NOT_FOUND;
+    size_t index = NOT_FOUND;
+    if (table->ctrl != NULL) {
+        index = insert_group(table, key, klen, hash, open);
+    } else {
+        probe_t probe;
+        probe_start(table, hash, &probe);
+        const size_t limit = probe_limit(table);
+        size_t count = 0;
+        for (; count < limit; ++count) {
+            if (is_open(table, probe.index)) {
+                if (*open == NOT_FOUND) *open = probe.index;
+                if (is_empty(table, probe.index)) break;
+            } else if (matches(table, probe.index, key, klen, hash)) {
+                index = probe.index;
+                break;
+            }
+            probe_next(table, &probe);
+        } // Search the cells.
+        if (index == NOT_FOUND) note_probe(table, count);
+    }
+    if (index == NOT_FOUND && table->stashed != 0) {
+        index = stash_find(table, key, klen, hash, false);
+    }
+    return index;
+}
+
+/**
+ * Set the touch index of a cell or stash entry, if touch index is enabled.
+ *
+ * @param table         The table.
+ * @param index         The index of the cell, or the capacity plus the stash
+ *                      index.
+ * @param touch_index   The touch index.
+ */
+static inline void
+set_touch(HE4 * table, const size_t index, const size_t touch_index) {
+#ifndef HE4NOTOUCH
+    if (index >= table->capacity) {
+        table->stash[index - table->capacity].touch = touch_index;
+    } else {
+        TOUCH(table, index) = touch_index;
+    }
+#else
+    (void)table;
+    (void)index;
+    (void)touch_index;
+#endif // HE4NOTOUCH
+}
 
 /**
  * Insert the given entry into the hash table.  If the table is full then the
  * least-recently-used item may be overwritten (see the flag).
  *
  * If either the table, key, or entry is equal to `NULL`, or if the key length
- * is 0, then nothing is done and `true` is returned.
+ * is 0, then nothing is done and `true` is returned.  If `HE4_ENTRY_VALUE`
+ * is defined then the entry is not checked.
+ *
+ * @param table         The hash table to get the new entry.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param entry         The entry to insert.
+ * @param hash          The hash of the key.  Rehashing passes the stored
+ *                      hash, so keys are not hashed again.
+ * @param overwrite     If true, force insertion by overwriting.  If false,
+ *                      do not.
+ * @param touch_index   The touch index value to use for the newly-inserted
+ *                      item, if touch index is enabled.
+ * @return              False if the entry was successfully inserted without
+ *                      overwriting another entry, and true if another entry was
+ *                      overwritten or insertion failed, depending on the
+ *                      overwrite flag.
+ */
+static inline bool
+insert_cell(HE4 * table, const he4_key_t key, const size_t klen,
+            const he4_entry_t entry, const he4_hash_t hash,
+            const bool overwrite, const size_t touch_index) {
+    if (table->old != NULL) prepare_insert(table, key, klen, hash);
+    if (table->policy & HE4_ROBIN_HOOD) {
+        return rh_insert(table, key, klen, entry, hash, overwrite,
+                         touch_index);
+    }
+    if (table->policy & HE4_HOPSCOTCH) {
+        return hop_insert(table, key, klen, entry, hash, overwrite,
+                          touch_index);
+    }
+    if (table->policy & HE4_CUCKOO) {
+        return cuckoo_insert(table, key, klen, entry, hash, overwrite,
+                             touch_index);
+    }
+
+    // Look for the key, remembering the first open slot.
+    size_t open = NOT_FOUND;
+    size_t index = find_slot(table, key, klen, hash, &open);
+    if (index != NOT_FOUND) {
+        // Found the key.  Replace the entry.
+        he4_entry_t * pentry = entry_at(table, index);
+        discard_entry(table, *pentry);
+        *pentry = entry;
+        set_touch(table, index, touch_index);
+        return false;
+    }
+    if (open != NOT_FOUND) {
+        // Found the place to insert.
+        if (is_deleted(table, open)) --(table->deleted);
+        fill_cell(table, open, key, klen, entry, hash, touch_index);
+        --(table->free);
+        return false;
+    }
+    if (table->probe_limit != 0 && table->stashed < HE4_STASH_SIZE) {
+        // There is no open cell within the probe limit, so use the stash.
+        table->stash[(table->stashed)++] = make_map(table, key, klen, entry,
+                                                   hash, touch_index);
+        return false;
+    }
+    if (!overwrite) return true;
+
+    // We did not find an open slot, and we did not find a match.  Force
+    // overwrite of the least-recently-used entry (if enabled), or of the
+    // first entry (if not enabled).
+    index = lru_cell(table, hash, probe_limit(table));
+    if (KEY(table, index) != NULL) table->delete_key(KEY(table, index));
+    discard_entry(table, ENTRY(table, index));
+    fill_cell(table, index, key, klen, entry, hash, touch_index);
+    return true;
+}
+
+/**
+ * Check the arguments common to every operation on a key.
  *
- * @param table         The hash table to get the new entry.
+ * @param table         The table.
  * @param key           The key.
  * @param klen          Length in bytes of key.
- * @param entry         The entry to insert.
- * @param overwrite     If true, force insertion by overwriting.  If false,
- *                      do not.
- * @param touch_index   The touch index value to use for the newly-inserted
- *                      item, if touch index is enabled.
- * @return              False if the entry was successfully inserted without
- *                      overwriting another entry, and true if another entry was
- *                      overwritten or insertion failed, depending on the
- *                      overwrite flag.
+ * @return              True if any argument is bad, and false if not.
  */
 static inline bool
-insert_cell(HE4 * table, const he4_key_t key, const size_t klen,
-            const he4_entry_t entry, const bool overwrite,
-            const size_t touch_index) {
-    // Hash the key, then wrap to table size.
-    he4_hash_t hash = table->hash(key, klen);
-    size_t start = hash % table->capacity;
-    size_t index = start;
-    size_t lru = SIZE_MAX;
-    size_t lru_index = start;
-
-    // Insert at first open slot, or overwrite a match.
-    do {
-        if (is_open(table, index)) {
-            // Found the place to insert.
-            table->maps[index].key = key;
-            table->maps[index].klen = klen;
-            table->maps[index].hash = hash;
-            table->maps[index].entry = entry;
+bad_key(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (key == NULL) {
+        DEBUG("Key is NULL.");
+        return true;
+    }
+    if (klen == 0) {
+        DEBUG("Key length is 0.");
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Start an incremental rehash if the load of the table has left the range
+ * set by `he4_set_auto_resize`.
+ *
+ * @param table         The table.
+ */
+static inline void
+auto_resize(HE4 * table) {
+    if (table->high_load == 0.0 || table->old != NULL) return;
+    double load = he4_load(table);
+    size_t capacity = 0;
+    if (load > table->high_load) {
+        if (table->capacity > SIZE_MAX / 2) return;
+        capacity = table->capacity * 2;
+    } else if (load < table->low_load &&
+               table->capacity / 2 >= HE4_MINIMUM_SIZE) {
+        capacity = table->capacity / 2;
+    } else {
+        return;
+    }
+    size_t mask = 0;
+    if (round_capacity(table->policy, &capacity, &mask)) return;
+    if (table->max_cells != 0 &&
+        (table->max_cells < table->capacity ||
+         capacity > table->max_cells - table->capacity)) {
+        DEBUG("Resizing would exceed the memory limit; nothing done.");
+        return;
+    }
+    he4_rehash_begin(table, capacity);
+}
+
+// Rebuild a flooded table.  This is defined with the rehash functions.
+static void check_flood(HE4 * table);
+
+he4_hash_t
+he4_hash_key(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (bad_key(table, key, klen)) return 0;
+    check_flood(table);
+    return key_hash(table, key, klen);
+}
+
+bool
+he4_insert(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_entry_t entry) {
+    if (bad_key(table, key, klen)) return true;
+    check_flood(table);
+    return he4_insert_hashed(table, key, klen, entry,
+                             key_hash(table, key, klen));
+}
+
+bool
+he4_insert_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                  const he4_entry_t entry, const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return true;
+    if (klen >= KLEN_LIMIT) {
+        DEBUG("Key length (%zu) is too large.", klen);
+        return true;
+    }
+#ifndef HE4_ENTRY_VALUE
+    if (entry == NULL) {
+        DEBUG("Entry is NULL.");
+        return true;
+    }
+#endif // HE4_ENTRY_VALUE
+
+    // Find an open space to insert the entry.
+#ifndef HE4NOTOUCH
+    touch_room(table);
+    if (insert_cell(table, key, klen, entry, hash, false,
+                    table->max_touch + 1)) {
+        // Nothing was inserted, so just return true.
+        return true;
+    }
+    // An insertion was done, so bump the max touch index.
+    ++table->max_touch;
+    auto_resize(table);
+    return false;
+#else
+    if (insert_cell(table, key, klen, entry, hash, false, 0)) return true;
+    auto_resize(table);
+    return false;
+#endif // HE4NOTOUCH
+}
+
+bool
+he4_force_insert(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_entry_t entry) {
+    if (bad_key(table, key, klen)) return true;
+    check_flood(table);
+    return he4_force_insert_hashed(table, key, klen, entry,
+                                   key_hash(table, key, klen));
+}
+
+bool
+he4_force_insert_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                        const he4_entry_t entry, const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return true;
+    if (klen >= KLEN_LIMIT) {
+        DEBUG("Key length (%zu) is too large.", klen);
+        return true;
+    }
+#ifndef HE4_ENTRY_VALUE
+    if (entry == NULL) {
+        DEBUG("Entry is NULL.");
+        return true;
+    }
+#endif // HE4_ENTRY_VALUE
+
+    // Force insertion of the entry.
 #ifndef HE4NOTOUCH
-            table->maps[index].touch = touch_index;
+    touch_room(table);
+    ++table->max_touch;
+    bool overwritten = insert_cell(table, key, klen, entry, hash, true,
+                                   table->max_touch);
+#else
+    bool overwritten = insert_cell(table, key, klen, entry, hash, true, 0);
 #endif // HE4NOTOUCH
-            --(table->free);
-            return false;
-        }
-        if (table->maps[index].hash == hash &&
-            table->compare(table->maps[index].key, table->maps[index].klen,
-                           key, klen) == 0) {
-            // Found the key.  Replace the entry.
-            table->delete_entry(table->maps[index].entry);
-            table->maps[index].entry = entry;
+    auto_resize(table);
+    return overwritten;
+}
+
+/**
+ * Find the cell holding a key, or claim one for it with an empty entry.  See
+ * `he4_find_or_insert`.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param touch_index   The touch index to give the entry, if touch index is
+ *                      enabled.
+ * @param inserted      Set to true if the key was inserted.
+ * @return              The index of the cell holding the key, the capacity
+ *                      plus the stash index of the key, or `NOT_FOUND` if
+ *                      there was no room for it.
+ */
+static inline size_t
+claim_cell(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_hash_t hash, const size_t touch_index, bool * inserted) {
+    if (table->old != NULL) prepare_insert(table, key, klen, hash);
+    *inserted = false;
+
+    // Look for the key.  A table that probes also finds where to put it.
+    size_t open = NOT_FOUND;
+    size_t index = (table->policy &
+                    (HE4_ROBIN_HOOD | HE4_HOPSCOTCH | HE4_CUCKOO)) ?
+                   find_cell(table, key, klen, hash, false) :
+                   find_slot(table, key, klen, hash, &open);
+    if (index != NOT_FOUND) {
+        set_touch(table, index, touch_index);
+        return index;
+    }
+
+    // Insert the key.
+    he4_map_t map = make_map(table, key, klen, NO_ENTRY, hash, touch_index);
+    if (table->free == 0 && table->probe_limit == 0) return NOT_FOUND;
+    if (table->policy & HE4_ROBIN_HOOD) {
+        index = rh_place(table, map);
+    } else if (table->policy & HE4_HOPSCOTCH) {
+        if (hop_place(table, map)) return NOT_FOUND;
+        index = hop_find(table, key, klen, hash, false);
+    } else if (table->policy & HE4_CUCKOO) {
+        index = cuckoo_make_room(table, hash);
+        if (index == NOT_FOUND) return NOT_FOUND;
+        put_cell(table, index, map);
+    } else if (open != NOT_FOUND) {
+        if (is_deleted(table, open)) --(table->deleted);
+        index = open;
+        put_cell(table, index, map);
+        set_ctrl(table, index, fingerprint(hash));
+    } else if (table->probe_limit != 0 && table->stashed < HE4_STASH_SIZE) {
+        // There is no open cell within the probe limit, so use the stash.
+        table->stash[table->stashed] = map;
+        *inserted = true;
+        return table->capacity + (table->stashed)++;
+    } else {
+        return NOT_FOUND;
+    }
+    --(table->free);
+    *inserted = true;
+    return index;
+}
+
+he4_entry_t *
+he4_find_or_insert(HE4 * table, const he4_key_t key, const size_t klen,
+                   bool * inserted) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return NULL;
+    if (klen >= KLEN_LIMIT) {
+        DEBUG("Key length (%zu) is too large.", klen);
+        return NULL;
+    }
+
+    // Resize before rather than after the insertion, so that the pointer
+    // returned stays good.
+    check_flood(table);
+    auto_resize(table);
+
+    // Find or insert the key.
+    bool fresh = false;
 #ifndef HE4NOTOUCH
-            table->maps[index].touch = touch_index;
+    touch_room(table);
+    size_t index = claim_cell(table, key, klen, key_hash(table, key, klen),
+                              table->max_touch + 1, &fresh);
+    if (index == NOT_FOUND) return NULL;
+    ++table->max_touch;
+#else
+    size_t index = claim_cell(table, key, klen, key_hash(table, key, klen), 0,
+                              &fresh);
+    if (index == NOT_FOUND) return NULL;
 #endif // HE4NOTOUCH
+    if (inserted != NULL) *inserted = fresh;
+    return entry_at(table, index);
+}
+
+bool
+he4_set_key(HE4 * table, he4_entry_t * entry, const he4_key_t key) {
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (entry == NULL || key == NULL) {
+        DEBUG("Entry or key is NULL.");
+        return true;
+    }
+
+    // Work out which cell holds the entry.
+    uintptr_t at = (uintptr_t)entry;
+#ifndef HE4SOA
+    uintptr_t base = (uintptr_t)&table->maps[0].entry;
+    size_t stride = sizeof(he4_cell_t);
+#else
+    uintptr_t base = (uintptr_t)table->entries;
+    size_t stride = sizeof(he4_entry_t);
+#endif // HE4SOA
+    if (at >= base && (at - base) % stride == 0 &&
+        (at - base) / stride < table->capacity) {
+        // A key stored inline is already the table's own copy.
+        size_t index = (at - base) / stride;
+        if (!is_inline(table, KLEN(table, index))) KEY(table, index) = key;
+        return false;
+    }
+    if (table->stashed != 0) {
+        base = (uintptr_t)&table->stash[0].entry;
+        stride = sizeof(he4_map_t);
+        if (at >= base && (at - base) % stride == 0 &&
+            (at - base) / stride < table->stashed) {
+            he4_map_t * map = table->stash + (at - base) / stride;
+            if (!is_inline(table, map->klen)) map->key = key;
             return false;
         }
-#ifndef HE4NOTOUCH
-        if (table->maps[index].touch < lru) {
-            lru = table->maps[index].touch;
-            lru_index = index;
+    }
+    DEBUG("Entry is not in the table.");
+    return true;
+}
+
+/**
+ * Remove a key from a table.  See `he4_remove` and `he4_discard`.
+ *
+ * @param table         The table.
+ * @param key           The key.
+ * @param klen          Length in bytes of key.
+ * @param hash          The hash of the key.
+ * @param entry         Receives the entry removed, which the caller then
+ *                      owns.  If `NULL`, then the entry is freed instead.
+ * @return              False if the key was removed, and true if it was not
+ *                      found.
+ */
+static inline bool
+remove_key(HE4 * table, const he4_key_t key, const size_t klen,
+           const he4_hash_t hash, he4_entry_t * entry) {
+    // Find the corresponding entry.
+    size_t index = search_cell(table, key, klen, hash, false);
+    if (index == NOT_FOUND) return true;
+
+    // Found the entry.  Remove it, and mark the cell as deleted.
+    const bool free_entry = entry == NULL;
+    if (!free_entry) *entry = *entry_at(table, index);
+    if (index >= table->capacity) {
+        stash_remove(table, index - table->capacity, free_entry);
+    } else {
+        remove_cell(table, index, free_entry);
+        ++(table->free);
+    }
+    // The table is not resized here, even if the load has dropped below the
+    // low mark (see `he4_index`).  The next insertion shrinks it.
+    return false;
+}
+
+he4_entry_t
+he4_remove(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (bad_key(table, key, klen)) return NO_ENTRY;
+    return he4_remove_hashed(table, key, klen, key_hash(table, key, klen));
+}
+
+he4_entry_t
+he4_remove_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                  const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return NO_ENTRY;
+
+    he4_entry_t entry = NO_ENTRY;
+    remove_key(table, key, klen, hash, &entry);
+    return entry;
+}
+
+bool
+he4_discard(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (bad_key(table, key, klen)) return true;
+    return he4_discard_hashed(table, key, klen, key_hash(table, key, klen));
+}
+
+bool
+he4_discard_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                   const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return true;
+
+    return remove_key(table, key, klen, hash, NULL);
+}
+
+he4_entry_t
+he4_get(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (bad_key(table, key, klen)) return NO_ENTRY;
+    return he4_get_hashed(table, key, klen, key_hash(table, key, klen));
+}
+
+he4_entry_t
+he4_get_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+               const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return NO_ENTRY;
+
+    // Find the corresponding entry.
+    size_t index = search_cell(table, key, klen, hash, true);
+    if (index == NOT_FOUND) return NO_ENTRY;
+    return *entry_at(table, index);
+}
+
+//======================================================================
+// Batched lookup.
+//======================================================================
+
+/**
+ * Ask the processor to start loading the memory at an address, without
+ * waiting for it.  Compilers without the builtin do nothing.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#  define PREFETCH(m_address) __builtin_prefetch((m_address), 0, 3)
+#else
+#  define PREFETCH(m_address) ((void)(m_address))
+#endif
+
+/**
+ * Prefetch the memory a search for a hash reads first: the home cell, with
+ * its control byte or probe metadata, or both buckets of a cuckoo table.
+ *
+ * @param table         The table.
+ * @param hash          The hash.
+ */
+static inline void
+prefetch_home(HE4 * table, const he4_hash_t hash) {
+    size_t bucket[2];
+    size_t count = 1;
+    if (table->policy & HE4_CUCKOO) {
+        cuckoo_buckets(table, hash, bucket);
+        count = 2;
+    } else {
+        bucket[0] = home_cell(table, hash);
+    }
+    for (size_t which = 0; which < count; ++which) {
+        size_t index = bucket[which];
+        if (table->ctrl != NULL) PREFETCH(table->ctrl + index);
+        if (table->meta != NULL) PREFETCH(table->meta + index);
+#ifndef HE4SOA
+        PREFETCH(table->maps + index);
+#else
+        PREFETCH(table->klens + index);
+        PREFETCH(table->hashes + index);
+#endif // HE4SOA
+    } // Prefetch each bucket.
+}
+
+size_t
+he4_get_many(HE4 * table, const he4_key_t keys[], const size_t klens[],
+             const size_t count, he4_entry_t out[]) {
+    // Check arguments.
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return 0;
+    }
+    if (keys == NULL || klens == NULL || out == NULL) {
+        DEBUG("Keys, lengths, or output is NULL.");
+        return 0;
+    }
+
+    // Work through the keys a batch at a time.  Every key of a batch is
+    // hashed and its home cell prefetched before any is searched, so the
+    // cache misses of the batch overlap instead of following one another.
+    size_t found = 0;
+    he4_hash_t hashes[HE4_BATCH];
+    for (size_t first = 0; first < count; first += HE4_BATCH) {
+        size_t batch = count - first < HE4_BATCH ? count - first : HE4_BATCH;
+        hash_keys(table, keys + first, klens + first, batch, hashes);
+        for (size_t which = 0; which < batch; ++which) {
+            prefetch_home(table, hashes[which]);
+        } // Prefetch.
+        for (size_t which = 0; which < batch; ++which) {
+            const size_t at = first + which;
+            out[at] = NO_ENTRY;
+            if (keys[at] == NULL || klens[at] == 0) continue;
+            size_t index = search_cell(table, keys[at], klens[at],
+                                       hashes[which], true);
+            if (index == NOT_FOUND) continue;
+            out[at] = *entry_at(table, index);
+            ++found;
+        } // Search.
+    } // Search every batch.
+    return found;
+}
+
+/**
+ * An operation of a batch, in the order it is applied.
+ */
+typedef struct {
+    size_t op;              ///< Index of the operation in the batch.
+    size_t home;            ///< Home cell of the key, when hashed.
+    he4_hash_t hash;        ///< Hash of the key.
+} pending_t;
+
+/**
+ * Apply one operation of a batch, given the hash of its key.
+ *
+ * @param table         The table.
+ * @param op            The operation.
+ * @param hash          The hash of the key.
+ */
+static inline void
+apply_op(HE4 * table, he4_op_t * op, const he4_hash_t hash) {
+    switch (op->kind) {
+        case HE4_OP_INSERT:
+            op->result = he4_insert_hashed(table, op->key, op->klen,
+                                           op->entry, hash);
+            break;
+        case HE4_OP_FORCE_INSERT:
+            op->result = he4_force_insert_hashed(table, op->key, op->klen,
+                                                 op->entry, hash);
+            break;
+        case HE4_OP_REMOVE:
+            op->entry = NO_ENTRY;
+            op->result = remove_key(table, op->key, op->klen, hash,
+                                    &op->entry);
+            break;
+        case HE4_OP_DISCARD:
+            op->result = remove_key(table, op->key, op->klen, hash, NULL);
+            break;
+        default:
+            DEBUG("Unknown operation (%u).", (unsigned)op->kind);
+            op->result = true;
+            break;
+    }
+}
+
+bool
+he4_apply_batch(HE4 * table, he4_op_t ops[], const size_t count) {
+    // Check arguments.
+    if (table == NULL) {
+        DEBUG("Table is NULL.");
+        return true;
+    }
+    if (ops == NULL) {
+        DEBUG("Operations are NULL.");
+        return true;
+    }
+    if (count == 0) return false;
+    check_flood(table);
+
+    // Hash every key, and find its home cell.
+    pending_t * pending = HE4MALLOC(pending_t, 2 * count);
+    size_t * starts = HE4MALLOC(size_t, count + 1);
+    if (pending == NULL || starts == NULL) {
+        // Apply the operations in order, hashing as we go.
+        DEBUG("Unable to get memory to sort the batch; applying in order.");
+        HE4FREE(pending);
+        HE4FREE(starts);
+        for (size_t op = 0; op < count; ++op) {
+            if (bad_key(table, ops[op].key, ops[op].klen)) {
+                ops[op].result = true;
+                continue;
+            }
+            apply_op(table, ops + op,
+                     key_hash(table, ops[op].key, ops[op].klen));
+        } // Apply every operation.
+        return false;
+    }
+    for (size_t first = 0; first < count; first += HE4_BATCH) {
+        size_t batch = count - first < HE4_BATCH ? count - first : HE4_BATCH;
+        he4_key_t keys[HE4_BATCH];
+        size_t klens[HE4_BATCH];
+        he4_hash_t hashes[HE4_BATCH];
+        for (size_t which = 0; which < batch; ++which) {
+            keys[which] = ops[first + which].key;
+            klens[which] = ops[first + which].klen;
+        } // Collect the keys.
+        hash_keys(table, keys, klens, batch, hashes);
+        for (size_t which = 0; which < batch; ++which) {
+            pending_t * item = pending + first + which;
+            item->op = first + which;
+            item->hash = hashes[which];
+            item->home = home_cell(table, hashes[which]);
+        } // Find the home cells.
+    } // Hash the keys.
+
+    // Sort the operations by home cell, into as many ranges of cells as
+    // there are operations.  A counting sort is stable, so operations on
+    // the same key keep their order.
+    const size_t span = table->capacity / count + 1;
+    for (size_t op = 0; op < count; ++op) {
+        ++starts[pending[op].home / span + 1];
+    } // Count the operations in each range.
+    for (size_t range = 1; range <= count; ++range) {
+        starts[range] += starts[range - 1];
+    } // Find where each range starts.
+    pending_t * sorted = pending + count;
+    for (size_t op = 0; op < count; ++op) {
+        sorted[starts[pending[op].home / span]++] = pending[op];
+    } // Sort the operations.
+    HE4FREE(starts);
+
+    // Apply the operations in order of their home cells, prefetching the
+    // home cells of those a batch ahead.
+    for (size_t at = 0; at < count && at < HE4_BATCH; ++at) {
+        prefetch_home(table, sorted[at].hash);
+    } // Prefetch the first batch.
+    for (size_t at = 0; at < count; ++at) {
+        if (at + HE4_BATCH < count) {
+            prefetch_home(table, sorted[at + HE4_BATCH].hash);
         }
-#endif // HE4NOTOUCH
-        index = (index + 1) % table->capacity;
-    } while (start != index);
-    if (!overwrite) return true;
+        he4_op_t * op = ops + sorted[at].op;
+        if (bad_key(table, op->key, op->klen)) {
+            op->result = true;
+            continue;
+        }
+        apply_op(table, op, sorted[at].hash);
+    } // Apply every operation.
+    HE4FREE(pending);
+    return false;
+}
+
+//======================================================================
+// Direct access.
+//======================================================================
+
+he4_entry_t *
+he4_find(HE4 * table, const he4_key_t key, const size_t klen) {
+    if (bad_key(table, key, klen)) return NULL;
+    return he4_find_hashed(table, key, klen, key_hash(table, key, klen));
+}
+
+he4_entry_t *
+he4_find_hashed(HE4 * table, const he4_key_t key, const size_t klen,
+                const he4_hash_t hash) {
+    // Check arguments.
+    if (bad_key(table, key, klen)) return NULL;
+
+    // Find the corresponding entry.
+    size_t index = search_cell(table, key, klen, hash, true);
+    if (index == NOT_FOUND) return NULL;
+    return entry_at(table, index);
+}
+
+//======================================================================
+// Random access.
+//======================================================================
+
+he4_map_t *
+he4_index(HE4 * table, const size_t index) {
+    if (table == NULL) return NULL;
+    he4_rehash_step(table, SIZE_MAX);
+    if (index >= table->capacity + table->stashed) return NULL;
+    he4_map_t * map = HE4MALLOC(he4_map_t, 1);
+    if (map == NULL) return NULL;
+    *map = index < table->capacity ? get_cell(table, index) :
+           table->stash[index - table->capacity];
+    // A key stored inline is returned as the copy in the mapping.
+    map->key = map_key(table, map);
+    return map;
+}
+
+//======================================================================
+// Rehash.
+//======================================================================
+
+/**
+ * Delete a table without deallocating any of its keys or entries, because
+ * they belong to another table.
+ *
+ * @param table         The table.
+ */
+static void
+forget_table(HE4 * table) {
+    for (size_t index = 0; index < table->capacity; ++index) {
+        put_cell(table, index, blank_cell);
+    } // Forget every cell.
+    table->stashed = 0;
+    he4_delete(table);
+}
 
-    // We did not find an open slot, and we did not find a match.  Force
-    // overwrite of the least-recently-used entry (if enabled), or of the
-    // first entry (if not enabled).
-#ifndef HE4NOTOUCH
-    index = lru_index;
-#endif // HE4NOTOUCH
-    table->delete_key(table->maps[index].key);
-    table->delete_entry(table->maps[index].entry);
-    table->maps[index].key = key;
-    table->maps[index].klen = klen;
-    table->maps[index].hash = hash;
-    table->maps[index].entry = entry;
-#ifndef HE4NOTOUCH
-    table->maps[index].touch = touch_index;
-#endif // HE4NOTOUCH
-    return true;
+/**
+ * Copy the settings of a table that are not part of its policy to the table
+ * that replaces it.
+ *
+ * @param to            The new table.
+ * @param from          The original table.
+ */
+static void
+copy_settings(HE4 * to, HE4 * from) {
+    to->deleted_ratio = from->deleted_ratio;
+    to->low_load = from->low_load;
+    to->high_load = from->high_load;
+    to->max_cells = from->max_cells;
+    to->seed = from->seed;
+    to->flood_limit = from->flood_limit;
 }
 
 bool
-he4_insert(HE4 * table, const he4_key_t key, const size_t klen,
-           const he4_entry_t entry) {
-    // Check arguments.
+he4_grow(HE4 * table, const size_t newsize) {
     if (table == NULL) {
-        DEBUG("Table is NULL.");
+        DEBUG("Attempt to grow a NULL table.");
         return true;
     }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
+    if (table->policy & HE4_ROBIN_HOOD) {
+        DEBUG("Robin Hood tables cannot grow in place; use he4_rehash.");
         return true;
     }
-    if (klen == 0) {
-        DEBUG("Key length is NULL.");
+    if (!can_migrate(table)) return true;
+    he4_rehash_step(table, SIZE_MAX);
+    if (newsize == 0 && table->capacity > SIZE_MAX / 2) {
+        DEBUG("Table is too large to double.");
         return true;
     }
-    if (entry == NULL) {
-        DEBUG("Entry is NULL.");
-        return true;
+    size_t capacity = newsize == 0 ? table->capacity * 2 : newsize;
+    size_t mask = 0;
+    if (round_capacity(table->policy, &capacity, &mask)) return true;
+    if (capacity <= table->capacity) {
+        DEBUG("New table capacity is too small; nothing done.");
+        return false;
     }
 
-    // Find an open space to insert the entry.
-#ifndef HE4NOTOUCH
-    if (insert_cell(table, key, klen, entry, false, table->max_touch+1)) {
-        // Nothing was inserted, so just return true.
+    // Extend the arrays.  The new cells are empty.
+    if (resize_cells(table, capacity)) {
+        DEBUG("Unable to get memory to grow the table.");
         return true;
     }
-    // An insertion was done, so bump the max touch index.
-    ++table->max_touch;
+    if (table->ctrl != NULL) {
+        // The old copies of the first control bytes are now ordinary cells.
+        memset(table->ctrl + table->capacity, CTRL_EMPTY, GROUP_WIDTH - 1);
+    }
+    table->free += capacity - table->capacity;
+    table->capacity = capacity;
+    table->mask = mask;
+
+    // Every entry now has a new probe sequence.  Compaction moves each to
+    // the first free cell of its sequence, using the stored hashes.
+    compact(table);
     return false;
-#else
-    return insert_cell(table, key, klen, entry, false, 0);
-#endif // HE4NOTOUCH
 }
 
-bool
-he4_force_insert(HE4 * table, const he4_key_t key, const size_t klen,
-           const he4_entry_t entry) {
-    // Check arguments.
-    if (table == NULL) {
-        DEBUG("Table is NULL.");
-        return true;
-    }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
-        return true;
-    }
-    if (klen == 0) {
-        DEBUG("Key length is 0.");
-        return true;
-    }
-    if (entry == NULL) {
-        DEBUG("Entry is NULL.");
+/**
+ * Give a table new, empty arrays, and keep the old ones as the table being
+ * migrated.  Any earlier migration must be finished.
+ *
+ * @param table         The table.
+ * @param capacity      The capacity of the new arrays.
+ * @return              False on success, and true if there is no memory.
+ */
+static bool
+begin_migration(HE4 * table, const size_t capacity) {
+    // Make the new arrays.
+    HE4 * fresh = he4_new_policy(capacity, table->policy, table->hash,
+                                 table->compare, table->delete_key,
+                                 table->delete_entry);
+    if (fresh == NULL) {
+        DEBUG("Unable to get memory for rehashed table.");
         return true;
     }
 
-    // Force insertion of the entry.
+    // Swap the two, so that the table keeps its address and the old arrays
+    // become the table being migrated.
+    HE4 swap = *table;
+    *table = *fresh;
+    *fresh = swap;
+    copy_settings(table, fresh);
 #ifndef HE4NOTOUCH
-    ++table->max_touch;
-    return insert_cell(table, key, klen, entry, true, table->max_touch);
-#else
-    return insert_cell(table, key, klen, entry, true, 0);
+    table->max_touch = fresh->max_touch;
 #endif // HE4NOTOUCH
+    table->old = fresh;
+    table->drained = 0;
+    return false;
 }
 
-he4_entry_t
-he4_remove(HE4 * table, const he4_key_t key, const size_t klen) {
-    // Check arguments.
-    if (table == NULL) {
-        DEBUG("Table is NULL.");
-        return (he4_entry_t)NULL;
-    }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
-        return (he4_entry_t)NULL;
+/**
+ * Rebuild a table with a new seed for the default hash.  Every key is hashed
+ * again with the new seed, and the entries are migrated to new arrays.
+ *
+ * @param table         The table, which must use the default hash.
+ * @param seed          The new seed.
+ * @return              False on success, and true if the table cannot be
+ *                      rebuilt.
+ */
+static bool
+reseed(HE4 * table, const uint64_t seed) {
+    he4_rehash_step(table, SIZE_MAX);
+    table->flooded = false;
+    if (he4_size(table) == 0) {
+        table->seed = seed;
+        return false;
     }
-    if (klen == 0) {
-        DEBUG("Key length is 0.");
-        return (he4_entry_t)NULL;
+    if (!can_migrate(table)) return true;
+    if (table->max_cells != 0 &&
+        (table->max_cells < table->capacity ||
+         table->capacity > table->max_cells - table->capacity)) {
+        DEBUG("Rebuilding would exceed the memory limit; nothing done.");
+        return true;
     }
+    if (begin_migration(table, table->capacity)) return true;
 
-    // Hash the key, then wrap to table size.
-    he4_hash_t hash = table->hash(key, klen);
-    size_t start = hash % table->capacity;
-    size_t index = start;
-
-    // Find the corresponding entry.  Stop if we wrap around, which can happen
-    // with a full table.
-    do {
-        // If we hit an empty cell, we can stop.
-        if (is_empty(table, index)) return (he4_entry_t)NULL;
-
-        // Skip deleted cells.
-        if (! is_deleted(table, index)) {
-            // Check the current slot.
-            if (table->maps[index].hash == hash &&
-                table->compare(key, klen, table->maps[index].key,
-                               table->maps[index].klen) == 0) {
-                // Found the entry.  Remove it and mark the cell as deleted.
-                he4_entry_t entry = table->maps[index].entry;
-                empty_cell(table, index, true, false);
-                table->maps[index].klen = 1;
-                ++(table->free);
-                return entry;
-            }
-        }
-
-        // Move to the next slot.
-        index = (index + 1) % table->capacity;
-    } while (start != index); // Find and remove the entry.
+    // Hash the old cells again, so that the migration places them with the
+    // new seed.
+    HE4 * old = table->old;
+    table->seed = seed;
+    for (size_t index = 0; index < old->capacity; ++index) {
+        if (is_open(old, index)) continue;
+        HASH(old, index) = key_hash(table, cell_key(old, index),
+                                    KLEN(old, index));
+    } // Hash every key.
+    he4_rehash_step(table, SIZE_MAX);
+    table->flooded = false;
+    return false;
+}
 
-    // Not found.
-    DEBUG("Exhausted.");
-    return (he4_entry_t)NULL;
+/**
+ * If an insertion has found the table flooded, rebuild the table with a new
+ * seed, and double the flood limit.  This is only done by the functions that
+ * hash the key themselves, so that a hash passed to the others is good.
+ *
+ * @param table         The table.
+ */
+static void
+check_flood(HE4 * table) {
+    if (!table->flooded) return;
+    DEBUG("Table is flooded; rebuilding with a new seed.");
+    if (!reseed(table, choose_seed(table)) &&
+        table->flood_limit <= SIZE_MAX / 2) {
+        table->flood_limit *= 2;
+    }
 }
 
 bool
-he4_discard(HE4 * table, const he4_key_t key, const size_t klen) {
-    // Check arguments.
+he4_set_seed(HE4 * table, uint64_t seed) {
     if (table == NULL) {
         DEBUG("Table is NULL.");
         return true;
     }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
-        return true;
-    }
-    if (klen == 0) {
-        DEBUG("Key length is 0.");
-        return true;
+    if (table->hash != he4_hash) {
+        table->seed = seed;
+        return false;
     }
-
-    // Hash the key, then wrap to table size.
-    he4_hash_t hash = table->hash(key, klen);
-    size_t start = hash % table->capacity;
-    size_t index = start;
-
-    // Find the corresponding entry.  Stop if we wrap around, which can happen
-    // with a full table.
-    do {
-        // If we find an empty cell, we can stop.
-        if (is_empty(table, index)) return true;
-
-        // Skip deleted cells.
-        if (! is_deleted(table, index)) {
-            // Check the current slot.
-            if (table->maps[index].hash == hash &&
-                table->compare(key, klen, table->maps[index].key,
-                               table->maps[index].klen) == 0) {
-                // Found the entry.  Remove it, and mark the cell as deleted.
-                empty_cell(table, index, true, true);
-                table->maps[index].klen = 1;
-                ++(table->free);
-                return false;
-            }
-        }
-
-        // Move to the next slot.
-        index = (index + 1) % table->capacity;
-    } while (start != index); // Find and remove the entry.
-
-    // Not found.
-    return true;
+    return reseed(table, seed);
 }
 
-he4_entry_t
-he4_get(HE4 * table, const he4_key_t key, const size_t klen) {
-    // Check arguments.
+bool
+he4_set_flood_limit(HE4 * table, size_t limit) {
     if (table == NULL) {
         DEBUG("Table is NULL.");
-        return (he4_entry_t)NULL;
+        return true;
     }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
-        return (he4_entry_t)NULL;
+    if (limit == 0) {
+        table->flood_limit = 0;
+        table->flooded = false;
+        return false;
     }
-    if (klen == 0) {
-        DEBUG("Key length is 0.");
-        return (he4_entry_t)NULL;
+    if (table->hash != he4_hash) {
+        DEBUG("Only tables that use the default hash can be re-seeded.");
+        return true;
     }
-
-    // Hash the key, then wrap to table size.
-    he4_hash_t hash = table->hash(key, klen);
-    size_t start = hash % table->capacity;
-    size_t index = start;
-
-    // Find the corresponding entry.  Stop if we wrap around, which can happen
-    // with a full table.
-    bool lazy = false;
-    size_t lazy_index = 0;
-    do {
-        // If we find an empty slot, stop.
-        if (is_empty(table, index)) return (he4_entry_t)NULL;
-
-        // Keep track of the first deleted slot that is open.
-        if (!lazy && is_deleted(table, index)) {
-            // This is a lazy-deleted cell.
-            lazy = true;
-            lazy_index = index;
-        }
-
-        // Check the current slot.
-        if (table->maps[index].hash == hash &&
-                table->compare(key, klen, table->maps[index].key,
-                               table->maps[index].klen) == 0) {
-            // Found the entry.  If we have a lazy-deleted index, move it there.
-            he4_entry_t entry = table->maps[index].entry;
-            if (lazy) {
-                move_cell(table, index, lazy_index);
-                table->maps[index].klen = 1;
-#ifndef HE4NOTOUCH
-                ++(table->max_touch);
-                table->maps[lazy_index].touch = table->max_touch;
-            } else {
-                ++(table->max_touch);
-                table->maps[index].touch = table->max_touch;
-#endif // HE4NOTOUCH
-            }
-            return entry;
-        }
-
-        // Move to the next slot.
-        index = (index + 1) % table->capacity;
-    } while (start != index); // Find the entry.
-
-    // Not found.
-    return (he4_entry_t)NULL;
+    if (!can_migrate(table)) return true;
+    table->flood_limit = limit;
+    return false;
 }
 
-//======================================================================
-// Direct access.
-//======================================================================
-
-he4_entry_t *
-he4_find(HE4 * table, const he4_key_t key, const size_t klen) {
-    // Check arguments.
+bool
+he4_rehash_begin(HE4 * table, const size_t newsize) {
     if (table == NULL) {
-        DEBUG("Table is NULL.");
-        return NULL;
+        DEBUG("Attempt to rehash a NULL table.");
+        return true;
     }
-    if (key == NULL) {
-        DEBUG("Key is NULL.");
-        return NULL;
+    if (!can_migrate(table)) return true;
+    he4_rehash_step(table, SIZE_MAX);
+    if (newsize == 0 && table->capacity > SIZE_MAX / 2) {
+        DEBUG("Table is too large to double.");
+        return true;
     }
-    if (klen == 0) {
-        DEBUG("Key length is 0.");
-        return NULL;
+    size_t capacity = newsize == 0 ? table->capacity * 2 : newsize;
+    if (capacity == table->capacity) {
+        DEBUG("New table capacity is the same; nothing done.");
+        return false;
+    }
+    if (capacity < HE4_MINIMUM_SIZE) capacity = HE4_MINIMUM_SIZE;
+    if (capacity < he4_size(table)) {
+        DEBUG("New table capacity is too small for the entries; nothing "
+              "done.");
+        return false;
     }
 
-    // Hash the key, then wrap to table size.
-    he4_hash_t hash = table->hash(key, klen);
-    size_t start = hash % table->capacity;
-    size_t index = start;
-
-    // Find the corresponding entry.  Stop if we wrap around, which can happen
-    // with a full table.
-    bool lazy = false;
-    size_t lazy_index = 0;
-    do {
-        // If we find an empty slot, stop.
-        if (is_empty(table, index)) return NULL;
-
-        // Pass over deleted cells.
-        if (is_deleted(table, index)) {
-            if (!lazy) {
-                // This is the first lazy-deleted cell encountered.
-                lazy = true;
-                lazy_index = index;
-            }
-        } else {
-            // Check the current slot.
-            if (table->maps[index].hash != hash ||
-                table->compare(key, klen, table->maps[index].key,
-                               table->maps[index].klen)) {
-            } else {
-                // Found the entry.  If we have a lazy-deleted index, move it
-                // there.
-                if (lazy) {
-                    move_cell(table, index, lazy_index);
-                    table->maps[index].klen = 1;
-                    index = lazy_index;
-#ifndef HE4NOTOUCH
-                    ++(table->max_touch);
-                    table->maps[lazy_index].touch = table->max_touch;
-                } else {
-                    ++(table->max_touch);
-                    table->maps[index].touch = table->max_touch;
-#endif // HE4NOTOUCH
-                }
-                return &table->maps[index].entry;
-            }
-        }
-        index = (index + 1) % table->capacity;
-    } while (start != index); // Find the entry.
-
-    // Not found.
-    return NULL;
+    return begin_migration(table, capacity);
 }
 
-//======================================================================
-// Random access.
-//======================================================================
+size_t
+he4_rehash_step(HE4 * table, size_t budget) {
+    if (table == NULL || table->old == NULL) return 0;
+    HE4 * old = table->old;
+    for (; budget > 0 && table->drained < old->capacity; --budget) {
+        if (!is_open(old, table->drained)) migrate_cell(table, table->drained);
+        // Removing an entry from a Robin Hood table may shift another into
+        // the same cell, so a cell is only passed once it is open.
+        if (is_open(old, table->drained)) ++(table->drained);
+    } // Migrate cells.
+    if (table->drained < old->capacity) {
+        return old->capacity - table->drained;
+    }
 
-he4_map_t *
-he4_index(HE4 * table, const size_t index) {
-    if (table == NULL || index >= table->capacity) return NULL;
-    he4_map_t * map = HE4MALLOC(he4_map_t, 1);
-    if (map == NULL) return NULL;
-    memcpy(map, &(table->maps[index]), sizeof(he4_map_t));
-    return map;
+    // Every old cell is open, so this just frees the old arrays.
+    table->old = NULL;
+    table->drained = 0;
+    he4_delete(old);
+    return 0;
 }
 
-//======================================================================
-// Rehash.
-//======================================================================
+void
+he4_compact(HE4 * table) {
+    if (table == NULL) {
+        DEBUG("Attempt to compact a NULL table.");
+        return;
+    }
+    if (table->policy & (HE4_ROBIN_HOOD | HE4_HOPSCOTCH | HE4_CUCKOO)) {
+        // These never have deleted cells.
+        return;
+    }
+    compact(table);
+}
 
 HE4 *
 he4_rehash(HE4 * table, const size_t newsize) {
@@ -722,110 +4145,205 @@ he4_rehash(HE4 * table, const size_t newsize) {
         DEBUG("Attempt to rehash a NULL table.");
         return NULL;
     }
+    return he4_rehash_policy(table, newsize, table->policy);
+}
+
+HE4 *
+he4_rehash_policy(HE4 * table, const size_t newsize, he4_policy_t policy) {
+    if (table == NULL) {
+        // We could treat this as an empty table, but this is almost certainly
+        // an error.
+        DEBUG("Attempt to rehash a NULL table.");
+        return NULL;
+    }
+    he4_rehash_step(table, SIZE_MAX);
     size_t capacity = newsize == 0 ? table->capacity * 2 : newsize;
-    if (capacity <= table->capacity) {
-        DEBUG("New table capacity is too small; nothing done.");
+    if (capacity == table->capacity && policy == table->policy) {
+        DEBUG("New table capacity is the same; nothing done.");
+        return table;
+    }
+    if (capacity < HE4_MINIMUM_SIZE) capacity = HE4_MINIMUM_SIZE;
+    if (capacity < he4_size(table)) {
+        DEBUG("New table capacity is too small for the entries; nothing "
+              "done.");
         return table;
     }
 
     // Make the new table.
-    HE4 * newtable = he4_new(capacity, table->hash, table->compare,
-                             table->delete_key, table->delete_entry);
+    HE4 * newtable = he4_new_policy(capacity, policy, table->hash,
+                                    table->compare, table->delete_key,
+                                    table->delete_entry);
     if (newtable == NULL) {
         DEBUG("Unable to get memory for rehashed table.");
         return NULL;
     }
+    if (table->probe_limit != 0 &&
+        he4_set_probe_limit(newtable, table->probe_limit)) {
+        DEBUG("Unable to keep the probe limit in the rehashed table.");
+        he4_delete(newtable);
+        return NULL;
+    }
+    copy_settings(newtable, table);
 
-    // Move everything to the rehashed table.  Note that we have to preserve
+    // Copy everything to the rehashed table.  Note that we have to preserve
     // the touch indices so successive rehashing works properly.
     for (size_t index = 0; index < table->capacity; ++index) {
+        if (is_open(table, index)) continue;
 #ifndef HE4NOTOUCH
-        insert_cell(newtable, table->maps[index].key, table->maps[index].klen,
-                    table->maps[index].entry, false, table->maps[index].touch);
+        bool failed = insert_cell(newtable, cell_key(table, index),
+                                  KLEN(table, index), ENTRY(table, index),
+                                  HASH(table, index), false,
+                                  TOUCH(table, index));
 #else
-        insert_cell(newtable, table->maps[index].key, table->maps[index].klen,
-                    table->maps[index].entry, false, 0);
+        bool failed = insert_cell(newtable, cell_key(table, index),
+                                  KLEN(table, index), ENTRY(table, index),
+                                  HASH(table, index), false, 0);
 #endif // HE4NOTOUCH
-        table->maps[index] = blank_cell;
+        if (failed) {
+            // Only hopscotch and cuckoo tables, or tables with a probe
+            // limit, can run out of room this way.
+            DEBUG("Unable to place every entry in the rehashed table.");
+            forget_table(newtable);
+            return NULL;
+        }
     } // Rehash the table.
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        he4_map_t * map = table->stash + slot;
+#ifndef HE4NOTOUCH
+        bool failed = insert_cell(newtable, map_key(table, map), map->klen,
+                                  map->entry, map->hash, false, map->touch);
+#else
+        bool failed = insert_cell(newtable, map_key(table, map), map->klen,
+                                  map->entry, map->hash, false, 0);
+#endif // HE4NOTOUCH
+        if (failed) {
+            DEBUG("Unable to place every entry in the rehashed table.");
+            forget_table(newtable);
+            return NULL;
+        }
+    } // Rehash the stash.
 #ifndef HE4NOTOUCH
     newtable->max_touch = table->max_touch;
 #endif // HE4NOTOUCH
 
-    // Free the original table.
-    he4_delete(table);
+    // Free the original table.  Its keys and entries now belong to the new
+    // table.
+    forget_table(table);
     return newtable;
 }
 
 #ifndef HE4NOTOUCH
+/**
+ * Trim old entries from a Robin Hood, hopscotch, or cuckoo table.  None has
+ * deleted cells, and removing an entry leaves the others where searches
+ * will find them, so the entries are just removed.  See `he4_trim`.
+ *
+ * @param table         The table.
+ * @param trim_below    Discard and free any entries with a touch index lower
+ *                      than this value.
+ */
+static void
+erase_trim(HE4 * table, const size_t trim_below) {
+    // Discard the old entries.  Removing an entry from a Robin Hood table
+    // may shift another into the same cell, so check the cell again.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        while (!is_open(table, index) && TOUCH(table, index) < trim_below) {
+            remove_cell(table, index, true);
+            ++(table->free);
+        } // Discard old entries.
+    } // Traverse the table.
+
+    // Rebase the touch indices.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (!is_open(table, index)) TOUCH(table, index) -= trim_below;
+    } // Traverse the table.
+    table->max_touch = table->max_touch < trim_below ?
+                       0 : table->max_touch - trim_below;
+}
+
 void
 he4_trim(HE4 * table, const size_t trim_below) {
     if (table == NULL) {
         DEBUG("Attempt to trim a NULL table.");
         return;
     }
+    he4_rehash_step(table, SIZE_MAX);
 
     /* Explanation
      *
-     * This traverses the table and performs the following action at each cell.
+     * This first traverses the table and performs the following action at
+     * each cell.
      * (1) If the cell is occupied and has touch index below the threshold, the
-     *     cell is freed and marked as empty.
+     *     cell is freed and marked as deleted.
      * (2) If the cell is occupied then the touch index is decremented by the
-     *     threshold.  If the cell is not at the correct position for the hash
-     *     code, then the first available position for it is searched and the
-     *     entry is relocated there.  This is not necessarily optimum because
-     *     we are doing all this in a single pass.
-     * (3) If the cell is deleted, then it is emptied.
-     * (4) If the cell is empty, then it is skipped.
+     *     threshold.
+     * (3) If the cell is deleted or empty, then it is skipped.
      * The table's max touch index is decremented by the threshold.
      *
-     * All of this could still result in a problem, though this is modestly
-     * unlikely.  The issue will arise when an entry is made after linear
-     * probing, but a cell is marked empty between the ideal hash and the
-     * insertion point (and the insertion point wraps).  Then the entry is
-     * "lost" because searches halt on an empty cell.  For this reason the
-     * table is re-visited until no entries are moved.
+     * Stash entries below the threshold are freed, and the rest are
+     * rebased along with the cells.
+     *
+     * The table is then compacted, which empties every deleted cell and
+     * moves each entry to the first free cell of its probe sequence, in a
+     * single pass.  Emptying a deleted cell could otherwise leave an entry
+     * "lost," because searches halt on an empty cell.  See `compact`.
+     * Finally, any stash entry that now has an open cell within the probe
+     * limit is moved back into the table.
+     *
+     * Robin Hood, hopscotch, and cuckoo tables have no deleted cells, and
+     * removing an entry never hides another from a search, so no entry is
+     * ever "lost."
+     * They are trimmed by a separate function.
      */
+    if (table->policy & (HE4_ROBIN_HOOD | HE4_HOPSCOTCH | HE4_CUCKOO)) {
+        erase_trim(table, trim_below);
+        auto_resize(table);
+        return;
+    }
 
-    bool moved = true;
-    while (moved) {
-        moved = false;
-        for (size_t index = 0; index < table->capacity; ++index) {
-            if (is_empty(table, index)) continue;
-            if (is_deleted(table, index)) {
-                // Mark this cell as empty.
-                table->maps[index].klen = 0;
-                continue;
-            }
-            // Cell is occupied.
-            if (table->maps[index].touch < trim_below) {
-                table->delete_key(table->maps[index].key);
-                table->maps[index].key = (he4_key_t)NULL;
-                table->delete_entry(table->maps[index].entry);
-                table->maps[index].entry = (he4_entry_t)NULL;
-                table->maps[index].klen = 0;
-                table->maps[index].hash = 0;
-                ++(table->free);
-                continue;
-            }
-            // We wish to retain the cell, but might want to move it.  Find the
-            // best place to put it.
-            size_t best = table->maps[index].hash % table->capacity;
-            if (best == index || table->free == 0) continue;
-            while (!is_open(table, best)) {
-                ++best;
-            } // Find the best slot for the cell.
-            // Move the data to the new cell.
-            table->maps[best] = table->maps[index];
-            table->maps[best].touch = table->maps[index].touch - trim_below;
-            table->maps[index].key = (he4_key_t)NULL;
-            table->maps[index].entry = (he4_entry_t)NULL;
-            table->maps[index].klen = 0;
-            table->maps[index].hash = 0;
-            table->maps[index].touch = 0;
-            moved = true;
-        } // Traverse the table.
-    } // Continue until no cells move.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (is_open(table, index)) continue;
+        if (TOUCH(table, index) < trim_below) {
+            delete_cell(table, index, true);
+            ++(table->free);
+            continue;
+        }
+        TOUCH(table, index) -= trim_below;
+    } // Traverse the table.
+    for (size_t slot = 0; slot < table->stashed; ) {
+        if (table->stash[slot].touch < trim_below) {
+            stash_remove(table, slot, true);
+            continue;
+        }
+        table->stash[slot].touch -= trim_below;
+        ++slot;
+    } // Traverse the stash.
+    table->max_touch = table->max_touch < trim_below ?
+                       0 : table->max_touch - trim_below;
+
+    compact(table);
+
+    // Move stashed entries back into the table where there is now room.
+    for (size_t slot = 0; slot < table->stashed; ) {
+        he4_map_t * map = table->stash + slot;
+        probe_t probe;
+        probe_start(table, map->hash, &probe);
+        size_t count = 0;
+        while (count < table->probe_limit && !is_open(table, probe.index)) {
+            probe_next(table, &probe);
+            ++count;
+        } // Find an open cell within the probe limit.
+        if (count == table->probe_limit) {
+            ++slot;
+            continue;
+        }
+        put_cell(table, probe.index, *map);
+        set_ctrl(table, probe.index, fingerprint(map->hash));
+        --(table->free);
+        *map = table->stash[--(table->stashed)];
+        table->stash[table->stashed] = blank_cell;
+    } // Traverse the stash.
+    auto_resize(table);
 }
 
 HE4 *
@@ -836,40 +4354,88 @@ he4_trim_and_rehash(HE4 * table, const size_t newsize, const size_t trim_below)
         DEBUG("Attempt to rehash a NULL table.");
         return NULL;
     }
+    he4_rehash_step(table, SIZE_MAX);
+    size_t kept = 0;
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (!is_open(table, index) && TOUCH(table, index) >= trim_below) {
+            ++kept;
+        }
+    } // Count the entries to keep.
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        if (table->stash[slot].touch >= trim_below) ++kept;
+    } // Count the stash entries to keep.
     size_t capacity = newsize == 0 ? table->capacity * 2 : newsize;
-    if (capacity < table->capacity) {
+    if (capacity < HE4_MINIMUM_SIZE) capacity = HE4_MINIMUM_SIZE;
+    if (capacity < kept) {
         DEBUG("New table capacity is too small; keeping old size.");
         capacity = table->capacity;
     }
 
     // Make the new table.
-    HE4 * newtable = he4_new(capacity, table->hash, table->compare,
-                             table->delete_key, table->delete_entry);
+    HE4 * newtable = he4_new_policy(capacity, table->policy, table->hash,
+                                    table->compare, table->delete_key,
+                                    table->delete_entry);
     if (newtable == NULL) {
         DEBUG("Unable to get memory for rehashed table.");
         return NULL;
     }
+    if (table->probe_limit != 0 &&
+        he4_set_probe_limit(newtable, table->probe_limit)) {
+        DEBUG("Unable to keep the probe limit in the rehashed table.");
+        he4_delete(newtable);
+        return NULL;
+    }
+    copy_settings(newtable, table);
 
-    // Move everything to the rehashed table, and adjust the touch indices.
+    // Copy the entries to keep to the rehashed table, and adjust the touch
+    // indices.
     for (size_t index = 0; index < table->capacity; ++index) {
-        if (table->maps[index].touch < trim_below) continue;
+        if (is_open(table, index)) continue;
+        if (TOUCH(table, index) < trim_below) continue;
 #ifndef HE4NOTOUCH
-        insert_cell(newtable, table->maps[index].key, table->maps[index].klen,
-                    table->maps[index].entry, false,
-                    table->maps[index].touch - trim_below);
+        bool failed = insert_cell(newtable, cell_key(table, index),
+                                  KLEN(table, index), ENTRY(table, index),
+                                  HASH(table, index), false,
+                                  TOUCH(table, index) - trim_below);
 #else
-        insert_cell(newtable, table->maps[index].key, table->maps[index].klen,
-                    table->maps[index].entry, false, 0);
+        bool failed = insert_cell(newtable, cell_key(table, index),
+                                  KLEN(table, index), ENTRY(table, index),
+                                  HASH(table, index), false, 0);
 #endif // HE4NOTOUCH
-        table->maps[index].key = (he4_key_t)NULL;
-        table->maps[index].entry = (he4_entry_t)NULL;
-        table->maps[index].klen = 0;
+        if (failed) {
+            // Only hopscotch and cuckoo tables, or tables with a probe
+            // limit, can run out of room this way.
+            DEBUG("Unable to place every entry in the rehashed table.");
+            forget_table(newtable);
+            return NULL;
+        }
     } // Rehash the table.
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        he4_map_t * map = table->stash + slot;
+        if (map->touch < trim_below) continue;
+        if (insert_cell(newtable, map_key(table, map), map->klen,
+                        map->entry, map->hash, false,
+                        map->touch - trim_below)) {
+            DEBUG("Unable to place every entry in the rehashed table.");
+            forget_table(newtable);
+            return NULL;
+        }
+    } // Rehash the stash.
 #ifndef HE4NOTOUCH
     newtable->max_touch = table->max_touch - trim_below;
 #endif // HE4NOTOUCH
 
-    // Free the original table.
+    // Free the original table, and with it the entries that were trimmed.
+    for (size_t index = 0; index < table->capacity; ++index) {
+        if (!is_open(table, index) && TOUCH(table, index) >= trim_below) {
+            put_cell(table, index, blank_cell);
+        }
+    } // Forget the entries that were kept.
+    for (size_t slot = 0; slot < table->stashed; ++slot) {
+        if (table->stash[slot].touch >= trim_below) {
+            table->stash[slot] = blank_cell;
+        }
+    } // Forget the stash entries that were kept.
     he4_delete(table);
     return newtable;
 }
@@ -0,0 +1,128 @@
+/**
+ * @file
+ * Test tables whose arrays are aligned or backed by huge pages.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 50000
+
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)(key * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The policies to test, and the alignment each must give.
+static he4_policy_t policies[] = {
+    HE4_ALIGN_LINES,
+    HE4_ALIGN_PAGES,
+    HE4_HUGE_PAGES,
+    HE4_ALIGN_LINES | HE4_CONTROL_BYTES,
+    HE4_HUGE_PAGES | HE4_CONTROL_BYTES | HE4_RANGE_MASK,
+    HE4_ALIGN_PAGES | HE4_ROBIN_HOOD,
+    HE4_ALIGN_LINES | HE4_CUCKOO,
+};
+static uintptr_t alignments[] = { 64, 4096, 4096, 64, 4096, 4096, 64 };
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Get the first cell array of a table.
+const void * cells(HE4 * table) {
+#ifndef HE4SOA
+    return table->maps;
+#else
+    return table->keys;
+#endif // HE4SOA
+}
+
+// Check that the arrays of a table are aligned.
+bool aligned(HE4 * table, uintptr_t alignment) {
+    if ((uintptr_t)cells(table) % alignment != 0) return false;
+    if (table->ctrl != NULL && (uintptr_t)table->ctrl % alignment != 0) {
+        return false;
+    }
+    if (table->meta != NULL && (uintptr_t)table->meta % alignment != 0) {
+        return false;
+    }
+    return true;
+}
+
+// Check that the table holds the keys from 1 up to keys.
+bool holds(HE4 * table, size_t keys) {
+    for (size_t key = 1; key <= keys; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != key + 7) return false;
+    } // Check every key.
+    return true;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(KEYS * 2, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        if (table == NULL) {
+            FAIL_TEST("creation with policy: 0x%x", policies[which]);
+        }
+        IF_FAIL_STOP;
+        if (!aligned(table, alignments[which])) {
+            FAIL_TEST("alignment with policy: 0x%x", policies[which]);
+        }
+
+        // New tables are empty.
+        size_t empty = 0;
+        for (size_t index = 0; index < he4_capacity(table); ++index) {
+            he4_map_t * map = he4_index(table, index);
+            if (map->klen == 0) ++empty;
+            HE4FREE(map);
+        } // Check every cell.
+        ASSERT(empty == he4_capacity(table));
+
+        // Fill the table.
+        for (size_t key = 1; key <= KEYS; ++key) {
+            if (he4_insert(table, key, sizeof(size_t), key + 7)) {
+                FAIL_TEST("insertion with policy: 0x%x", policies[which]);
+            }
+        } // Fill the table.
+        ASSERT(holds(table, KEYS));
+
+        // Rehashing keeps the policy, and with it the alignment.
+        table = he4_rehash(table, 0);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(table->policy == policies[which]);
+        ASSERT(aligned(table, alignments[which]));
+        ASSERT(holds(table, KEYS));
+        table = he4_trim_and_rehash(table, he4_capacity(table), 0);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(table->policy == policies[which]);
+        ASSERT(aligned(table, alignments[which]));
+        ASSERT(holds(table, KEYS));
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+
+END_TEST
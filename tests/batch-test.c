@@ -0,0 +1,222 @@
+/**
+ * @file
+ * Test looking up and changing many keys at once.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 3000
+#define LOOKUPS 1000
+
+// The hash is kept to 32 bits, so that keys collide the same way with 64-bit
+// hashes.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)(uint32_t)(key * 2654435761u);
+}
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MULTIPLY | HE4_PROBE_DOUBLE,
+    HE4_CONTROL_BYTES,
+    HE4_ROBIN_HOOD,
+    HE4_HOPSCOTCH,
+    HE4_CUCKOO,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Look up a mix of present and missing keys, in batches of every size up to
+// a few times HE4_BATCH, and check them against he4_get.  Return a
+// description of the first problem found, or NULL.
+const char * lookup(HE4 * table) {
+    static size_t keys[LOOKUPS];
+    static size_t klens[LOOKUPS];
+    static size_t out[LOOKUPS];
+    for (size_t at = 0; at < LOOKUPS; ++at) {
+        keys[at] = (at * 7919) % (2 * KEYS) + 1;
+        klens[at] = sizeof(size_t);
+    } // Make the keys.
+    size_t at = 0;
+    for (size_t count = 0; at + count <= LOOKUPS; ++count) {
+        size_t found = he4_get_many(table, keys + at, klens + at, count,
+                                    out + at);
+        size_t expect = 0;
+        for (size_t which = at; which < at + count; ++which) {
+            if (out[which] != he4_get(table, keys[which], sizeof(size_t))) {
+                return "wrong entry";
+            }
+            if (out[which] != 0) ++expect;
+        } // Check the batch.
+        if (found != expect) return "wrong count";
+        at += count;
+        if (count == 3 * HE4_BATCH) count = 0;
+    } // Look up batches.
+    return NULL;
+}
+
+// Apply batches of random operations to one table, and the same operations
+// one at a time to another, and compare.  Keys repeat within a batch, so
+// the order of operations on the same key is checked too.  Return a
+// description of the first problem found, or NULL.
+const char * apply(HE4 * table, HE4 * twin) {
+    static he4_op_t ops[2000];
+    for (size_t round = 0; round < 20; ++round) {
+        size_t count = next(2000) + 1;
+        for (size_t at = 0; at < count; ++at) {
+            ops[at].kind = (he4_op_kind_t)next(4);
+            ops[at].key = next(KEYS) + 1;
+            ops[at].klen = sizeof(size_t);
+            ops[at].entry = next(1000) + 1;
+        } // Make the operations.
+        static he4_op_t expect[2000];
+        for (size_t at = 0; at < count; ++at) {
+            he4_op_t * op = expect + at;
+            *op = ops[at];
+            switch (op->kind) {
+                case HE4_OP_INSERT:
+                    op->result = he4_insert(twin, op->key, op->klen,
+                                            op->entry);
+                    break;
+                case HE4_OP_FORCE_INSERT:
+                    op->result = he4_force_insert(twin, op->key, op->klen,
+                                                  op->entry);
+                    break;
+                case HE4_OP_REMOVE:
+                    op->entry = he4_remove(twin, op->key, op->klen);
+                    op->result = op->entry == 0;
+                    break;
+                default:
+                    op->result = he4_discard(twin, op->key, op->klen);
+                    break;
+            }
+        } // Apply the operations one at a time.
+        if (he4_apply_batch(table, ops, count)) return "apply";
+        for (size_t at = 0; at < count; ++at) {
+            if (ops[at].result != expect[at].result) return "result";
+            if (ops[at].entry != expect[at].entry) return "entry";
+        } // Check the results.
+        if (he4_size(table) != he4_size(twin)) return "size";
+        for (size_t key = 1; key <= KEYS; ++key) {
+            if (he4_get(table, key, sizeof(size_t)) !=
+                he4_get(twin, key, sizeof(size_t))) {
+                return "contents";
+            }
+        } // Compare the tables.
+    } // Apply batches.
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(4000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        for (size_t key = 1; key <= KEYS; ++key) {
+            ASSERT(!he4_insert(table, key, sizeof(size_t), key + 7));
+        } // Fill the table.
+        const char * problem = lookup(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Lookups work in the middle of an incremental rehash, and find keys in
+    // the stash.
+    HE4 * table = he4_new(4000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        ASSERT(!he4_insert(table, key, sizeof(size_t), key + 7));
+    } // Fill the table.
+    ASSERT(!he4_rehash_begin(table, 8000));
+    ASSERT(he4_rehash_step(table, 0) != 0);
+    ASSERT(lookup(table) == NULL);
+    he4_delete(table);
+    table = he4_new(4000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 1));
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_insert(table, key, sizeof(size_t), key + 7);
+    } // Fill the table and the stash.
+    ASSERT(table->stashed == HE4_STASH_SIZE);
+    ASSERT(lookup(table) == NULL);
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(apply)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(4000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        HE4 * twin = he4_new_policy(4000, policies[which], hash, compare,
+                                    delete_key, delete_entry);
+        ASSERT(table != NULL && twin != NULL); IF_FAIL_STOP;
+        const char * problem = apply(table, twin);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+        he4_delete(twin);
+    } // Try every policy.
+
+    // Batches also work while the table resizes itself.
+    HE4 * table = he4_new(64, hash, compare, delete_key, delete_entry);
+    HE4 * twin = he4_new(4000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL && twin != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_auto_resize(table, 0.1, 0.7, 0));
+    ASSERT(apply(table, twin) == NULL);
+    he4_delete(table);
+    he4_delete(twin);
+
+END_ITEM
+START_ITEM(arguments)
+
+    HE4 * table = he4_new(100, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_insert(table, 5, sizeof(size_t), 12));
+    size_t keys[3] = { 5, 0, 5 };
+    size_t klens[3] = { sizeof(size_t), sizeof(size_t), 0 };
+    size_t out[3] = { 1, 1, 1 };
+    ASSERT(he4_get_many(table, keys, klens, 3, out) == 1);
+    ASSERT(out[0] == 12 && out[1] == 0 && out[2] == 0);
+    ASSERT(he4_get_many(NULL, keys, klens, 3, out) == 0);
+    ASSERT(he4_get_many(table, NULL, klens, 3, out) == 0);
+    ASSERT(he4_get_many(table, keys, NULL, 3, out) == 0);
+    ASSERT(he4_get_many(table, keys, klens, 3, NULL) == 0);
+    ASSERT(he4_get_many(table, keys, klens, 0, out) == 0);
+    he4_op_t ops[3] = {
+        { HE4_OP_DISCARD, 5, sizeof(size_t), 0, true },
+        { HE4_OP_INSERT, 0, sizeof(size_t), 3, false },
+        { 9, 6, sizeof(size_t), 3, false },
+    };
+    ASSERT(!he4_apply_batch(table, ops, 3));
+    ASSERT(!ops[0].result && ops[1].result && ops[2].result);
+    ASSERT(he4_size(table) == 0);
+    ASSERT(he4_apply_batch(NULL, ops, 3));
+    ASSERT(he4_apply_batch(table, NULL, 3));
+    ASSERT(!he4_apply_batch(table, ops, 0));
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
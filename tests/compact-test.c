@@ -0,0 +1,161 @@
+/**
+ * @file
+ * Test the deleted cell count, and compaction of tables in place.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 1500
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MULTIPLY,
+    HE4_PROBE_TRIANGULAR,
+    HE4_PROBE_DOUBLE,
+    HE4_CONTROL_BYTES,
+    HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Count the deleted cells of a table.
+size_t count_deleted(HE4 * table) {
+    size_t deleted = 0;
+    for (size_t index = 0; index < he4_capacity(table); ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->key == 0 && map->klen != 0) ++deleted;
+        HE4FREE(map);
+    } // Check every cell.
+    return deleted;
+}
+
+// Check the table against the model.
+bool agrees(HE4 * table, size_t * model) {
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != model[key]) return false;
+    } // Check every key.
+    return true;
+}
+
+// Churn a table against a model.  Return a description of the first problem
+// found, or NULL.
+const char * exercise(HE4 * table, double ratio) {
+    size_t model[KEYS + 1] = { 0 };
+    size_t capacity = he4_capacity(table);
+    size_t most = 0;
+    for (size_t step = 0; step < 50000; ++step) {
+        size_t key = next(KEYS) + 1;
+        size_t entry = next(100000) + 1;
+        if (next(2) == 0) {
+            bool failed = he4_insert(table, key, sizeof(size_t), entry);
+            if (!failed) model[key] = entry;
+            if (failed && model[key] != 0) return "insert";
+            // The insertion may have reused a deleted cell.
+            if ((double)he4_deleted(table) > ratio * (double)capacity + 1) {
+                return "too many deleted cells";
+            }
+        } else {
+            if (he4_remove(table, key, sizeof(size_t)) != model[key]) {
+                return "remove";
+            }
+            model[key] = 0;
+        }
+        if (he4_deleted(table) > most) most = he4_deleted(table);
+    } // Churn the table.
+    if (he4_deleted(table) != count_deleted(table)) return "count";
+    if (!agrees(table, model)) return "churn";
+    if (most == 0) return "no deleted cells";
+    he4_compact(table);
+    if (he4_deleted(table) != 0 || count_deleted(table) != 0) {
+        return "compact";
+    }
+    if (!agrees(table, model)) return "after compaction";
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(ratio)
+
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->deleted_ratio == HE4_DELETED_RATIO);
+    ASSERT(he4_set_deleted_ratio(table, 1.5));
+    ASSERT(he4_set_deleted_ratio(table, -0.5));
+    ASSERT(he4_set_deleted_ratio(NULL, 0.5));
+    ASSERT(!he4_set_deleted_ratio(table, 0.5));
+    ASSERT(table->deleted_ratio == 0.5);
+    table = he4_rehash(table, 2000);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->deleted_ratio == 0.5);
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(count)
+
+    // Without automatic compaction, removals leave deleted cells.
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_deleted_ratio(table, 0.0));
+    for (size_t key = 1; key <= 800; ++key) {
+        ASSERT(!he4_insert(table, key, sizeof(size_t), key));
+    } // Fill the table.
+    for (size_t key = 1; key <= 800; key += 2) {
+        ASSERT(he4_remove(table, key, sizeof(size_t)) == key);
+    } // Remove half of the entries.
+    ASSERT(he4_deleted(table) == 400);
+    ASSERT(count_deleted(table) == 400);
+    ASSERT(!he4_insert(table, 1, sizeof(size_t), 1));
+    ASSERT(he4_deleted(table) == 399);
+    he4_compact(table);
+    ASSERT(he4_deleted(table) == 0);
+    ASSERT(count_deleted(table) == 0);
+    ASSERT(he4_size(table) == 401);
+    for (size_t key = 1; key <= 800; ++key) {
+        size_t expect = key == 1 || key % 2 == 0 ? key : 0;
+        if (he4_get(table, key, sizeof(size_t)) != expect) {
+            FAIL_TEST("wrong entry for key: %zu", key);
+        }
+    } // Check every key.
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], group_hash, compare,
+                                     delete_key, delete_entry);
+        if (table == NULL) {
+            FAIL_TEST("creation with policy: 0x%x", policies[which]);
+        }
+        IF_FAIL_STOP;
+        const char * problem = exercise(table, HE4_DELETED_RATIO);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+    // Compaction keeps entries within the probe limit.
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 16));
+    ASSERT(exercise(table, HE4_DELETED_RATIO) == NULL);
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
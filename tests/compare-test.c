@@ -0,0 +1,110 @@
+/**
+ * @file
+ * Test that probes check the hash and key length before comparing keys.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE size_t
+
+#include <string.h>
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 200
+
+// Every key has the same hash, so every probe must compare keys.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)key;
+    (void)klen;
+    return 17;
+}
+
+// Count the calls to the comparison function.
+static size_t compares = 0;
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    ++compares;
+    return klen1 != klen2 ? 1 : memcmp(key1, key2, klen1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The keys are runs of 'x' of every length from 1 to KEYS, so no two keys
+// have the same length.
+static char text[KEYS + 1];
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_EXACT_LENGTH,
+    HE4_EXACT_LENGTH | HE4_CONTROL_BYTES,
+    HE4_EXACT_LENGTH | HE4_ROBIN_HOOD,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Fill a table and check every key.  Return true on failure.
+bool exercise(HE4 * table) {
+    for (size_t klen = 1; klen <= KEYS; ++klen) {
+        if (he4_insert(table, text, klen, klen)) return true;
+    } // Fill the table.
+    for (size_t klen = 1; klen <= KEYS; ++klen) {
+        if (he4_get(table, text, klen) != klen) return true;
+    } // Check every key.
+    return he4_get(table, "y", 1) != 0;
+}
+
+START_TEST
+
+    he4_debug = 1;
+    memset(text, 'x', KEYS);
+
+START_ITEM(exact)
+
+    // Keys of different lengths are never compared.
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        compares = 0;
+        if (exercise(table)) {
+            FAIL_TEST("wrong entry with policy: 0x%x", policies[which]);
+        }
+        // Each key matches itself once, and "y" matches the length of the
+        // first key.
+        if (compares != KEYS + 1) {
+            FAIL_TEST("%zu comparisons with policy: 0x%x", compares,
+                      policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(default)
+
+    // Without the policy, the comparison function is called for every key
+    // passed.
+    HE4 * table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    compares = 0;
+    ASSERT(!exercise(table));
+    ASSERT(compares > KEYS * KEYS / 2);
+    he4_delete(table);
+
+    // The default comparison gives the same answers.
+    table = he4_new(1000, hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!exercise(table));
+    ASSERT(he4_get(table, "xy", 2) == 0);
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
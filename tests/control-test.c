@@ -0,0 +1,95 @@
+/**
+ * @file
+ * Test tables that use control bytes against the default table.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+START_TEST
+
+    he4_debug = 1;
+    // Create the tables.
+    HE4 * plain = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    HE4 * table = he4_new_policy(1000, HE4_CONTROL_BYTES, group_hash, compare,
+                                 delete_key, delete_entry);
+
+START_ITEM(basics)
+
+    ASSERT(plain != NULL); IF_FAIL_STOP;
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->ctrl != NULL); IF_FAIL_STOP;
+    ASSERT(plain->ctrl == NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1000); IF_FAIL_STOP;
+    ASSERT(he4_size(table) == 0); IF_FAIL_STOP;
+    ASSERT(he4_get(table, 17, sizeof(size_t)) == 0);
+
+END_ITEM
+START_ITEM(fill)
+
+    // Fill both tables completely.
+    for (size_t key = 1; key <= 1000; ++key) {
+        ASSERT(!he4_insert(plain, key, sizeof(size_t), key + 7));
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) {
+            FAIL_TEST("insertion at key: %zu", key);
+        }
+    } // Fill the tables.
+    ASSERT(he4_load(table) == 1.0);
+    ASSERT(he4_insert(table, 5000, sizeof(size_t), 1));
+    ASSERT(he4_get(table, 5000, sizeof(size_t)) == 0);
+    for (size_t key = 1; key <= 1000; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != key + 7) {
+            FAIL_TEST("missing key: %zu", key);
+        }
+    } // Check the tables.
+    ASSERT(same(plain, table)); IF_FAIL_STOP;
+
+END_ITEM
+START_ITEM(churn)
+
+    // Apply the same random operations to both tables, and check that they
+    // always agree.
+    const char * problem = churn_against(plain, table, 1500, 200000);
+    if (problem != NULL) {
+        FAIL_TEST("%s", problem);
+    }
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Rehashing preserves the policy.
+    plain = he4_rehash(plain, 4096);
+    table = he4_rehash(table, 4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->policy == HE4_CONTROL_BYTES);
+    ASSERT(table->ctrl != NULL);
+    ASSERT(same(plain, table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= 1500; ++key) {
+        ASSERT(he4_get(plain, key, sizeof(size_t)) ==
+               he4_get(table, key, sizeof(size_t)));
+    } // Check every key.
+    he4_trim(plain, he4_max_touch(plain) / 2);
+    he4_trim(table, he4_max_touch(table) / 2);
+    ASSERT(same(plain, table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= 1500; ++key) {
+        ASSERT(he4_get(plain, key, sizeof(size_t)) ==
+               he4_get(table, key, sizeof(size_t)));
+    } // Check every key.
+
+END_ITEM
+
+    // Done.
+    he4_delete(plain);
+    he4_delete(table);
+
+END_TEST
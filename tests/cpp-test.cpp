@@ -0,0 +1,217 @@
+/**
+ * @file
+ * Test the C++ table template.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#include "test-frame.h"
+#include <he4.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+#define KEYS 3000
+
+// Keys are hashed in groups of four, so that the comparison and the shifting
+// of removal are exercised.
+struct group_hash {
+    std::size_t operator()(std::size_t key) const { return key / 4; }
+};
+
+// Every key has the same hash, so that every removal shifts.
+struct same_hash {
+    std::size_t operator()(const std::unique_ptr<int> &) const { return 0; }
+};
+
+// A value that counts its live instances, so that leaks can be found.
+static long live = 0;
+struct counted {
+    explicit counted(std::size_t value = 0) : value(value) { ++live; }
+    counted(const counted & other) : value(other.value) { ++live; }
+    counted(counted && other) noexcept : value(other.value) { ++live; }
+    counted & operator=(const counted &) = default;
+    counted & operator=(counted &&) = default;
+    ~counted() { --live; }
+    std::size_t value;
+};
+
+// A simple deterministic generator, so failures can be reproduced.
+static std::size_t state = 12345;
+static std::size_t next(std::size_t limit) {
+    state = state * 6364136223846793005u + 1442695040888963407u;
+    return (state >> 33) % limit;
+}
+
+// Iterators see entries with a const key, as for the standard maps.
+using counted_table = he4::table<std::size_t, counted, group_hash>;
+static_assert(std::is_same_v<counted_table::value_type,
+                             std::pair<const std::size_t, counted>>);
+static_assert(std::is_same_v<counted_table::iterator::reference,
+                             std::pair<const std::size_t, counted> &>);
+static_assert(std::is_const_v<std::remove_reference_t<
+        decltype(std::declval<counted_table::iterator>()->first)>>);
+
+START_TEST
+
+START_ITEM(model)
+
+    // Insert and remove at random, and compare with a standard map.
+    {
+        he4::table<std::size_t, counted, group_hash> table(KEYS);
+        std::unordered_map<std::size_t, std::size_t> model;
+        ASSERT(table.capacity() == 4096);
+        for (std::size_t step = 0; step < 100000; ++step) {
+            std::size_t key = next(KEYS);
+            if (next(3) == 0) {
+                ASSERT(table.erase(key) == model.erase(key));
+            } else {
+                ASSERT(table.insert_or_assign(key, counted(step)).first !=
+                       table.end());
+                model[key] = step;
+            }
+        } // Make random changes.
+        ASSERT(table.size() == model.size());
+        std::size_t seen = 0;
+        for (const auto & entry : table) {
+            auto found = model.find(entry.first);
+            if (found == model.end() || found->second != entry.second.value) {
+                FAIL_TEST("entry %zu", entry.first);
+            }
+            ++seen;
+        } // Walk the table.
+        ASSERT(seen == model.size());
+        for (std::size_t key = 0; key < KEYS; ++key) {
+            ASSERT(table.contains(key) == (model.count(key) == 1));
+        } // Look up every key.
+        ASSERT(live == (long)model.size());
+
+        // Copies and moves have the same entries.
+        auto copy = table;
+        ASSERT(copy.size() == table.size());
+        auto moved = std::move(table);
+        ASSERT(table.size() == 0 && table.capacity() == 0);
+        ASSERT(table.find(0) == table.end());
+        ASSERT(!table.try_emplace(0).second);
+        for (const auto & entry : copy) {
+            ASSERT(moved.at(entry.first).value == entry.second.value);
+        } // Compare the copy.
+        ASSERT(live == 2 * (long)model.size());
+        copy.clear();
+        ASSERT(copy.empty() && copy.begin() == copy.end());
+        ASSERT(live == (long)model.size());
+    }
+    ASSERT(live == 0);
+
+END_ITEM
+START_ITEM(transparent)
+
+    he4::table<std::string, int> table(64);
+    ASSERT(table.insert_or_assign("spoon", 1).second);
+    ASSERT(table.try_emplace(std::string("fork"), 2).second);
+    ASSERT(!table.try_emplace("fork", 3).second);
+    ASSERT(table.insert({ "knife", 4 }).second);
+
+    // A string view does not convert to a string implicitly, so these can
+    // only compile if the lookup is heterogeneous.
+    std::string_view view("spoon and fork", 5);
+    auto it = table.find(view);
+    ASSERT(it != table.end()); IF_FAIL_STOP;
+    ASSERT(it->second == 1);
+    ASSERT(table.at(std::string_view("fork")) == 2);
+    ASSERT(table.count(std::string_view("knife")) == 1);
+    ASSERT(!table.contains(std::string_view("spork")));
+    ASSERT(table.contains("knife"));
+    ASSERT(table.erase(std::string_view("knife")) == 1);
+    ASSERT(table.size() == 2);
+    bool threw = false;
+    try {
+        table.at(std::string_view("knife"));
+    } catch (const std::out_of_range &) {
+        threw = true;
+    }
+    ASSERT(threw);
+
+    // Const lookups work, and const iterators compare with iterators.
+    const auto & view_table = table;
+    ASSERT(view_table.find("fork") != view_table.end());
+    ASSERT(view_table.at("spoon") == 1);
+    ASSERT(table.cbegin() == table.begin());
+
+END_ITEM
+START_ITEM(move)
+
+    // Keys and values are moved into the table.
+    he4::table<std::string, std::unique_ptr<int>> table(64);
+    std::string key(100, 'k');
+    auto result = table.try_emplace(std::move(key), std::make_unique<int>(7));
+    ASSERT(result.second);
+    ASSERT(key.empty());
+    ASSERT(*result.first->second == 7);
+    auto value = std::make_unique<int>(8);
+    table.insert_or_assign(std::string(100, 'k'), std::move(value));
+    ASSERT(value == nullptr);
+    ASSERT(*table.at(std::string(100, 'k')) == 8);
+
+    // Keys that can only be moved are moved back when removal shifts them.
+    he4::table<std::unique_ptr<int>, int, same_hash> owned(64);
+    ASSERT(owned.try_emplace(std::make_unique<int>(1), 1).second);
+    ASSERT(owned.try_emplace(std::make_unique<int>(2), 2).second);
+    auto second = std::next(owned.begin());
+    ASSERT(*second->first == 2);
+    ASSERT(owned.erase(owned.begin()->first) == 1);
+    ASSERT(owned.size() == 1);
+    ASSERT(*owned.begin()->first == 2 && owned.begin()->second == 2);
+
+    // A found key is not moved from.
+    std::string again(100, 'k');
+    ASSERT(!table.try_emplace(std::move(again)).second);
+    ASSERT(again.size() == 100);
+
+END_ITEM
+START_ITEM(full)
+
+    he4::table<std::size_t, counted, group_hash> table(64);
+    for (std::size_t key = 0; key < 64; ++key) {
+        ASSERT(table.try_emplace(key, key).second);
+    } // Fill the table.
+    ASSERT(table.size() == 64);
+    ASSERT(table.try_emplace(64, 64).first == table.end());
+    ASSERT(table.insert_or_assign(64, counted(64)).first == table.end());
+    ASSERT(table.insert_or_assign(17, counted(18)).first != table.end());
+
+    // Forcing replaces the least-recently-used entry.  Touch the even keys
+    // and then 17, so that the other odd keys are replaced first.
+    for (std::size_t key = 0; key < 64; key += 2) {
+        ASSERT(table.find(key) != table.end());
+    } // Touch the even keys.
+    ASSERT(!table.force_insert(17, counted(19)));
+    ASSERT(table.at(17).value == 19);
+    for (std::size_t key = 64; key < 95; ++key) {
+        ASSERT(table.force_insert(key, counted(key)));
+    } // Replace the odd keys.
+    ASSERT(table.size() == 64);
+    ASSERT(table.force_insert(std::size_t(95), counted(95)));
+    for (std::size_t key = 0; key < 96; ++key) {
+        bool kept = key >= 64 || (key % 2 == 0 && key != 0) || key == 17;
+        if (table.contains(key) != kept) {
+            FAIL_TEST("key %zu", key);
+        }
+    } // Check which keys remain.
+    ASSERT(live == 64);
+
+END_ITEM
+ASSERT(live == 0);
+
+END_TEST
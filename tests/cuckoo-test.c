@@ -0,0 +1,182 @@
+/**
+ * @file
+ * Test tables that use cuckoo hashing.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 1500
+
+// Each key gets its own well-mixed hash.  Cuckoo hashing relies on the two
+// buckets of different keys being independent, so keys that share a hash
+// (as in the other tests) would fill their buckets early.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    uint64_t mixed = key * UINT64_C(0x9E3779B97F4A7C15);
+    return (he4_hash_t)(mixed ^ (mixed >> 29));
+}
+
+// Find the first cell of one of the two buckets for a hash.
+size_t bucket(HE4 * table, he4_hash_t hash, int which) {
+    size_t buckets = table->capacity / HE4_BUCKET_WAYS;
+    size_t first = hash % buckets;
+    if (which == 0) return first * HE4_BUCKET_WAYS;
+#ifdef HE4_HASH64
+    size_t second = (size_t)((((hash >> 32) | (hash << 32)) *
+                              UINT64_C(0x9E3779B97F4A7C15)) % buckets);
+#else
+    size_t second = (uint32_t)(((uint64_t)hash *
+                                UINT64_C(0x9E3779B97F4A7C15)) >> 32) % buckets;
+#endif // HE4_HASH64
+    if (second == first) second = (first + 1) % buckets;
+    return second * HE4_BUCKET_WAYS;
+}
+
+// Check that every entry is in one of its two buckets.
+bool valid(HE4 * table) {
+    size_t count = 0;
+    bool ok = true;
+    for (size_t index = 0; ok && index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->klen != 0) {
+            ++count;
+            size_t here = index - index % HE4_BUCKET_WAYS;
+            ok = here == bucket(table, map->hash, 0) ||
+                 here == bucket(table, map->hash, 1);
+        }
+        HE4FREE(map);
+    } // Check every cell.
+    return ok && count == he4_size(table);
+}
+
+START_TEST
+
+    he4_debug = 1;
+    size_t model[KEYS + 1] = { 0 };
+    HE4 * table = he4_new_policy(1000, HE4_CUCKOO, hash, compare,
+                                 delete_key, delete_entry);
+
+START_ITEM(basics)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1000); IF_FAIL_STOP;
+    ASSERT(he4_size(table) == 0); IF_FAIL_STOP;
+    HE4 * odd = he4_new_policy(1001, HE4_CUCKOO, hash, compare, delete_key,
+                               delete_entry);
+    ASSERT(odd != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(odd) == 1004);
+    he4_delete(odd);
+    ASSERT(he4_new_policy(1000, HE4_CUCKOO | HE4_CONTROL_BYTES, hash,
+                          compare, delete_key, delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_CUCKOO | HE4_ROBIN_HOOD, hash,
+                          compare, delete_key, delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_CUCKOO | HE4_HOPSCOTCH, hash,
+                          compare, delete_key, delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_CUCKOO | HE4_PROBE_DOUBLE, hash,
+                          compare, delete_key, delete_entry) == NULL);
+
+END_ITEM
+START_ITEM(fill)
+
+    // Fill the table until an insertion fails.  That must not happen until
+    // the table is nearly full.
+    size_t key = 1;
+    for (; key <= KEYS; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) break;
+        model[key] = key + 7;
+    } // Fill the table.
+    ASSERT(he4_load(table) >= 0.9);
+    ASSERT(he4_get(table, key, sizeof(size_t)) == 0);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t check = 1; check < key; ++check) {
+        if (he4_get(table, check, sizeof(size_t)) != check + 7) {
+            FAIL_TEST("missing key: %zu", check);
+        }
+    } // Check the table.
+
+END_ITEM
+START_ITEM(churn)
+
+    // Apply random operations and check against a simple model.  An
+    // insertion may only fail if the table is nearly full.
+    const char * problem = churn(table, model, KEYS, 200000, 0.9, valid);
+    if (problem != NULL) {
+        FAIL_TEST("%s", problem);
+    }
+
+END_ITEM
+START_ITEM(force)
+
+    // Fill the table as far as it goes, then force in new keys.  Each must
+    // be found afterward, and must replace at most one entry.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (!he4_insert(table, key, sizeof(size_t), key)) model[key] = key;
+    } // Fill the table.
+    for (size_t key = KEYS + 1; key <= KEYS + 100; ++key) {
+        size_t size = he4_size(table);
+        if (he4_force_insert(table, key, sizeof(size_t), 99)) {
+            ASSERT(he4_size(table) == size);
+        } else {
+            ASSERT(he4_size(table) == size + 1);
+        }
+        if (he4_get(table, key, sizeof(size_t)) != 99) {
+            FAIL_TEST("missing forced key: %zu", key);
+        }
+    } // Force in new keys.
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        ASSERT(entry == 0 || entry == model[key]);
+        model[key] = entry;
+    } // Check every key.
+    for (size_t key = KEYS + 1; key <= KEYS + 100; ++key) {
+        he4_discard(table, key, sizeof(size_t));
+    } // Discard the forced keys.
+
+END_ITEM
+START_ITEM(trim)
+
+    // Trim half the entries, then check what is left.
+    size_t threshold = he4_max_touch(table) - he4_size(table) / 2;
+    size_t kept = 0;
+    for (size_t index = 0; index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->klen != 0 && map->touch >= threshold) ++kept;
+        HE4FREE(map);
+    } // Count the entries to keep.
+    he4_trim(table, threshold);
+    ASSERT(he4_size(table) == kept);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        ASSERT(entry == 0 || entry == model[key]);
+    } // Check every key.
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Rehashing preserves the policy.
+    size_t size = he4_size(table);
+    table = he4_rehash(table, 4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->policy == HE4_CUCKOO);
+    ASSERT(he4_size(table) == size);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+
+END_ITEM
+
+    // Done.
+    he4_delete(table);
+
+END_TEST
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * Test tables generated for a key type and an entry type.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#include "test-table.h"
+#include <he4gen.h>
+
+#define KEYS 3000
+
+// Strings, hashed with FNV-1a.
+static inline uint64_t
+name_hash(const char * name) {
+    uint64_t hash = UINT64_C(14695981039346656037);
+    for (; *name != '\0'; ++name) {
+        hash = (hash ^ (uint8_t)*name) * UINT64_C(1099511628211);
+    } // Hash every byte.
+    return hash;
+}
+#define NAME_EQ(m_name1, m_name2) (strcmp(m_name1, m_name2) == 0)
+
+// Several tables with different types in one program.
+HE4_DECLARE(counts, uint64_t, uint32_t, KEY_GROUP, HE4_EQ_INT)
+HE4_DECLARE(ids, uint32_t, double, HE4_HASH_INT, HE4_EQ_INT)
+HE4_DECLARE(names, const char *, size_t, name_hash, NAME_EQ)
+
+// Check that a table holds exactly the keys with a model entry.
+bool holds(counts_t * table, const uint32_t model[]) {
+    size_t count = 0;
+    for (uint64_t key = 0; key < KEYS; ++key) {
+        uint32_t * entry = counts_find(table, key);
+        if (model[key] == 0) {
+            if (entry != NULL) return false;
+        } else {
+            if (entry == NULL || *entry != model[key]) return false;
+            ++count;
+        }
+    } // Check every key.
+    return count == counts_size(table);
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(basics)
+
+    counts_t * table = counts_new(100);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(counts_capacity(table) == 128);
+    ASSERT(counts_size(table) == 0);
+    ASSERT(counts_find(table, 7) == NULL);
+    ASSERT(!counts_insert(table, 7, 70));
+    ASSERT(!counts_insert(table, 8, 80));
+    ASSERT(!counts_insert(table, 7, 71));
+    ASSERT(counts_size(table) == 2);
+    uint32_t * entry = counts_find(table, 7);
+    ASSERT(entry != NULL && *entry == 71); IF_FAIL_STOP;
+    ++*entry;
+    uint32_t removed = 0;
+    ASSERT(!counts_remove(table, 7, &removed));
+    ASSERT(removed == 72);
+    ASSERT(counts_remove(table, 7, NULL));
+    ASSERT(counts_find(table, 8) != NULL);
+    counts_clear(table);
+    ASSERT(counts_size(table) == 0);
+    ASSERT(counts_find(table, 8) == NULL);
+    counts_delete(table);
+
+    // Small tables are made the minimum size, and NULL tables are ignored.
+    ids_t * small = ids_new(1);
+    ASSERT(small != NULL); IF_FAIL_STOP;
+    ASSERT(ids_capacity(small) == HE4_MINIMUM_SIZE);
+    ids_delete(small);
+    ASSERT(ids_insert(NULL, 1, 1.0));
+    ASSERT(ids_find(NULL, 1) == NULL);
+    ASSERT(ids_remove(NULL, 1, NULL));
+    ASSERT(ids_size(NULL) == 0);
+    ids_delete(NULL);
+
+END_ITEM
+START_ITEM(churn)
+
+    // Insert and remove at random, keeping a model of the table.
+    counts_t * table = counts_new(4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    uint32_t model[KEYS] = { 0 };
+    for (size_t step = 0; step < 100000; ++step) {
+        uint64_t key = next(KEYS);
+        if (next(3) == 0) {
+            uint32_t entry = 0;
+            bool missing = counts_remove(table, key, &entry);
+            if (missing != (model[key] == 0) || entry != model[key]) {
+                FAIL_TEST("removal of key: %zu", (size_t)key);
+            }
+            model[key] = 0;
+        } else {
+            uint32_t entry = (uint32_t)step + 1;
+            if (counts_insert(table, key, entry)) {
+                FAIL_TEST("insertion of key: %zu", (size_t)key);
+            }
+            model[key] = entry;
+        }
+    } // Change the table.
+    ASSERT(holds(table, model));
+
+    // Walking the table visits every entry once.
+    size_t walked = 0;
+    for (size_t index = 0; index < counts_capacity(table); ++index) {
+        uint64_t key = 0;
+        uint32_t entry = 0;
+        if (counts_at(table, index, &key, &entry)) continue;
+        ASSERT(key < KEYS && model[key] == entry);
+        ++walked;
+    } // Walk the table.
+    ASSERT(walked == counts_size(table));
+    ASSERT(counts_at(table, counts_capacity(table), NULL, NULL));
+    counts_delete(table);
+
+END_ITEM
+START_ITEM(full)
+
+    // A full table rejects new keys, but still replaces and removes.
+    counts_t * table = counts_new(64);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    uint32_t model[KEYS] = { 0 };
+    for (uint64_t key = 0; key < 64; ++key) {
+        ASSERT(!counts_insert(table, key, (uint32_t)key + 1));
+        model[key] = (uint32_t)key + 1;
+    } // Fill the table.
+    ASSERT(counts_insert(table, 64, 1));
+    ASSERT(counts_find(table, 64) == NULL);
+    ASSERT(!counts_insert(table, 10, 99));
+    model[10] = 99;
+    ASSERT(holds(table, model));
+    for (uint64_t key = 0; key < 64; key += 3) {
+        ASSERT(!counts_remove(table, key, NULL));
+        model[key] = 0;
+        if (!holds(table, model)) {
+            FAIL_TEST("after removing key: %zu", (size_t)key);
+        }
+    } // Empty some of the table.
+    counts_delete(table);
+
+END_ITEM
+START_ITEM(types)
+
+    // Each table has its own types, hash, and comparison.
+    names_t * names = names_new(100);
+    ids_t * ids = ids_new(100);
+    ASSERT(names != NULL && ids != NULL); IF_FAIL_STOP;
+    char buffer[] = "carbon";
+    ASSERT(!names_insert(names, "helium", 4));
+    ASSERT(!names_insert(names, "carbon", 12));
+    ASSERT(!ids_insert(ids, 4, 4.0026));
+    size_t * number = names_find(names, buffer);
+    ASSERT(number != NULL && *number == 12); IF_FAIL_STOP;
+    number = names_find(names, "helium");
+    ASSERT(number != NULL); IF_FAIL_STOP;
+    double * weight = ids_find(ids, (uint32_t)*number);
+    ASSERT(weight != NULL && *weight == 4.0026);
+    ASSERT(names_find(names, "neon") == NULL);
+    names_delete(names);
+    ids_delete(ids);
+
+END_ITEM
+
+END_TEST
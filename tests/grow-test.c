@@ -0,0 +1,151 @@
+/**
+ * @file
+ * Test growing tables in place.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+// Every four consecutive keys share a hash, so that the key comparison is
+// exercised.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)((key / 4) * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK,
+    HE4_RANGE_MULTIPLY,
+    HE4_PROBE_TRIANGULAR,
+    HE4_PROBE_DOUBLE,
+    HE4_CONTROL_BYTES,
+    HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR,
+    HE4_ALIGN_LINES,
+    HE4_ALIGN_PAGES | HE4_CONTROL_BYTES,
+    HE4_HUGE_PAGES,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Check that the table holds exactly the keys from 1 to count that are not
+// multiples of seven.
+bool holds(HE4 * table, size_t count) {
+    for (size_t key = 1; key <= count + 100; ++key) {
+        size_t expect = key <= count && key % 7 != 0 ? key + 3 : 0;
+        if (he4_get(table, key, sizeof(size_t)) != expect) return false;
+    } // Check every key.
+    return true;
+}
+
+// Fill a table, grow it a few times, and check it.  Return a description
+// of the first problem found, or NULL.
+const char * exercise(HE4 * table) {
+    size_t count = 0;
+    for (int round = 0; round < 3; ++round) {
+        // Fill the table, and then remove some entries to leave deleted
+        // cells behind.
+        size_t capacity = he4_capacity(table);
+        while (count < capacity) {
+            ++count;
+            if (he4_insert(table, count, sizeof(size_t), count + 3)) {
+                return "fill";
+            }
+        } // Fill the table.
+        for (size_t key = 7; key <= count; key += 7) {
+            he4_discard(table, key, sizeof(size_t));
+        } // Remove some entries.
+        size_t size = he4_size(table);
+        if (!holds(table, count)) return "before growing";
+
+        // Grow the table.
+        if (he4_grow(table, 0)) return "grow";
+        if (he4_capacity(table) < 2 * capacity) return "capacity";
+        if (he4_size(table) != size) return "size";
+        if (he4_deleted(table) != 0) return "deleted";
+        if (!holds(table, count)) return "after growing";
+    } // Grow the table.
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        size_t size = (policies[which] & HE4_HUGE_PAGES) ? 60000 : 1000;
+        HE4 * table = he4_new_policy(size, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        if (table == NULL) {
+            FAIL_TEST("creation with policy: 0x%x", policies[which]);
+        }
+        IF_FAIL_STOP;
+        const char * problem = exercise(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(sizes)
+
+    // Sizes are rounded as for a new table, and smaller sizes do nothing.
+    HE4 * table = he4_new_policy(1000, HE4_RANGE_MASK, hash, compare,
+                                 delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_grow(table, 1000));
+    ASSERT(he4_capacity(table) == 1024);
+    ASSERT(!he4_grow(table, 3000));
+    ASSERT(he4_capacity(table) == 4096);
+    ASSERT(table->mask == 4095);
+    he4_delete(table);
+    table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_grow(table, 1500));
+    ASSERT(he4_capacity(table) == 1500);
+    ASSERT(he4_load(table) == 0.0);
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(rejected)
+
+    // Some tables cannot grow in place.
+    HE4 * table = he4_new_policy(1000, HE4_ROBIN_HOOD, hash, compare,
+                                 delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_grow(table, 0));
+    ASSERT(he4_capacity(table) == 1000);
+    he4_delete(table);
+    table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 16));
+    ASSERT(he4_grow(table, 0));
+    he4_delete(table);
+    ASSERT(he4_grow(NULL, 0));
+
+END_ITEM
+
+END_TEST
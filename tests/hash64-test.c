@@ -0,0 +1,145 @@
+/**
+ * @file
+ * Test the width of the hash, and how a hash is split into a cell index and
+ * a control byte tag.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE char *
+
+#include <string.h>
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 64
+
+// Keys are numbers, and their hashes differ only in the low bits and the top
+// seven bits, which are all the same.  Every key has its own home cell, and
+// every key has the same control byte.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    he4_hash_t number = (he4_hash_t)strtoul(key, NULL, 10);
+    return number | ((he4_hash_t)0x7F << (sizeof(he4_hash_t) * 8 - 7));
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+static char keys[KEYS][4];
+
+START_TEST
+
+    he4_debug = 1;
+    for (size_t number = 0; number < KEYS; ++number) {
+        snprintf(keys[number], 4, "%zu", number);
+    } // Make the keys.
+
+START_ITEM(default)
+
+    // The default hash is XXH3 for 64-bit hashes and XXH32 otherwise, with
+    // the seed of the table.
+    HE4 * table = he4_new(100, NULL, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_seed(table, 0));
+#ifdef HE4_HASH64
+    ASSERT(sizeof(he4_hash_t) == 8);
+    ASSERT(he4_hash_key(table, "abc", 3) == UINT64_C(0x78AF5F94892F3950));
+#else
+    ASSERT(sizeof(he4_hash_t) == 4);
+    ASSERT(he4_hash_key(table, "abc", 3) == 0x32D153FFu);
+#endif // HE4_HASH64
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(split)
+
+    // The cell index comes from the low bits of the hash, and the control
+    // byte from the high bits, so neither gets in the way of the other.
+    HE4 * table = he4_new_policy(1024, HE4_RANGE_MASK | HE4_CONTROL_BYTES,
+                                 hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t number = 0; number < KEYS; ++number) {
+        ASSERT(!he4_insert(table, keys[number], strlen(keys[number]),
+                           keys[number]));
+    } // Insert the keys.
+    for (size_t number = 0; number < KEYS; ++number) {
+        he4_map_t * map = he4_index(table, number);
+        ASSERT(map != NULL); IF_FAIL_STOP;
+        if (map->entry != keys[number]) {
+            FAIL_TEST("key %zu not in its home cell", number);
+        }
+        HE4FREE(map);
+    } // Check that each key is in its home cell.
+
+    // Rehashing reuses the stored hashes, and keeps every key in place.
+    table = he4_rehash(table, 2048);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t number = 0; number < KEYS; ++number) {
+        he4_map_t * map = he4_index(table, number);
+        ASSERT(map != NULL); IF_FAIL_STOP;
+        ASSERT(map->entry == keys[number]);
+        ASSERT(map->hash == hash(keys[number], 0));
+        HE4FREE(map);
+        ASSERT(he4_get(table, keys[number], strlen(keys[number])) ==
+               keys[number]);
+    } // Check each key again.
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(capacity)
+
+    // Multiply-shift reduction covers 2^32 cells with a 32-bit hash, and
+    // 2^57 cells with a 64-bit hash.  Only the sizes are checked, since
+    // tables that large cannot be allocated here.
+    ASSERT(he4_policy_capacity(HE4_MINIMUM_SIZE - 1, HE4_POLICY_DEFAULT) == 0);
+    ASSERT(he4_policy_capacity(100, HE4_RANGE_MASK) == 128);
+    ASSERT(he4_policy_capacity(100, HE4_RANGE_MULTIPLY) == 100);
+#if SIZE_MAX > UINT32_MAX
+    const size_t limit = (size_t)1 << 32;
+    size_t big = he4_best_capacity((size_t)1 << 40);
+    ASSERT(big > limit);
+    ASSERT(he4_policy_capacity(limit, HE4_RANGE_MULTIPLY) == limit);
+    ASSERT(he4_policy_capacity(big, HE4_POLICY_DEFAULT) == big);
+#if defined(HE4_HASH64) && defined(__SIZEOF_INT128__)
+    ASSERT(he4_policy_capacity(big, HE4_RANGE_MULTIPLY) == big);
+    ASSERT(he4_policy_capacity(((size_t)1 << 57) + 1,
+                               HE4_RANGE_MULTIPLY) == 0);
+#else
+    ASSERT(he4_policy_capacity(big, HE4_RANGE_MULTIPLY) == 0);
+#endif // HE4_HASH64
+#endif // SIZE_MAX
+
+END_ITEM
+#if defined(HE4_HASH64) && defined(__SIZEOF_INT128__)
+START_ITEM(multiply)
+
+    // Multiplying uses the bits of a 64-bit hash below the tag, so the tag
+    // does not move keys.
+    HE4 * table = he4_new_policy(1000, HE4_RANGE_MULTIPLY, hash, NULL,
+                                 delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_insert(table, keys[1], 1, keys[1]));
+    ASSERT(!he4_insert(table, keys[2], 1, keys[2]));
+    he4_map_t * map = he4_index(table, 0);
+    ASSERT(map != NULL); IF_FAIL_STOP;
+    ASSERT(map->entry == keys[1]);
+    HE4FREE(map);
+    map = he4_index(table, 1);
+    ASSERT(map != NULL); IF_FAIL_STOP;
+    ASSERT(map->entry == keys[2]);
+    HE4FREE(map);
+    he4_delete(table);
+
+END_ITEM
+#endif // HE4_HASH64
+
+END_TEST
@@ -0,0 +1,147 @@
+/**
+ * @file
+ * Test the operations that take the hash of the key from the caller.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 600
+
+// Count the calls to the hash function.
+static size_t hashes = 0;
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    ++hashes;
+    return (he4_hash_t)(key * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK | HE4_PROBE_TRIANGULAR,
+    HE4_CONTROL_BYTES,
+    HE4_ROBIN_HOOD,
+    HE4_HOPSCOTCH,
+    HE4_CUCKOO,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Exercise the pre-hashed operations on a table without ever calling the
+// hash function.  Return a description of the first problem found, or NULL.
+const char * exercise(HE4 * table) {
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (he4_insert_hashed(table, key, sizeof(size_t), key + 7,
+                              (he4_hash_t)(key * 2654435761u))) {
+            return "insert";
+        }
+    } // Fill the table.
+    for (size_t key = 1; key <= KEYS; key += 3) {
+        he4_hash_t hash = (he4_hash_t)(key * 2654435761u);
+        if (he4_remove_hashed(table, key, sizeof(size_t), hash) != key + 7) {
+            return "remove";
+        }
+        if (!he4_discard_hashed(table, key + 1, sizeof(size_t), hash)) {
+            return "discard with the wrong hash";
+        }
+    } // Remove every third key.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_hash_t hash = (he4_hash_t)(key * 2654435761u);
+        size_t expect = key % 3 == 1 ? 0 : key + 7;
+        if (he4_get_hashed(table, key, sizeof(size_t), hash) != expect) {
+            return "get";
+        }
+        size_t * entry = he4_find_hashed(table, key, sizeof(size_t), hash);
+        if ((entry == NULL) != (expect == 0)) return "find";
+        if (key % 3 == 2 && he4_discard_hashed(table, key, sizeof(size_t),
+                                               hash)) {
+            return "discard";
+        }
+    } // Check every key.
+    if (he4_size(table) != KEYS / 3) return "size";
+    if (hashes != 0) return "hashed a key";
+
+    // Rehashing uses the stored hashes.
+    table = he4_rehash(table, 2000);
+    if (table == NULL) return "rehash";
+    if (hashes != 0) return "rehash hashed a key";
+    for (size_t key = 1; key <= KEYS; ++key) {
+        size_t expect = key % 3 == 0 ? key + 7 : 0;
+        if (he4_get(table, key, sizeof(size_t)) != expect) {
+            return "get after rehash";
+        }
+    } // Check every key.
+    if (hashes != KEYS) return "get did not hash once";
+    he4_delete(table);
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        hashes = 0;
+        const char * problem = exercise(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(tables)
+
+    // One hash serves every table with the same hash function.
+    HE4 * cache = he4_new(100, hash, compare, delete_key, delete_entry);
+    HE4 * routes = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(cache != NULL && routes != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_insert(routes, 42, sizeof(size_t), 99));
+    hashes = 0;
+    he4_hash_t hash = he4_hash_key(routes, 42, sizeof(size_t));
+    ASSERT(hash == (he4_hash_t)((size_t)42 * 2654435761u));
+    ASSERT(he4_get_hashed(cache, 42, sizeof(size_t), hash) == 0);
+    ASSERT(he4_get_hashed(routes, 42, sizeof(size_t), hash) == 99);
+    ASSERT(!he4_insert_hashed(cache, 42, sizeof(size_t), 99, hash));
+    ASSERT(he4_get(cache, 42, sizeof(size_t)) == 99);
+    ASSERT(hashes == 2);
+
+    // Bad arguments.
+    ASSERT(he4_hash_key(NULL, 42, sizeof(size_t)) == 0);
+    ASSERT(he4_hash_key(cache, 42, 0) == 0);
+    ASSERT(he4_insert_hashed(NULL, 42, sizeof(size_t), 99, hash));
+    ASSERT(he4_insert_hashed(cache, 42, 0, 99, hash));
+    ASSERT(he4_get_hashed(NULL, 42, sizeof(size_t), hash) == 0);
+    ASSERT(he4_find_hashed(cache, 42, 0, hash) == NULL);
+    ASSERT(he4_remove_hashed(NULL, 42, sizeof(size_t), hash) == 0);
+    ASSERT(he4_discard_hashed(cache, 42, 0, hash));
+    he4_delete(cache);
+    he4_delete(routes);
+
+END_ITEM
+
+END_TEST
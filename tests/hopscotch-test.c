@@ -0,0 +1,157 @@
+/**
+ * @file
+ * Test tables that use hopscotch hashing.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 1500
+
+// Check that every entry is in the neighborhood of its home cell and has its
+// bit set there, and that no bit is set for any other cell.
+bool valid(HE4 * table) {
+    size_t count = 0;
+    size_t bits = 0;
+    bool ok = true;
+    for (size_t index = 0; ok && index < table->capacity; ++index) {
+        for (uint32_t hops = table->meta[index]; hops != 0; hops &= hops - 1) {
+            ++bits;
+        } // Count the bits.
+        he4_map_t * map = he4_index(table, index);
+        if (map->klen != 0) {
+            ++count;
+            size_t home = map->hash % table->capacity;
+            size_t dist = (index + table->capacity - home) % table->capacity;
+            ok = dist < HE4_HOP_RANGE &&
+                 (table->meta[home] & ((uint32_t)1 << dist)) != 0;
+        }
+        HE4FREE(map);
+    } // Check every cell.
+    return ok && count == he4_size(table) && bits == count;
+}
+
+START_TEST
+
+    he4_debug = 1;
+    size_t model[KEYS + 1] = { 0 };
+    HE4 * table = he4_new_policy(1000, HE4_HOPSCOTCH, group_hash, compare,
+                                 delete_key, delete_entry);
+
+START_ITEM(basics)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->meta != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1000); IF_FAIL_STOP;
+    ASSERT(he4_size(table) == 0); IF_FAIL_STOP;
+    ASSERT(he4_new_policy(1000, HE4_HOPSCOTCH | HE4_CONTROL_BYTES, group_hash,
+                          compare, delete_key, delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_HOPSCOTCH | HE4_ROBIN_HOOD, group_hash,
+                          compare, delete_key, delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_HOPSCOTCH | HE4_PROBE_DOUBLE, group_hash,
+                          compare, delete_key, delete_entry) == NULL);
+
+END_ITEM
+START_ITEM(fill)
+
+    // Fill the table until an insertion fails.  That must not happen until
+    // the table is nearly full.
+    size_t key = 1;
+    for (; key <= KEYS; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) break;
+        model[key] = key + 7;
+    } // Fill the table.
+    ASSERT(he4_load(table) >= 0.9);
+    ASSERT(he4_get(table, key, sizeof(size_t)) == 0);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t check = 1; check < key; ++check) {
+        if (he4_get(table, check, sizeof(size_t)) != check + 7) {
+            FAIL_TEST("missing key: %zu", check);
+        }
+    } // Check the table.
+
+END_ITEM
+START_ITEM(churn)
+
+    // Apply random operations and check against a simple model.  An
+    // insertion may only fail if the table is nearly full.
+    const char * problem = churn(table, model, KEYS, 200000, 0.9, valid);
+    if (problem != NULL) {
+        FAIL_TEST("%s", problem);
+    }
+
+END_ITEM
+START_ITEM(force)
+
+    // Fill the table as far as it goes, then force in new keys.  Each must
+    // be found afterward, and must replace exactly one entry.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (!he4_insert(table, key, sizeof(size_t), key)) model[key] = key;
+    } // Fill the table.
+    for (size_t key = KEYS + 1; key <= KEYS + 100; ++key) {
+        size_t size = he4_size(table);
+        if (he4_force_insert(table, key, sizeof(size_t), 99)) {
+            ASSERT(he4_size(table) == size);
+        } else {
+            ASSERT(he4_size(table) == size + 1);
+        }
+        if (he4_get(table, key, sizeof(size_t)) != 99) {
+            FAIL_TEST("missing forced key: %zu", key);
+        }
+    } // Force in new keys.
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        ASSERT(entry == 0 || entry == model[key]);
+        model[key] = entry;
+    } // Check every key.
+    for (size_t key = KEYS + 1; key <= KEYS + 100; ++key) {
+        he4_discard(table, key, sizeof(size_t));
+    } // Discard the forced keys.
+
+END_ITEM
+START_ITEM(trim)
+
+    // Trim half the entries, then check what is left.
+    size_t threshold = he4_max_touch(table) - he4_size(table) / 2;
+    size_t kept = 0;
+    for (size_t index = 0; index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->klen != 0 && map->touch >= threshold) ++kept;
+        HE4FREE(map);
+    } // Count the entries to keep.
+    he4_trim(table, threshold);
+    ASSERT(he4_size(table) == kept);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        ASSERT(entry == 0 || entry == model[key]);
+    } // Check every key.
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Rehashing preserves the policy.
+    size_t size = he4_size(table);
+    table = he4_rehash(table, 4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->policy == HE4_HOPSCOTCH);
+    ASSERT(he4_size(table) == size);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+
+END_ITEM
+
+    // Done.
+    he4_delete(table);
+
+END_TEST
@@ -0,0 +1,159 @@
+/**
+ * @file
+ * Test tables with short and long string keys, which are stored inline if
+ * HE4_INLINE_KEYS is defined.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE size_t
+
+#include <string.h>
+#include "test-table.h"
+#include <he4.h>
+
+#define KEYS 1000
+
+// Count the keys deallocated by the table.
+static size_t deleted = 0;
+void delete_key(he4_key_t key) {
+    ++deleted;
+    free(key);
+}
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+
+// Make the key for a number.  Even numbers get short keys, and odd numbers
+// get long keys.
+size_t make_key(char * buffer, size_t number) {
+    if (number % 2 == 0) return (size_t)sprintf(buffer, "k%zu", number);
+    return (size_t)sprintf(buffer, "a rather longer key that is kept by "
+                           "pointer, number %zu", number);
+}
+
+START_TEST
+
+    he4_debug = 1;
+    char buffer[100];
+    size_t owned = 0;
+    size_t removed = 0;
+    HE4 * table = he4_new(2000, NULL, NULL, delete_key, delete_entry);
+
+START_ITEM(insert)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t number = 0; number < KEYS; ++number) {
+        size_t klen = make_key(buffer, number);
+        char * key = buffer;
+        if (OWNED(klen)) {
+            // Only keys the table keeps a pointer to need a copy.
+            key = malloc(klen);
+            ASSERT(key != NULL); IF_FAIL_STOP;
+            memcpy(key, buffer, klen);
+            ++owned;
+        }
+        if (he4_insert(table, key, klen, number + 1)) {
+            FAIL_TEST("insertion of key: %zu", number);
+        }
+    } // Insert the keys.
+    for (size_t number = 0; number < KEYS; ++number) {
+        size_t klen = make_key(buffer, number);
+        if (he4_get(table, buffer, klen) != number + 1) {
+            FAIL_TEST("missing key: %zu", number);
+        }
+    } // Check the keys.
+    ASSERT(deleted == 0);
+
+END_ITEM
+START_ITEM(index)
+
+    // The mappings must show every key, and short keys must also be copied
+    // into the cell.
+    size_t found = 0;
+    for (size_t index = 0; index < he4_capacity(table); ++index) {
+        he4_map_t * map = he4_index(table, index);
+        ASSERT(map != NULL); IF_FAIL_STOP;
+        if (map->key != NULL && map->entry != 0) {
+            size_t klen = make_key(buffer, map->entry - 1);
+            ASSERT(map->klen == klen);
+            ASSERT(memcmp(map->key, buffer, klen) == 0);
+#ifdef HE4_INLINE_KEYS
+            if (klen <= HE4_INLINE_KEYS) {
+                // The key of the mapping is the copy in the mapping.
+                ASSERT(map->key == (char *)map->ikey);
+            }
+#endif // HE4_INLINE_KEYS
+            ++found;
+        }
+        HE4FREE(map);
+    } // Check every cell.
+    ASSERT(found == KEYS);
+
+END_ITEM
+START_ITEM(remove)
+
+    // Only the keys the table owns are deallocated.
+    for (size_t number = 0; number < KEYS; number += 3) {
+        size_t klen = make_key(buffer, number);
+        ASSERT(!he4_discard(table, buffer, klen));
+        if (OWNED(klen)) ++removed;
+    } // Remove some keys.
+    ASSERT(deleted == removed);
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Rehashing moves the keys, but does not deallocate any.
+    table = he4_rehash(table, 4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t number = 0; number < KEYS; ++number) {
+        size_t klen = make_key(buffer, number);
+        size_t entry = number % 3 == 0 ? 0 : number + 1;
+        if (he4_get(table, buffer, klen) != entry) {
+            FAIL_TEST("wrong entry for key: %zu", number);
+        }
+    } // Check the keys.
+    ASSERT(deleted == removed);
+
+END_ITEM
+START_ITEM(borrowed)
+
+    // A key found or inserted from a reused buffer needs a copy only if it
+    // is not stored inline.
+    for (size_t number = KEYS; number < KEYS + 10; ++number) {
+        size_t klen = make_key(buffer, number);
+        bool inserted = false;
+        size_t * entry = he4_find_or_insert(table, buffer, klen, &inserted);
+        ASSERT(entry != NULL); IF_FAIL_STOP;
+        ASSERT(inserted);
+        *entry = number + 1;
+        if (OWNED(klen)) {
+            char * key = malloc(klen);
+            ASSERT(key != NULL); IF_FAIL_STOP;
+            memcpy(key, buffer, klen);
+            ASSERT(!he4_set_key(table, entry, key));
+            ++owned;
+        }
+        memset(buffer, 'x', sizeof(buffer));
+    } // Insert from the buffer.
+    for (size_t number = KEYS; number < KEYS + 10; ++number) {
+        size_t klen = make_key(buffer, number);
+        ASSERT(he4_get(table, buffer, klen) == number + 1);
+    } // Check the keys.
+
+END_ITEM
+
+    // Done.  Deleting the table deallocates the remaining keys it owns.
+    he4_delete(table);
+    ASSERT(deleted == owned);
+
+END_TEST
@@ -16,7 +16,7 @@
 #define HE4_KEY_TYPE char *
 #define HE4_ENTRY_TYPE char *
 
-#include "test-frame.h"
+#include "test-table.h"
 #include <string.h>
 #include <he4.h>
 
@@ -84,12 +84,14 @@ START_ITEM(fill)
     // Insert data to fill the table.  The data is generated by combining
     // words from the list.
     for (size_t index = 1; index <= 1024; ++index) {
-        // These go in the table, so we do not deallocate them.
+        // These go in the table, so we do not deallocate them, unless the
+        // key was copied into the cell.
         he4_key_t key = (he4_key_t) num_to_word(index);
         he4_entry_t entry = (he4_entry_t) num_to_word(index + 7);
         if (he4_insert(table, key, strlen_n(key), entry)) {
             FAIL_TEST("insertion at key: %s", key);
         }
+        if (!OWNED(strlen_n(key))) free(key);
         ASSERT(he4_capacity(table) == 1024); IF_FAIL_STOP;
         ASSERT(he4_size(table) == index); IF_FAIL_STOP;
     } // Fill the table.
@@ -146,7 +148,8 @@ START_ITEM(force)
 
     // Force insert some items.  The table is full, so these will overwrite.
     for (size_t index = 2048; index < 3072; ++index) {
-        // These go in the table, so we do not deallocate them.
+        // These go in the table, so we do not deallocate them, unless the
+        // key was copied into the cell.
         he4_key_t key = (he4_key_t) num_to_word(index);
         he4_entry_t entry = (he4_entry_t) num_to_word(index + 7);
         if (!he4_force_insert(table, key, strlen_n(key), entry)) {
@@ -160,6 +163,7 @@ START_ITEM(force)
         if (strcmp(entry2, entry) != 0) {
             FAIL_ITEM("missing forced entry for key: %s", key);
         }
+        if (!OWNED(strlen_n(key))) free(key);
     } // Test over-filling.
     ASSERT(he4_capacity(table) == 1024); IF_FAIL_STOP;
     ASSERT(he4_size(table) == 1024); IF_FAIL_STOP;
@@ -0,0 +1,97 @@
+/**
+ * @file
+ * Test that the batch functions hash keys exactly as the default hash does,
+ * however many keys they hash at once.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 400
+
+// Keys of every length up to 80 bytes, each allocated to its exact length so
+// that reading past the end is caught by the address sanitizer.
+static char * keys[KEYS];
+static size_t klens[KEYS];
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+START_TEST
+
+    he4_debug = 1;
+    size_t state = 12345;
+    for (size_t at = 0; at < KEYS; ++at) {
+        klens[at] = at % 80 + 1;
+        keys[at] = HE4MALLOC(char, klens[at]);
+        for (size_t byte = 0; byte < klens[at]; ++byte) {
+            state = state * 6364136223846793005u + 1442695040888963407u;
+            keys[at][byte] = (char)(state >> 56);
+        } // Fill the key.
+    } // Make the keys.
+
+START_ITEM(get_many)
+
+    // Insert half of the keys, hashing one at a time, and then look up all
+    // of them together.
+    HE4 * table = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t at = 0; at < KEYS; at += 2) {
+        ASSERT(!he4_insert(table, keys[at], klens[at], at + 1));
+    } // Insert half the keys.
+    size_t out[KEYS];
+    ASSERT(he4_get_many(table, keys, klens, KEYS, out) == KEYS / 2);
+    for (size_t at = 0; at < KEYS; ++at) {
+        if (out[at] != (at % 2 == 0 ? at + 1 : 0)) {
+            FAIL_TEST("wrong entry for key of length: %zu", klens[at]);
+        }
+    } // Check every key.
+
+    // Missing keys in a batch do not disturb the others.
+    char * some[8] = { keys[0], NULL, keys[2], keys[4], NULL, keys[6],
+                       keys[8], keys[10] };
+    size_t some_klens[8] = { klens[0], 5, klens[2], 0, 0, klens[6],
+                             klens[8], klens[10] };
+    ASSERT(he4_get_many(table, some, some_klens, 8, out) == 5);
+    ASSERT(out[0] == 1 && out[1] == 0 && out[3] == 0 && out[7] == 11);
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(apply_batch)
+
+    // Insert the keys together, and then look each up by itself.
+    HE4 * table = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    he4_op_t ops[KEYS];
+    for (size_t at = 0; at < KEYS; ++at) {
+        ops[at].kind = HE4_OP_INSERT;
+        ops[at].key = keys[at];
+        ops[at].klen = klens[at];
+        ops[at].entry = at + 1;
+    } // Make the operations.
+    ASSERT(!he4_apply_batch(table, ops, KEYS));
+    ASSERT(he4_size(table) == KEYS);
+    for (size_t at = 0; at < KEYS; ++at) {
+        if (he4_get(table, keys[at], klens[at]) != at + 1) {
+            FAIL_TEST("wrong entry for key of length: %zu", klens[at]);
+        }
+    } // Check every key.
+    he4_delete(table);
+
+END_ITEM
+
+    for (size_t at = 0; at < KEYS; ++at) HE4FREE(keys[at]);
+
+END_TEST
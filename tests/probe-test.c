@@ -0,0 +1,137 @@
+/**
+ * @file
+ * Test the probe sequences selected by the table policy.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 1500
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK,
+    HE4_RANGE_MULTIPLY,
+    HE4_PROBE_TRIANGULAR,
+    HE4_PROBE_DOUBLE,
+    HE4_PROBE_TRIANGULAR | HE4_RANGE_MULTIPLY,
+    HE4_CONTROL_BYTES | HE4_RANGE_MASK,
+    HE4_CONTROL_BYTES | HE4_RANGE_MULTIPLY,
+    HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR,
+    HE4_CONTROL_BYTES | HE4_PROBE_DOUBLE,
+    HE4_ROBIN_HOOD | HE4_RANGE_MASK,
+    HE4_ROBIN_HOOD | HE4_RANGE_MULTIPLY,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Fill a table completely, then churn it against a model.  Return a
+// description of the first problem found, or NULL.
+const char * exercise(HE4 * table) {
+    size_t model[KEYS + 1] = { 0 };
+    size_t capacity = he4_capacity(table);
+    for (size_t key = 1; key <= capacity; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) return "fill";
+        model[key] = key + 7;
+    } // Fill the table.
+    if (!he4_insert(table, capacity + 1, sizeof(size_t), 1)) return "full";
+    for (size_t key = 1; key <= capacity; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != key + 7) return "missing";
+    } // Check the table.
+    const char * problem = churn(table, model, KEYS, 50000, 1.0, NULL);
+    if (problem != NULL) return problem;
+    he4_trim(table, 0);
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != model[key]) return "trim";
+    } // Check every key.
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(capacity)
+
+    // Power of two policies round the capacity up.
+    HE4 * table = he4_new_policy(1000, HE4_RANGE_MASK, group_hash, compare,
+                                 delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1024);
+    he4_delete(table);
+    table = he4_new_policy(1000, HE4_RANGE_MULTIPLY, group_hash, compare,
+                           delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1000);
+    he4_delete(table);
+    table = he4_new_policy(1024, HE4_PROBE_DOUBLE, group_hash, compare,
+                           delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1024);
+    he4_delete(table);
+
+    // Some combinations are not allowed.
+    ASSERT(he4_new_policy(1000, HE4_ROBIN_HOOD | HE4_PROBE_TRIANGULAR,
+                          group_hash, compare, delete_key,
+                          delete_entry) == NULL);
+    ASSERT(he4_new_policy(1000, HE4_PROBE_TRIANGULAR | HE4_PROBE_DOUBLE,
+                          group_hash, compare, delete_key,
+                          delete_entry) == NULL);
+
+END_ITEM
+START_ITEM(policies)
+
+    // Every policy must reach every cell, and must agree with the model.
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], group_hash, compare,
+                                     delete_key, delete_entry);
+        if (table == NULL) {
+            FAIL_TEST("creation with policy: 0x%x", policies[which]);
+        }
+        const char * problem = exercise(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Switch a table from one policy to another.
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t key = 1; key <= 1000; ++key) {
+        he4_insert(table, key, sizeof(size_t), key + 7);
+    } // Fill the table.
+    ASSERT(he4_rehash_policy(table, 1000, HE4_POLICY_DEFAULT) == table);
+    table = he4_rehash_policy(table, 1000,
+                              HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->policy == (HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR));
+    ASSERT(he4_capacity(table) == 1024);
+    ASSERT(he4_size(table) == 1000);
+    table = he4_rehash(table, 0);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 2048);
+    ASSERT(table->policy == (HE4_CONTROL_BYTES | HE4_PROBE_TRIANGULAR));
+    for (size_t key = 1; key <= 1000; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != key + 7) {
+            FAIL_TEST("missing key: %zu", key);
+        }
+    } // Check the table.
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
@@ -0,0 +1,171 @@
+/**
+ * @file
+ * Test incremental rehashing.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 3000
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK,
+    HE4_PROBE_TRIANGULAR,
+    HE4_PROBE_DOUBLE,
+    HE4_CONTROL_BYTES,
+    HE4_ROBIN_HOOD,
+    HE4_ALIGN_PAGES | HE4_CONTROL_BYTES,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Check the table against the model.
+bool agrees(HE4 * table, size_t * model) {
+    size_t size = 0;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != model[key]) return false;
+        if (model[key] != 0) ++size;
+    } // Check every key.
+    return he4_size(table) == size;
+}
+
+// Fill a table, rehash it incrementally while churning it against a model,
+// and check it.  Return a description of the first problem found, or NULL.
+const char * exercise(HE4 * table) {
+    size_t model[KEYS + 1] = { 0 };
+    for (size_t key = 1; key <= 700; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 3)) return "fill";
+        model[key] = key + 3;
+    } // Fill the table.
+    size_t capacity = he4_capacity(table);
+    if (he4_rehash_begin(table, 0)) return "begin";
+    if (table->old == NULL) return "no migration";
+    if (he4_capacity(table) < 2 * capacity) return "capacity";
+    if (he4_rehash_step(table, 0) != capacity) return "progress";
+    if (!agrees(table, model)) return "after begin";
+
+    // Churn the table while it migrates.
+    size_t left = capacity;
+    while (table->old != NULL) {
+        size_t key = next(KEYS) + 1;
+        size_t entry = next(100000) + 1;
+        if (next(3) != 0) {
+            if (he4_insert(table, key, sizeof(size_t), entry)) {
+                return "insert";
+            }
+            model[key] = entry;
+        } else {
+            if (he4_remove(table, key, sizeof(size_t)) != model[key]) {
+                return "remove";
+            }
+            model[key] = 0;
+        }
+        if (he4_rehash_step(table, 0) > left) return "no progress";
+        left = he4_rehash_step(table, 0);
+        key = next(KEYS) + 1;
+        if (he4_get(table, key, sizeof(size_t)) != model[key]) return "get";
+    } // Churn the table.
+    if (!agrees(table, model)) return "after migration";
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], group_hash, compare,
+                                     delete_key, delete_entry);
+        if (table == NULL) {
+            FAIL_TEST("creation with policy: 0x%x", policies[which]);
+        }
+        IF_FAIL_STOP;
+        const char * problem = exercise(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(step)
+
+    // Explicit steps finish the migration, and searches see both arrays.
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t key = 1; key <= 600; ++key) {
+        ASSERT(!he4_insert(table, key, sizeof(size_t), key));
+    } // Fill the table.
+    ASSERT(!he4_rehash_begin(table, 4000));
+    ASSERT(he4_capacity(table) == 4000);
+    ASSERT(he4_rehash_step(table, 100) == 900);
+    for (size_t key = 1; key <= 600; ++key) {
+        if (*he4_find(table, key, sizeof(size_t)) != key) {
+            FAIL_TEST("wrong entry for key: %zu", key);
+        }
+    } // Check every key.
+    ASSERT(he4_size(table) == 600);
+    while (he4_rehash_step(table, 50) != 0) {}
+    ASSERT(table->old == NULL);
+    ASSERT(he4_size(table) == 600);
+    ASSERT(he4_rehash_step(table, 50) == 0);
+
+    // Walking the table finishes the migration.
+    ASSERT(!he4_rehash_begin(table, 0));
+    ASSERT(table->old != NULL);
+    ASSERT(he4_size(table) == 600);
+    size_t found = 0;
+    for (size_t index = 0; index < he4_capacity(table); ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->klen != 0 && map->key != 0) ++found;
+        HE4FREE(map);
+    } // Count the entries.
+    ASSERT(table->old == NULL);
+    ASSERT(found == 600);
+
+    // Deleting a table during the migration frees every key once.
+    ASSERT(!he4_rehash_begin(table, 0));
+    ASSERT(he4_rehash_step(table, 1000) != 0);
+    deleted_keys = 0;
+    he4_delete(table);
+    ASSERT(deleted_keys == 600);
+
+END_ITEM
+START_ITEM(rejected)
+
+    // Sizes that are not larger do nothing.
+    HE4 * table = he4_new(1000, group_hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_rehash_begin(table, 1000));
+    ASSERT(table->old == NULL);
+    ASSERT(he4_capacity(table) == 1000);
+
+    // Tables with a probe limit cannot be rehashed incrementally.
+    ASSERT(!he4_set_probe_limit(table, 16));
+    ASSERT(he4_rehash_begin(table, 0));
+    he4_delete(table);
+    table = he4_new_policy(1000, HE4_HOPSCOTCH, group_hash, compare, delete_key,
+                           delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_rehash_begin(table, 0));
+    ASSERT(he4_capacity(table) == 1000);
+    he4_delete(table);
+    ASSERT(he4_rehash_begin(NULL, 0));
+    ASSERT(he4_rehash_step(NULL, 10) == 0);
+
+END_ITEM
+
+END_TEST
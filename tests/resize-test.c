@@ -0,0 +1,233 @@
+/**
+ * @file
+ * Test shrinking tables, and resizing them automatically.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 5000
+
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)(key * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK,
+    HE4_CONTROL_BYTES,
+    HE4_ROBIN_HOOD,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Check that the table holds exactly the keys from first to last.
+bool holds(HE4 * table, size_t first, size_t last) {
+    for (size_t key = 1; key <= KEYS; ++key) {
+        size_t expect = key >= first && key <= last ? key + 7 : 0;
+        if (he4_get(table, key, sizeof(size_t)) != expect) return false;
+    } // Check every key.
+    return he4_size(table) == (last >= first ? last - first + 1 : 0);
+}
+
+// Grow a table by inserting, and shrink it by removing, checking the load
+// as it goes.  Return a description of the first problem found, or NULL.
+const char * exercise(HE4 * table) {
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) return "insert";
+        if (table->old == NULL && he4_load(table) > 0.7) return "high load";
+    } // Fill the table.
+    if (he4_capacity(table) < KEYS) return "did not grow";
+    if (!holds(table, 1, KEYS)) return "after growing";
+    size_t peak = he4_capacity(table);
+    for (size_t key = 1; key <= KEYS - 100; ++key) {
+        if (he4_remove(table, key, sizeof(size_t)) != key + 7) {
+            return "remove";
+        }
+    } // Empty most of the table.
+    while (he4_rehash_step(table, 1000) != 0) {}
+    if (he4_capacity(table) != peak) return "resized on removal";
+
+    // Each insertion halves the table until the load is above the low mark.
+    for (size_t round = 0; round < 8; ++round) {
+        if (he4_insert(table, 1, sizeof(size_t), 8)) return "insert";
+        if (he4_remove(table, 1, sizeof(size_t)) != 8) return "remove";
+        while (he4_rehash_step(table, 1000) != 0) {}
+    } // Shrink the table.
+    if (he4_capacity(table) >= peak / 8) return "did not shrink";
+    if (!holds(table, KEYS - 99, KEYS)) return "after shrinking";
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(shrink)
+
+    // Trimming can make a table smaller, if the entries kept fit.
+    HE4 * table = he4_new(4000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t key = 1; key <= 500; ++key) {
+        ASSERT(!he4_insert(table, key, sizeof(size_t), key + 7));
+    } // Fill the table.
+    table = he4_trim_and_rehash(table, 300, 101);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 4000);
+    table = he4_trim_and_rehash(table, 400, 100);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 400);
+    ASSERT(holds(table, 201, 500));
+
+    // So can rehashing, but not too small.
+    table = he4_rehash(table, 2000);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_rehash(table, 200) == table);
+    table = he4_rehash(table, 400);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 400);
+    ASSERT(holds(table, 201, 500));
+
+    // So can an incremental rehash, and sizes below the minimum are raised.
+    for (size_t key = 201; key <= 480; ++key) {
+        ASSERT(he4_remove(table, key, sizeof(size_t)) == key + 7);
+    } // Empty most of the table.
+    ASSERT(!he4_rehash_begin(table, 10));
+    ASSERT(he4_capacity(table) == HE4_MINIMUM_SIZE);
+    ASSERT(holds(table, 481, 500));
+    ASSERT(he4_rehash_step(table, 1000) == 0);
+    ASSERT(holds(table, 481, 500));
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(settings)
+
+    HE4 * table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->high_load == 0.0);
+    ASSERT(he4_set_auto_resize(table, 0.4, 0.7, 0));
+    ASSERT(he4_set_auto_resize(table, 0.2, 1.0, 0));
+    ASSERT(he4_set_auto_resize(table, -0.1, 0.7, 0));
+    ASSERT(he4_set_auto_resize(table, 0.2, 0.7, 8));
+    ASSERT(he4_set_auto_resize(NULL, 0.2, 0.7, 0));
+    ASSERT(table->high_load == 0.0);
+    ASSERT(!he4_set_auto_resize(table, 0.2, 0.7, 0));
+    ASSERT(table->high_load == 0.7);
+    table = he4_rehash(table, 2000);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->low_load == 0.2);
+    ASSERT(table->high_load == 0.7);
+    ASSERT(!he4_set_auto_resize(table, 0.0, 0.0, 0));
+    ASSERT(table->high_load == 0.0);
+    he4_delete(table);
+    table = he4_new_policy(1000, HE4_CUCKOO, hash, compare, delete_key,
+                           delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_set_auto_resize(table, 0.2, 0.7, 0));
+    he4_delete(table);
+
+    // Without automatic resizing the table fills up.
+    table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    size_t key = 1;
+    while (!he4_insert(table, key, sizeof(size_t), key + 7)) ++key;
+    ASSERT(key == 1001);
+    ASSERT(he4_capacity(table) == 1000);
+    ASSERT(table->old == NULL);
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(!he4_set_auto_resize(table, 0.2, 0.7, 0));
+        const char * problem = exercise(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(walk)
+
+    // Removals never resize, so every entry can be removed while walking
+    // the table by index.
+    he4_policy_t walked[] = { HE4_POLICY_DEFAULT, HE4_CONTROL_BYTES };
+    for (size_t which = 0; which < 2; ++which) {
+        HE4 * table = he4_new_policy(1000, walked[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(!he4_set_auto_resize(table, 0.2, 0.7, 0));
+        for (size_t key = 1; key <= KEYS; ++key) {
+            ASSERT(!he4_insert(table, key, sizeof(size_t), key + 7));
+        } // Fill the table.
+        size_t capacity = he4_capacity(table);
+        size_t removed = 0;
+        for (size_t index = 0; index < he4_capacity(table); ++index) {
+            he4_map_t * map = he4_index(table, index);
+            ASSERT(map != NULL); IF_FAIL_STOP;
+            if (map->key != 0 && map->entry == map->key + 7) {
+                if (he4_remove(table, map->key, map->klen) != map->entry) {
+                    FAIL_TEST("remove at index %zu", index);
+                }
+                ++removed;
+            }
+            HE4FREE(map);
+            ASSERT(he4_capacity(table) == capacity); IF_FAIL_STOP;
+        } // Remove every entry while walking.
+        ASSERT(removed == KEYS);
+        ASSERT(holds(table, 1, 0));
+        ASSERT(!he4_insert(table, 1, sizeof(size_t), 8));
+        while (he4_rehash_step(table, 1000) != 0) {}
+        ASSERT(he4_capacity(table) < capacity);
+        ASSERT(holds(table, 1, 1));
+        he4_delete(table);
+    } // Try each policy.
+
+END_ITEM
+START_ITEM(limit)
+
+    // The old and new arrays must fit within the limit together, so a
+    // table of 1000 cells can grow to 2000 cells within 3000 cells, but no
+    // further.
+    size_t bytes = sizeof(HE4);
+    while (he4_best_capacity(bytes) < 3000) bytes += 8;
+    HE4 * table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_auto_resize(table, 0.2, 0.7, bytes));
+    ASSERT(table->max_cells == 3000);
+    size_t key = 1;
+    while (!he4_insert(table, key, sizeof(size_t), key + 7)) ++key;
+    ASSERT(he4_capacity(table) == 2000);
+    ASSERT(key == 2001);
+    ASSERT(holds(table, 1, 2000));
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
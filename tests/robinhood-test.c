@@ -0,0 +1,151 @@
+/**
+ * @file
+ * Test tables that use Robin Hood insertion.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define KEYS 1500
+
+// Check that the table has no deleted cells, that every probe distance is
+// correct, and that no entry is further from its start than the entry
+// following it is from its own start, plus one.
+bool valid(HE4 * table) {
+    size_t count = 0;
+    bool ok = true;
+    for (size_t index = 0; ok && index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (table->meta[index] == 0) {
+            ok = map->klen == 0 && map->key == 0;
+            HE4FREE(map);
+            continue;
+        }
+        ++count;
+        size_t start = map->hash % table->capacity;
+        size_t dist = (index + table->capacity - start) % table->capacity;
+        size_t next = (index + 1) % table->capacity;
+        ok = table->meta[index] == dist + 1 &&
+             table->meta[next] <= table->meta[index] + 1;
+        HE4FREE(map);
+    } // Check every cell.
+    return ok && count == he4_size(table);
+}
+
+START_TEST
+
+    he4_debug = 1;
+    size_t model[KEYS + 1] = { 0 };
+    HE4 * table = he4_new_policy(1000, HE4_ROBIN_HOOD, group_hash, compare,
+                                 delete_key, delete_entry);
+
+START_ITEM(basics)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->meta != NULL); IF_FAIL_STOP;
+    ASSERT(he4_capacity(table) == 1000); IF_FAIL_STOP;
+    ASSERT(he4_size(table) == 0); IF_FAIL_STOP;
+    ASSERT(he4_new_policy(1000, HE4_ROBIN_HOOD | HE4_CONTROL_BYTES, group_hash,
+                          compare, delete_key, delete_entry) == NULL);
+
+END_ITEM
+START_ITEM(fill)
+
+    // Fill the table completely.
+    for (size_t key = 1; key <= 1000; ++key) {
+        if (he4_insert(table, key, sizeof(size_t), key + 7)) {
+            FAIL_TEST("insertion at key: %zu", key);
+        }
+        model[key] = key + 7;
+    } // Fill the table.
+    ASSERT(he4_load(table) == 1.0);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    ASSERT(he4_insert(table, 1001, sizeof(size_t), 1));
+    ASSERT(he4_get(table, 1001, sizeof(size_t)) == 0);
+    for (size_t key = 1; key <= 1000; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != key + 7) {
+            FAIL_TEST("missing key: %zu", key);
+        }
+    } // Check the table.
+
+END_ITEM
+START_ITEM(churn)
+
+    // Apply random operations and check against a simple model.
+    const char * problem = churn(table, model, KEYS, 200000, 1.0, valid);
+    if (problem != NULL) {
+        FAIL_TEST("%s", problem);
+    }
+
+END_ITEM
+START_ITEM(force)
+
+    // Fill the table, then force in a new key.  The least-recently-used
+    // entry must be the one discarded.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (!he4_insert(table, key, sizeof(size_t), key)) model[key] = key;
+    } // Fill the table.
+    ASSERT(he4_size(table) == he4_capacity(table)); IF_FAIL_STOP;
+    size_t lru = 0, lru_touch = SIZE_MAX;
+    for (size_t index = 0; index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->touch < lru_touch) {
+            lru_touch = map->touch;
+            lru = map->key;
+        }
+        HE4FREE(map);
+    } // Find the least-recently-used entry.
+    ASSERT(he4_force_insert(table, KEYS + 1, sizeof(size_t), 99));
+    ASSERT(he4_size(table) == he4_capacity(table));
+    ASSERT(he4_get(table, KEYS + 1, sizeof(size_t)) == 99);
+    ASSERT(he4_get(table, lru, sizeof(size_t)) == 0);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    he4_discard(table, KEYS + 1, sizeof(size_t));
+    model[lru] = 0;
+
+END_ITEM
+START_ITEM(trim)
+
+    // Trim half the entries, then check what is left.
+    size_t threshold = he4_max_touch(table) - he4_size(table) / 2;
+    size_t kept = 0;
+    for (size_t index = 0; index < table->capacity; ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (table->meta[index] != 0 && map->touch >= threshold) ++kept;
+        HE4FREE(map);
+    } // Count the entries to keep.
+    he4_trim(table, threshold);
+    ASSERT(he4_size(table) == kept);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        ASSERT(entry == 0 || entry == model[key]);
+    } // Check every key.
+
+END_ITEM
+START_ITEM(rehash)
+
+    // Rehashing preserves the policy.
+    size_t size = he4_size(table);
+    table = he4_rehash(table, 4096);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->policy == HE4_ROBIN_HOOD);
+    ASSERT(he4_size(table) == size);
+    ASSERT(valid(table)); IF_FAIL_STOP;
+
+END_ITEM
+
+    // Done.
+    he4_delete(table);
+
+END_TEST
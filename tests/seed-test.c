@@ -0,0 +1,237 @@
+/**
+ * @file
+ * Test the per-table seed of the default hash, and the guard against hash
+ * flooding.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE char *
+
+#include <string.h>
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 100
+#define WORDS 500
+
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)strtoul(key, NULL, 10);
+}
+
+// Keys that all have the same home cell in a table of 1024 cells with seed
+// zero, and ordinary keys.
+static char keys[KEYS][16];
+static char words[WORDS][16];
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_RANGE_MASK,
+    HE4_RANGE_MASK | HE4_PROBE_TRIANGULAR,
+    HE4_RANGE_MASK | HE4_CONTROL_BYTES,
+    HE4_RANGE_MASK | HE4_ROBIN_HOOD,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Check that a table holds every one of a set of keys, stored with the hash
+// the table now gives it.
+bool holds(HE4 * table, char set[][16], size_t count) {
+    for (size_t index = 0; index < he4_capacity(table); ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map == NULL) return false;
+        bool good = map->klen == 0 ||
+                    map->hash == he4_hash_key(table, map->key, map->klen);
+        HE4FREE(map);
+        if (!good) return false;
+    } // Check the stored hashes.
+    for (size_t number = 0; number < count; ++number) {
+        if (he4_get(table, set[number], strlen(set[number])) != set[number]) {
+            return false;
+        }
+    } // Check every key.
+    return he4_size(table) == count;
+}
+
+// Count the home cells of the keys in a table of 1024 cells.
+size_t homes(HE4 * table) {
+    bool seen[1024] = { false };
+    size_t count = 0;
+    for (size_t number = 0; number < KEYS; ++number) {
+        size_t home = (size_t)(he4_hash_key(table, keys[number],
+                                            strlen(keys[number])) & 1023);
+        if (!seen[home]) ++count;
+        seen[home] = true;
+    } // Find each home cell.
+    return count;
+}
+
+START_TEST
+
+    he4_debug = 1;
+    HE4 * table = he4_new_policy(1024, HE4_RANGE_MASK, NULL, NULL,
+                                 delete_key, delete_entry);
+    if (table == NULL || he4_set_seed(table, 0)) {
+        FAIL_TEST("unable to make the table");
+    }
+    he4_hash_t home = he4_hash_key(table, "0", 1) & 1023;
+    size_t found = 0;
+    for (size_t number = 0; found < KEYS; ++number) {
+        char buffer[16];
+        size_t len = (size_t)snprintf(buffer, sizeof(buffer), "%zu", number);
+        if ((he4_hash_key(table, buffer, len) & 1023) != home) continue;
+        memcpy(keys[found++], buffer, len + 1);
+    } // Find keys with the same home cell.
+    he4_delete(table);
+    for (size_t number = 0; number < WORDS; ++number) {
+        snprintf(words[number], 16, "w%zu", number);
+    } // Make the ordinary keys.
+
+START_ITEM(seeds)
+
+    // Every table gets its own seed, which rehashing keeps.
+    HE4 * first = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    HE4 * second = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    ASSERT(first != NULL && second != NULL); IF_FAIL_STOP;
+    ASSERT(he4_seed(first) != he4_seed(second));
+    for (size_t number = 0; number < WORDS; ++number) {
+        ASSERT(!he4_insert(first, words[number], strlen(words[number]),
+                           words[number]));
+    } // Fill the table.
+    uint64_t seed = he4_seed(first);
+    first = he4_rehash(first, 2000);
+    ASSERT(first != NULL); IF_FAIL_STOP;
+    ASSERT(he4_seed(first) == seed);
+    ASSERT(holds(first, words, WORDS));
+    ASSERT(!he4_rehash_begin(first, 4000));
+    ASSERT(he4_seed(first) == seed);
+    ASSERT(holds(first, words, WORDS));
+
+    // Setting the seed rebuilds the table, and tables with the same seed
+    // share hashes.
+    ASSERT(!he4_set_seed(first, 7));
+    ASSERT(he4_seed(first) == 7);
+    ASSERT(holds(first, words, WORDS));
+    ASSERT(!he4_set_seed(second, 7));
+    ASSERT(he4_hash_key(first, "key", 3) == he4_hash_key(second, "key", 3));
+    he4_delete(first);
+    he4_delete(second);
+
+    // Tables with their own hash ignore the seed, and tables that cannot be
+    // migrated can only be given a seed while empty.
+    HE4 * own = he4_new(1000, hash, NULL, delete_key, delete_entry);
+    ASSERT(own != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_insert(own, "12", 2, "12"));
+    ASSERT(!he4_set_seed(own, 7));
+    ASSERT(he4_hash_key(own, "12", 2) == 12);
+    he4_delete(own);
+    HE4 * cuckoo = he4_new_policy(1000, HE4_CUCKOO, NULL, NULL, delete_key,
+                                  delete_entry);
+    ASSERT(cuckoo != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_seed(cuckoo, 7));
+    ASSERT(!he4_insert(cuckoo, "12", 2, "12"));
+    ASSERT(he4_set_seed(cuckoo, 8));
+    ASSERT(he4_seed(cuckoo) == 7);
+    he4_delete(cuckoo);
+
+END_ITEM
+START_ITEM(flood)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1024, policies[which], NULL, NULL,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(!he4_set_seed(table, 0));
+        ASSERT(!he4_set_flood_limit(table, 32));
+        ASSERT(homes(table) == 1);
+        for (size_t number = 0; number < KEYS; ++number) {
+            ASSERT(!he4_insert(table, keys[number], strlen(keys[number]),
+                               keys[number]));
+        } // Flood the table.
+        if (he4_seed(table) == 0 || table->flood_limit != 64) {
+            FAIL_TEST("not re-seeded with policy: 0x%x", policies[which]);
+        }
+        if (homes(table) < KEYS / 2) {
+            FAIL_TEST("still flooded with policy: 0x%x", policies[which]);
+        }
+        if (!holds(table, keys, KEYS)) {
+            FAIL_TEST("lost keys with policy: 0x%x", policies[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+    // Pre-hashed insertions only mark the table, so that their hashes stay
+    // good, and the next call that hashes a key rebuilds it.
+    HE4 * table = he4_new_policy(1024, HE4_RANGE_MASK, NULL, NULL,
+                                 delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_seed(table, 0));
+    ASSERT(!he4_set_flood_limit(table, 32));
+    he4_hash_t hashes[KEYS];
+    for (size_t number = 0; number < KEYS; ++number) {
+        hashes[number] = he4_hash_key(table, keys[number],
+                                      strlen(keys[number]));
+    } // Hash the keys.
+    for (size_t number = 0; number < KEYS; ++number) {
+        ASSERT(!he4_insert_hashed(table, keys[number], strlen(keys[number]),
+                                  keys[number], hashes[number]));
+    } // Flood the table.
+    ASSERT(table->flooded);
+    ASSERT(he4_seed(table) == 0);
+    for (size_t number = 0; number < KEYS; ++number) {
+        ASSERT(he4_get_hashed(table, keys[number], strlen(keys[number]),
+                              hashes[number]) == keys[number]);
+    } // Check every key.
+    he4_hash_key(table, "0", 1);
+    ASSERT(!table->flooded);
+    ASSERT(he4_seed(table) != 0);
+    ASSERT(holds(table, keys, KEYS));
+    he4_delete(table);
+
+END_ITEM
+START_ITEM(settings)
+
+    HE4 * table = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_flood_limit(table, 100));
+    ASSERT(table->flood_limit == 100);
+    table = he4_rehash(table, 2000);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(table->flood_limit == 100);
+    ASSERT(!he4_set_flood_limit(table, 0));
+    ASSERT(table->flood_limit == 0);
+    ASSERT(he4_set_flood_limit(NULL, 100));
+    ASSERT(he4_set_seed(NULL, 1));
+    ASSERT(he4_seed(NULL) == 0);
+    he4_delete(table);
+
+    // Only tables with the default hash that can be migrated are guarded.
+    table = he4_new(1000, hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_set_flood_limit(table, 100));
+    he4_delete(table);
+    table = he4_new_policy(1000, HE4_HOPSCOTCH, NULL, NULL, delete_key,
+                           delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_set_flood_limit(table, 100));
+    he4_delete(table);
+    table = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 8));
+    ASSERT(he4_set_flood_limit(table, 100));
+    he4_delete(table);
+
+END_ITEM
+
+END_TEST
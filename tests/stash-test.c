@@ -0,0 +1,252 @@
+/**
+ * @file
+ * Test tables with a probe limit, whose overflow goes to the stash.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define TEST_SIZE_KEYS
+#include "test-table.h"
+
+#define LIMIT 8
+
+// Every hundred consecutive keys share a hash, so a run of keys makes a
+// cluster longer than the probe limit.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)((key / 100) * 2654435761u);
+}
+
+// The home cell of a key in a table of 64 cells is its last three digits.
+he4_hash_t home(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)(key % 1000);
+}
+
+// Scatter the keys, so that they collide at random in a small table.
+he4_hash_t scatter(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_PROBE_TRIANGULAR,
+    HE4_CONTROL_BYTES,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// The policies to churn with a small probe limit.
+static he4_policy_t churned[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_RANGE_MASK,
+    HE4_RANGE_MULTIPLY,
+    HE4_PROBE_TRIANGULAR,
+    HE4_PROBE_DOUBLE,
+    HE4_CONTROL_BYTES,
+};
+#define CHURNED (sizeof(churned) / sizeof(he4_policy_t))
+
+// Compact or trim the table, and check that every entry can still be found.
+bool reachable(HE4 * table) {
+#ifndef HE4NOTOUCH
+    if (next(2) == 0) {
+        he4_trim(table, 0);
+    } else {
+        he4_compact(table);
+    }
+#else
+    he4_compact(table);
+#endif // HE4NOTOUCH
+    size_t size = 0;
+    for (size_t index = 0; index < he4_capacity(table) + table->stashed;
+         ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map == NULL) return false;
+        bool found = map->klen == 0 ||
+                     he4_get(table, map->key, map->klen) == map->entry;
+        if (map->klen != 0) ++size;
+        HE4FREE(map);
+        if (!found) return false;
+    } // Look up every entry.
+    return size == he4_size(table);
+}
+
+// Fill the cluster for one hash until an insertion fails.  Return the first
+// key that could not be inserted.
+size_t fill(HE4 * table) {
+    size_t key = 100;
+    while (key < 200 && !he4_insert(table, key, sizeof(size_t), key + 7)) {
+        ++key;
+    } // Fill the cluster.
+    return key;
+}
+
+// Check that the keys from 100 up to (but excluding) last are present,
+// except for the removed key.
+bool present(HE4 * table, size_t last, size_t removed) {
+    for (size_t key = 100; key < last; ++key) {
+        size_t expect = key == removed ? 0 : key + 7;
+        if (he4_get(table, key, sizeof(size_t)) != expect) return false;
+    } // Check every key.
+    return true;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(limit)
+
+    // The limit is only accepted for an empty table that probes.
+    HE4 * table = he4_new(1000, hash, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, LIMIT));
+    ASSERT(table->probe_limit == LIMIT);
+    ASSERT(!he4_insert(table, 1, sizeof(size_t), 1));
+    ASSERT(he4_set_probe_limit(table, 0));
+    ASSERT(table->probe_limit == LIMIT);
+    he4_delete(table);
+    table = he4_new_policy(1000, HE4_ROBIN_HOOD, hash, compare, delete_key,
+                           delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(he4_set_probe_limit(table, LIMIT));
+    he4_delete(table);
+    ASSERT(he4_set_probe_limit(NULL, LIMIT));
+
+END_ITEM
+START_ITEM(stash)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], hash, compare,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(!he4_set_probe_limit(table, LIMIT)); IF_FAIL_STOP;
+
+        // The cluster overflows into the stash, which then fills.
+        size_t last = fill(table);
+        ASSERT(last > 100 + HE4_STASH_SIZE);
+        ASSERT(last < 200);
+        ASSERT(table->stashed == HE4_STASH_SIZE);
+        ASSERT(he4_size(table) == last - 100);
+        if (!present(table, last, 0)) {
+            FAIL_TEST("missing key with policy: 0x%x", policies[which]);
+        }
+
+        // The stash entries follow the cells.
+        size_t capacity = he4_capacity(table);
+        for (size_t slot = 0; slot < HE4_STASH_SIZE; ++slot) {
+            he4_map_t * map = he4_index(table, capacity + slot);
+            ASSERT(map != NULL); IF_FAIL_STOP;
+            ASSERT(map->key >= 100 && map->key < last);
+            ASSERT(map->entry == map->key + 7);
+            HE4FREE(map);
+        } // Check the stash.
+        ASSERT(he4_index(table, capacity + HE4_STASH_SIZE) == NULL);
+
+        // Stashed entries can be replaced and removed.
+        size_t stashed = last - 1;
+        ASSERT(!he4_insert(table, stashed, sizeof(size_t), 1));
+        ASSERT(he4_get(table, stashed, sizeof(size_t)) == 1);
+        ASSERT(*he4_find(table, stashed, sizeof(size_t)) == 1);
+        ASSERT(he4_remove(table, stashed, sizeof(size_t)) == 1);
+        ASSERT(table->stashed == HE4_STASH_SIZE - 1);
+        ASSERT(he4_size(table) == last - 101);
+        ASSERT(!he4_insert(table, stashed, sizeof(size_t), stashed + 7));
+        ASSERT(!he4_discard(table, last - 2, sizeof(size_t)));
+        ASSERT(!he4_insert(table, last - 2, sizeof(size_t), last + 5));
+        ASSERT(he4_get(table, last - 2, sizeof(size_t)) == last + 5);
+        ASSERT(!he4_insert(table, last - 2, sizeof(size_t), last + 5));
+        ASSERT(!he4_insert(table, last - 2, sizeof(size_t), last - 2 + 7));
+        ASSERT(present(table, last, 0));
+
+        // Forcing an insertion overwrites an entry in the table.
+        ASSERT(he4_insert(table, last, sizeof(size_t), last + 7));
+        ASSERT(he4_force_insert(table, last, sizeof(size_t), last + 7));
+        ASSERT(he4_get(table, last, sizeof(size_t)) == last + 7);
+        ASSERT(he4_size(table) == last - 100);
+
+        // Removing entries from the table and trimming moves stashed
+        // entries back into the table.
+        size_t moved = 0;
+        for (size_t key = 100; key <= last && moved < 3; ++key) {
+            if (he4_remove(table, key, sizeof(size_t)) != 0) ++moved;
+        } // Remove some entries.
+        ASSERT(moved == 3);
+        size_t size = he4_size(table);
+        he4_trim(table, 0);
+        ASSERT(table->stashed == HE4_STASH_SIZE - 3);
+        ASSERT(he4_size(table) == size);
+        size_t found = 0;
+        for (size_t key = 100; key <= last; ++key) {
+            size_t entry = he4_get(table, key, sizeof(size_t));
+            if (entry == 0) continue;
+            ASSERT(entry == key + 7);
+            ++found;
+        } // Check every key.
+        ASSERT(found == size);
+
+        // Rehashing keeps the limit and every entry.
+        table = he4_rehash(table, 2000);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(table->probe_limit == LIMIT);
+        ASSERT(he4_size(table) == size);
+        found = 0;
+        for (size_t key = 100; key <= last; ++key) {
+            size_t entry = he4_get(table, key, sizeof(size_t));
+            if (entry == 0) continue;
+            ASSERT(entry == key + 7);
+            ++found;
+        } // Check every key.
+        ASSERT(found == size);
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+START_ITEM(compact)
+
+    // Keys 1061 and 2061 start at cell 61, 1062 at cell 62, and 1063 at
+    // cell 63, so 1063 wraps around to cell 0.  Moving it back to cell 63
+    // must not push the others, in turn, past their probe limit.
+    HE4 * table = he4_new(64, home, compare, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 3)); IF_FAIL_STOP;
+    size_t keys[] = { 1061, 2061, 1062, 1063 };
+    for (size_t at = 0; at < 4; ++at) {
+        ASSERT(!he4_insert(table, keys[at], sizeof(size_t), keys[at] + 7));
+    } // Make the cluster.
+    ASSERT(table->stashed == 0);
+    he4_compact(table);
+    for (size_t at = 0; at < 4; ++at) {
+        ASSERT(he4_get(table, keys[at], sizeof(size_t)) == keys[at] + 7);
+    } // Check the cluster.
+    he4_delete(table);
+
+    // Compacting and trimming keep every entry within the probe limit, as
+    // does compacting automatically when there are many deleted cells.
+    for (size_t which = 0; which < CHURNED; ++which) {
+        table = he4_new_policy(64, churned[which], scatter, compare,
+                               delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        ASSERT(!he4_set_probe_limit(table, 3)); IF_FAIL_STOP;
+        ASSERT(!he4_set_deleted_ratio(table, 0.03)); IF_FAIL_STOP;
+        size_t model[61] = { 0 };
+        const char * problem = churn(table, model, 60, 20000, 0.0, reachable);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, churned[which]);
+        }
+        he4_delete(table);
+    } // Try every policy.
+
+END_ITEM
+
+END_TEST
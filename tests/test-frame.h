@@ -335,7 +335,7 @@ int main(int argc, char *argv[]) { \
 #define START_ITEM(item_name_m) \
 	if (tf_item_enabled) { \
 		tf_need_space = false; \
-		char * item_name = STRINGIFY(item_name_m); \
+		const char * item_name = STRINGIFY(item_name_m); \
 		TS("Starting item %s", item_name); \
 		tf_need_space = false; \
 		tf_need_indent = true; \
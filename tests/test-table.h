@@ -0,0 +1,178 @@
+#ifndef TEST_TABLE_H_
+#define TEST_TABLE_H_
+
+/**
+ * @file
+ * Keys, a generator, and random churn shared by the table tests.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ *
+ * Include this instead of `test-frame.h`.  If `TEST_SIZE_KEYS` is defined
+ * first, this also includes `he4.h` with keys and entries of type `size_t`,
+ * and provides the functions for such tables: a hash, a comparison, the
+ * deallocation functions, and churn against a model or against a plain
+ * table.  Entries are never zero, so a zero in a model means the key is not
+ * in the table.
+ */
+
+#include "test-frame.h"
+
+// Every four consecutive keys share a group, and keys in a group share a
+// hash, so that the key comparison is exercised.
+#define KEY_GROUP(m_key) ((m_key) / 4)
+
+// Short string keys are copied into the cell, and are not owned by the table.
+#ifdef HE4_INLINE_KEYS
+#  define OWNED(m_klen) ((m_klen) > HE4_INLINE_KEYS)
+#else
+#  define OWNED(m_klen) true
+#endif // HE4_INLINE_KEYS
+
+// A simple deterministic generator, so failures can be reproduced.
+static size_t state = 12345;
+size_t next(size_t limit) {
+    state = state * 6364136223846793005u + 1442695040888963407u;
+    return (state >> 33) % limit;
+}
+
+#ifdef TEST_SIZE_KEYS
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+#include <he4.h>
+
+he4_hash_t group_hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)(KEY_GROUP(key) * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+
+// Count the keys deallocated, so that ownership can be checked.
+static size_t deleted_keys = 0;
+void delete_key(he4_key_t key) { (void)key; ++deleted_keys; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// Apply random insertions, removals, and searches for the keys 1 to keys,
+// and check each against the model.  An insertion of a new key may only fail
+// once the load reaches full_load.  Every hundred steps, and at the end, the
+// table must pass the check, if there is one.  Return a description of the
+// first problem found, or NULL.
+const char * churn(HE4 * table, size_t * model, size_t keys, size_t steps,
+                   double full_load, bool (* check)(HE4 * table)) {
+    for (size_t step = 0; step < steps; ++step) {
+        size_t key = next(keys) + 1;
+        size_t entry = next(100000) + 1;
+        switch (next(5)) {
+            case 0:
+            case 1: {
+                bool failed = he4_insert(table, key, sizeof(size_t), entry);
+                if (!failed) {
+                    model[key] = entry;
+                } else if (model[key] != 0 || he4_load(table) < full_load) {
+                    return "insert";
+                }
+                break;
+            }
+            case 2:
+            case 3:
+                if (he4_remove(table, key, sizeof(size_t)) != model[key]) {
+                    return "remove";
+                }
+                model[key] = 0;
+                break;
+            default: {
+                he4_entry_t * pentry = he4_find(table, key, sizeof(size_t));
+                if ((pentry == NULL) != (model[key] == 0)) return "find";
+                if (pentry != NULL && *pentry != model[key]) return "find";
+                break;
+            }
+        } // Apply the operation.
+        if (check != NULL && step % 100 == 0 && !check(table)) {
+            return "invalid table";
+        }
+    } // Churn the table.
+    for (size_t key = 1; key <= keys; ++key) {
+        if (he4_get(table, key, sizeof(size_t)) != model[key]) return "get";
+    } // Check every key.
+    if (check != NULL && !check(table)) return "invalid table";
+    return NULL;
+}
+
+// Check that two tables hold the same mappings in the same cells.
+bool same(HE4 * t1, HE4 * t2) {
+    if (he4_size(t1) != he4_size(t2)) return false;
+    if (he4_capacity(t1) != he4_capacity(t2)) return false;
+    for (size_t index = 0; index < he4_capacity(t1); ++index) {
+        he4_map_t * m1 = he4_index(t1, index);
+        he4_map_t * m2 = he4_index(t2, index);
+        bool ok = m1->key == m2->key && m1->klen == m2->klen &&
+                  m1->entry == m2->entry;
+        HE4FREE(m1);
+        HE4FREE(m2);
+        if (!ok) return false;
+    } // Compare all cells.
+    return true;
+}
+
+// Apply the same random operations for the keys 1 to keys to a plain table
+// and to a table with another policy, which must always agree, and must
+// hold their entries in the same cells.  Return a description of the first
+// problem found, or NULL.
+const char * churn_against(HE4 * plain, HE4 * table, size_t keys,
+                           size_t steps) {
+    for (size_t step = 0; step < steps; ++step) {
+        size_t key = next(keys) + 1;
+        size_t entry = next(100000) + 1;
+        switch (next(6)) {
+            case 0:
+                if (he4_insert(plain, key, sizeof(size_t), entry) !=
+                    he4_insert(table, key, sizeof(size_t), entry)) {
+                    return "insert";
+                }
+                break;
+            case 1:
+                if (he4_force_insert(plain, key, sizeof(size_t), entry) !=
+                    he4_force_insert(table, key, sizeof(size_t), entry)) {
+                    return "force insert";
+                }
+                break;
+            case 2:
+            case 3:
+                if (he4_remove(plain, key, sizeof(size_t)) !=
+                    he4_remove(table, key, sizeof(size_t))) {
+                    return "remove";
+                }
+                break;
+            case 4:
+                if (he4_get(plain, key, sizeof(size_t)) !=
+                    he4_get(table, key, sizeof(size_t))) {
+                    return "get";
+                }
+                break;
+            default: {
+                he4_entry_t * p1 = he4_find(plain, key, sizeof(size_t));
+                he4_entry_t * p2 = he4_find(table, key, sizeof(size_t));
+                if ((p1 == NULL) != (p2 == NULL)) return "find";
+                if (p1 != NULL && *p1 != *p2) return "find";
+                break;
+            }
+        } // Apply the operation.
+        if (step % 1000 == 0 && !same(plain, table)) return "tables differ";
+    } // Churn the tables.
+    if (!same(plain, table)) return "tables differ";
+    return NULL;
+}
+#endif // TEST_SIZE_KEYS
+
+#endif /*TEST_TABLE_H_*/
@@ -0,0 +1,136 @@
+/**
+ * @file
+ * Test the touch indices, and their rebasing by trim.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 800
+
+// Every four consecutive keys share a hash, so that the key comparison is
+// exercised.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)((key / 4) * 2654435761u);
+}
+int compare(he4_key_t key1, size_t klen1, he4_key_t key2, size_t klen2) {
+    (void)klen1;
+    (void)klen2;
+    return (key1 == key2 ? 0 : 1);
+}
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// Find the touch index of every key in the table.
+void touches(HE4 * table, size_t * touch) {
+    for (size_t key = 0; key <= KEYS; ++key) touch[key] = SIZE_MAX;
+    for (size_t index = 0; index < he4_capacity(table); ++index) {
+        he4_map_t * map = he4_index(table, index);
+        if (map->key != 0 && map->key <= KEYS) touch[map->key] = map->touch;
+        HE4FREE(map);
+    } // Check every cell.
+}
+
+START_TEST
+
+    he4_debug = 1;
+    size_t before[KEYS + 1];
+    size_t after[KEYS + 1];
+    HE4 * table = he4_new(1000, hash, compare, delete_key, delete_entry);
+
+START_ITEM(cells)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+#ifdef HE4COMPACT
+    // Compact cells must fit in 24 bytes, or 32 with 64-bit hashes, plus any
+    // inline key.
+    size_t bytes = sizeof(he4_hash_t) > 4 ? 32 : 24;
+#ifdef HE4_INLINE_KEYS
+    ASSERT(sizeof(he4_cell_t) <= bytes + sizeof(he4_ikey_t));
+#else
+    ASSERT(sizeof(he4_cell_t) <= bytes);
+#endif // HE4_INLINE_KEYS
+    ASSERT(he4_best_capacity(1024 * 1024) >
+           (1024 * 1024 - sizeof(HE4)) / sizeof(he4_map_t));
+#endif // HE4COMPACT
+
+END_ITEM
+START_ITEM(trim)
+
+    // Fill the table, and then delete and use some of the entries.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        ASSERT(!he4_insert(table, key, sizeof(size_t), key));
+    } // Fill the table.
+    for (size_t key = 3; key <= KEYS; key += 5) {
+        ASSERT(he4_remove(table, key, sizeof(size_t)) == key);
+    } // Delete some entries.
+    for (size_t key = 1; key <= KEYS; key += 7) {
+        he4_get(table, key, sizeof(size_t));
+    } // Use some entries.
+    IF_FAIL_STOP;
+
+    // Trim the table, and check that the touch indices of the entries that
+    // were kept were rebased.
+    touches(table, before);
+    size_t max_touch = he4_max_touch(table);
+    size_t threshold = max_touch / 2;
+    he4_trim(table, threshold);
+    ASSERT(he4_max_touch(table) == max_touch - threshold);
+    touches(table, after);
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (before[key] == SIZE_MAX || before[key] < threshold) {
+            if (after[key] != SIZE_MAX) {
+                FAIL_TEST("kept key: %zu", key);
+            }
+        } else if (after[key] != before[key] - threshold) {
+            FAIL_TEST("touch not rebased for key: %zu", key);
+        }
+    } // Check every key.
+    for (size_t key = 1; key <= KEYS; ++key) {
+        he4_entry_t entry = he4_get(table, key, sizeof(size_t));
+        if (entry != (after[key] == SIZE_MAX ? 0 : key)) {
+            FAIL_TEST("wrong entry for key: %zu", key);
+        }
+    } // Check every key.
+
+END_ITEM
+START_ITEM(limit)
+
+    // Use the entries many times.  The touch indices must never pass the
+    // maximum touch index.
+    for (size_t step = 0; step < 20000; ++step) {
+        size_t key = (step * 7919) % KEYS + 1;
+        if (he4_get(table, key, sizeof(size_t)) == 0) {
+            he4_insert(table, key, sizeof(size_t), key);
+        }
+    } // Use the entries.
+#ifdef HE4COMPACT
+    ASSERT(he4_max_touch(table) <= HE4_TOUCH_LIMIT);
+#endif // HE4COMPACT
+    touches(table, after);
+    for (size_t key = 1; key <= KEYS; ++key) {
+        if (after[key] != SIZE_MAX && after[key] > he4_max_touch(table)) {
+            FAIL_TEST("touch index too large for key: %zu", key);
+        }
+    } // Check every key.
+
+END_ITEM
+
+    // Done.
+    he4_delete(table);
+
+END_TEST
@@ -0,0 +1,166 @@
+/**
+ * @file
+ * Test finding or inserting keys with a single search.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE char *
+#define HE4_ENTRY_TYPE size_t
+
+#include <string.h>
+#include "test-table.h"
+#include <he4.h>
+
+#define WORDS 400
+
+// Words share a hash in groups of four, so that the key comparison is
+// exercised.
+he4_hash_t hash(he4_key_t key, size_t klen) {
+    (void)klen;
+    return (he4_hash_t)((strtoul(key, NULL, 10) / 4) * 2654435761u);
+}
+
+// Count the keys, so that every clone can be checked to be freed.
+static size_t live_keys = 0;
+void delete_key(he4_key_t key) { --live_keys; HE4FREE(key); }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+// The policies to test.
+static he4_policy_t policies[] = {
+    HE4_POLICY_DEFAULT,
+    HE4_PROBE_TRIANGULAR,
+    HE4_CONTROL_BYTES,
+    HE4_ROBIN_HOOD,
+    HE4_HOPSCOTCH,
+    HE4_CUCKOO,
+};
+#define POLICIES (sizeof(policies) / sizeof(he4_policy_t))
+
+// Count words read into a reused buffer, copying each word only when it is
+// inserted.  Return a description of the first problem found, or NULL.
+const char * count(HE4 * table) {
+    size_t model[WORDS] = { 0 };
+    char buffer[32];
+    for (size_t step = 0; step < 20000; ++step) {
+        size_t word = next(WORDS);
+        size_t len = (size_t)snprintf(buffer, sizeof(buffer), "%zu", word);
+        bool inserted = true;
+        size_t * value = he4_find_or_insert(table, buffer, len, &inserted);
+        if (value == NULL) return "find or insert";
+        if (inserted != (model[word] == 0)) return "inserted";
+        if (inserted && *value != 0) return "new entry";
+        if (inserted && OWNED(len)) {
+            char * clone = HE4MALLOC(char, len + 1);
+            memcpy(clone, buffer, len);
+            ++live_keys;
+            if (he4_set_key(table, value, clone)) return "set key";
+        }
+        if (*value != model[word]) return "count";
+        ++*value;
+        ++model[word];
+    } // Count the words.
+    for (size_t word = 0; word < WORDS; ++word) {
+        size_t len = (size_t)snprintf(buffer, sizeof(buffer), "%zu", word);
+        if (he4_get(table, buffer, len) != model[word]) return "final count";
+    } // Check every count.
+    return NULL;
+}
+
+START_TEST
+
+    he4_debug = 1;
+
+START_ITEM(policies)
+
+    for (size_t which = 0; which < POLICIES; ++which) {
+        HE4 * table = he4_new_policy(1000, policies[which], hash, NULL,
+                                     delete_key, delete_entry);
+        ASSERT(table != NULL); IF_FAIL_STOP;
+        const char * problem = count(table);
+        if (problem != NULL) {
+            FAIL_TEST("%s with policy: 0x%x", problem, policies[which]);
+        }
+        he4_delete(table);
+        if (live_keys != 0) {
+            FAIL_TEST("leaked keys with policy: 0x%x", policies[which]);
+        }
+        live_keys = 0;
+    } // Try every policy.
+
+    // Entries that overflow into the stash can be found and inserted too.
+    HE4 * table = he4_new(1000, hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_probe_limit(table, 2)); IF_FAIL_STOP;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t word = 0; word < 4; ++word) {
+            char buffer[4];
+            size_t len = (size_t)snprintf(buffer, sizeof(buffer), "%zu", word);
+            bool inserted = false;
+            size_t * value = he4_find_or_insert(table, buffer, len, &inserted);
+            ASSERT(value != NULL); IF_FAIL_STOP;
+            ASSERT(inserted == (pass == 0));
+            if (inserted && OWNED(len)) {
+                char * clone = HE4MALLOC(char, len + 1);
+                memcpy(clone, buffer, len);
+                ++live_keys;
+                ASSERT(!he4_set_key(table, value, clone));
+            }
+            ++*value;
+        } // Find or insert a group of words with the same hash.
+    } // Make two passes.
+    ASSERT(table->stashed == 2);
+    ASSERT(he4_get(table, "3", 1) == 2);
+    he4_delete(table);
+    ASSERT(live_keys == 0);
+
+    // Tables can also resize as they go.
+    table = he4_new(64, hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    ASSERT(!he4_set_auto_resize(table, 0.1, 0.7, 0));
+    ASSERT(count(table) == NULL);
+    ASSERT(he4_capacity(table) > 64);
+    he4_delete(table);
+    ASSERT(live_keys == 0);
+
+END_ITEM
+START_ITEM(full)
+
+    // A full table returns NULL for a new key, and the entry for an old one.
+    HE4 * table = he4_new(64, hash, NULL, delete_key, delete_entry);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t word = 0; word < 64; ++word) {
+        char * key = HE4MALLOC(char, 4);
+        snprintf(key, 4, "%zu", word);
+        ASSERT(!he4_insert(table, key, strlen(key), word + 1));
+        if (OWNED(strlen(key))) ++live_keys; else HE4FREE(key);
+    } // Fill the table.
+    bool inserted = true;
+    ASSERT(he4_find_or_insert(table, "64", 2, &inserted) == NULL);
+    size_t * value = he4_find_or_insert(table, "17", 2, &inserted);
+    ASSERT(value != NULL); IF_FAIL_STOP;
+    ASSERT(!inserted);
+    ASSERT(*value == 18);
+    ASSERT(he4_find_or_insert(table, "17", 2, NULL) == value);
+
+    // Only pointers to entries in the table are accepted.
+    size_t outside = 0;
+    ASSERT(he4_set_key(table, &outside, "17"));
+    ASSERT(he4_set_key(table, value, NULL));
+    ASSERT(he4_set_key(NULL, value, "17"));
+    ASSERT(he4_find_or_insert(NULL, "17", 2, NULL) == NULL);
+    ASSERT(he4_find_or_insert(table, "17", 0, NULL) == NULL);
+    he4_delete(table);
+    ASSERT(live_keys == 0);
+
+END_ITEM
+
+END_TEST
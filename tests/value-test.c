@@ -0,0 +1,102 @@
+/**
+ * @file
+ * Test storing entries by value, including zero, if HE4_ENTRY_VALUE is
+ * defined.
+ *
+ * @code{text}
+ * |_| _ |_|
+ * | |(/_  |
+ * @endcode
+ *
+ * Copyright (c) 2015 by Stacy Prowell, all rights reserved.  Licensed under
+ * the BSD 2-Clause license.  See the file license that is part of this
+ * distribution.  This file may not be copied, modified, or distributed except
+ * according to those terms.
+ */
+
+#define HE4_KEY_TYPE size_t *
+#define HE4_ENTRY_TYPE size_t
+
+#include "test-frame.h"
+#include <he4.h>
+
+#define KEYS 500
+
+// The keys.  The table does not own them.
+static size_t keys[KEYS];
+void delete_key(he4_key_t key) { (void)key; }
+void delete_entry(he4_entry_t entry) { (void)entry; }
+
+START_TEST
+
+    he4_debug = 1;
+    for (size_t number = 0; number < KEYS; ++number) keys[number] = number;
+#ifdef HE4_ENTRY_VALUE
+    // By-value entries need no deallocation function.
+    HE4 * table = he4_new(1000, NULL, NULL, delete_key, NULL);
+#else
+    HE4 * table = he4_new(1000, NULL, NULL, delete_key, delete_entry);
+#endif // HE4_ENTRY_VALUE
+
+START_ITEM(insert)
+
+    ASSERT(table != NULL); IF_FAIL_STOP;
+#ifdef HE4_ENTRY_VALUE
+    // Every entry, including zero, can be stored.
+    for (size_t number = 0; number < KEYS; ++number) {
+        if (he4_insert(table, keys + number, sizeof(size_t), number % 3)) {
+            FAIL_TEST("insertion of key: %zu", number);
+        }
+    } // Insert the keys.
+    ASSERT(he4_size(table) == KEYS);
+#else
+    // A zero entry is the same as NULL, and is rejected.
+    ASSERT(he4_insert(table, keys, sizeof(size_t), 0));
+    ASSERT(he4_force_insert(table, keys, sizeof(size_t), 0));
+    ASSERT(he4_size(table) == 0);
+#endif // HE4_ENTRY_VALUE
+
+END_ITEM
+#ifdef HE4_ENTRY_VALUE
+START_ITEM(find)
+
+    // Stored zeros are found, and are distinct from missing keys.
+    for (size_t number = 0; number < KEYS; ++number) {
+        he4_entry_t * entry = he4_find(table, keys + number, sizeof(size_t));
+        if (entry == NULL || *entry != number % 3) {
+            FAIL_TEST("wrong entry for key: %zu", number);
+        }
+        if (he4_get(table, keys + number, sizeof(size_t)) != number % 3) {
+            FAIL_TEST("wrong entry for key: %zu", number);
+        }
+    } // Check the keys.
+    size_t missing = KEYS;
+    ASSERT(he4_find(table, &missing, sizeof(size_t)) == NULL);
+    ASSERT(he4_get(table, &missing, sizeof(size_t)) == 0);
+
+END_ITEM
+START_ITEM(remove)
+
+    // Replace, remove, and discard zeros.
+    ASSERT(!he4_insert(table, keys, sizeof(size_t), 0));
+    ASSERT(he4_remove(table, keys, sizeof(size_t)) == 0);
+    ASSERT(he4_find(table, keys, sizeof(size_t)) == NULL);
+    ASSERT(!he4_discard(table, keys + 3, sizeof(size_t)));
+    ASSERT(he4_find(table, keys + 3, sizeof(size_t)) == NULL);
+    ASSERT(he4_size(table) == KEYS - 2);
+    table = he4_rehash(table, 0);
+    ASSERT(table != NULL); IF_FAIL_STOP;
+    for (size_t number = 6; number < KEYS; number += 3) {
+        he4_entry_t * entry = he4_find(table, keys + number, sizeof(size_t));
+        if (entry == NULL || *entry != 0) {
+            FAIL_TEST("wrong entry for key: %zu", number);
+        }
+    } // Check the zeros.
+
+END_ITEM
+#endif // HE4_ENTRY_VALUE
+
+    // Done.
+    he4_delete(table);
+
+END_TEST